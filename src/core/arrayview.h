@@ -0,0 +1,48 @@
+#ifndef ARRAYVIEW_H
+#define ARRAYVIEW_H
+
+#include <assert.h>
+#include <stddef.h>
+#include <vector>
+
+// read-only window onto contiguous elements owned by someone else
+template <typename T>
+class ArrayView {
+public:
+	ArrayView() :
+		elements(nullptr),
+		count(0)
+	{
+	}
+
+	ArrayView(const T *elements, size_t count) :
+		elements(elements),
+		count(count)
+	{
+	}
+
+	ArrayView(const std::vector<T> &vector) :
+		elements(vector.data()),
+		count(vector.size())
+	{
+	}
+
+	const T *data() const { return elements; }
+	size_t size() const { return count; }
+	bool empty() const { return count == 0; }
+
+	const T *begin() const { return elements; }
+	const T *end() const { return elements + count; }
+
+	const T &operator[](size_t index) const
+	{
+		assert(index < count);
+		return elements[index];
+	}
+
+private:
+	const T *elements;
+	size_t count;
+};
+
+#endif // ARRAYVIEW_H
@@ -0,0 +1,307 @@
+#include "asyncfilereader.h"
+#include "threadpool.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <algorithm>
+#include <stdexcept>
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<liburing.h>)
+#include <liburing.h>
+#define HAVE_IO_URING
+#endif
+#endif
+
+using std::min;
+using std::runtime_error;
+using std::vector;
+
+ReadableFile::ReadableFile(const char *path)
+{
+#ifdef WIN32
+	handle = CreateFile(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (INVALID_HANDLE_VALUE == handle)
+		throw runtime_error("failed to open file for reading");
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(handle, &fileSize)) {
+		CloseHandle(handle);
+		throw runtime_error("failed to get file size");
+	}
+	size = uint64_t(fileSize.QuadPart);
+#else
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		throw runtime_error("failed to open file for reading");
+
+	struct stat st;
+	if (fstat(fd, &st) < 0) {
+		close(fd);
+		throw runtime_error("failed to get file size");
+	}
+	size = uint64_t(st.st_size);
+#endif
+}
+
+ReadableFile::~ReadableFile()
+{
+#ifdef WIN32
+	CloseHandle(handle);
+#else
+	close(fd);
+#endif
+}
+
+int64_t ReadableFile::readAt(uint64_t offset, void *dst, size_t count) const
+{
+	auto bytes = static_cast<uint8_t *>(dst);
+	size_t done = 0;
+	while (done < count) {
+#ifdef WIN32
+		OVERLAPPED overlapped = {};
+		overlapped.Offset = DWORD(offset + done);
+		overlapped.OffsetHigh = DWORD((offset + done) >> 32);
+
+		DWORD bytesRead;
+		auto toRead = DWORD(min(count - done, size_t(1) << 30));
+		if (!ReadFile(handle, bytes + done, toRead, &bytesRead, &overlapped))
+			return -1;
+#else
+		auto bytesRead = pread(fd, bytes + done, count - done, off_t(offset + done));
+		if (bytesRead < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+#endif
+		if (bytesRead == 0)
+			break;
+		done += size_t(bytesRead);
+	}
+	return int64_t(done);
+}
+
+AsyncFileReader::AsyncFileReader(unsigned queueDepth, size_t chunkSize) :
+	queueDepth(std::max(queueDepth, 1u)),
+	chunkSize(std::max(chunkSize, size_t(4096))),
+	pendingRequests(0),
+	ring(nullptr),
+	chunksInFlight(0),
+	pendingChunks(0)
+{
+	resetStatistics();
+
+#ifdef HAVE_IO_URING
+	// not every kernel (or sandbox) allows io_uring, so failing here is fine
+	auto uring = new io_uring;
+	if (io_uring_queue_init(this->queueDepth, uring, 0) == 0)
+		ring = uring;
+	else
+		delete uring;
+#endif
+}
+
+AsyncFileReader::~AsyncFileReader()
+{
+	// in-flight reads still write to their destinations
+	try {
+		wait();
+	} catch (...) {
+	}
+
+#ifdef HAVE_IO_URING
+	if (ring != nullptr) {
+		auto uring = static_cast<io_uring *>(ring);
+		io_uring_queue_exit(uring);
+		delete uring;
+	}
+#endif
+}
+
+void AsyncFileReader::resetStatistics()
+{
+	statistics = Statistics();
+}
+
+void AsyncFileReader::read(const ReadableFile &file, uint64_t offset, size_t size, void *dst)
+{
+	if (offset > file.getSize() || size > file.getSize() - offset)
+		throw runtime_error("read outside of file");
+
+	if (size == 0)
+		return;
+
+	auto now = Clock::now();
+	auto chunkCount = (size + chunkSize - 1) / chunkSize;
+	size_t firstChunk;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		if (pendingRequests++ == 0)
+			busyStart = now;
+
+		Request request = { now, chunkCount, size };
+		requests.push_back(request);
+
+		firstChunk = chunks.size();
+		for (size_t i = 0; i < chunkCount; ++i) {
+			auto chunkOffset = i * chunkSize;
+			Chunk chunk = { &file, offset + chunkOffset, min(chunkSize, size - chunkOffset), static_cast<uint8_t *>(dst) + chunkOffset, requests.size() - 1 };
+			chunks.push_back(chunk);
+		}
+		pendingChunks += chunkCount;
+	}
+
+	if (ring != nullptr) {
+		for (size_t i = 0; i < chunkCount; ++i)
+			queuedChunks.push_back(firstChunk + i);
+		pumpRing(false);
+		return;
+	}
+
+	for (size_t i = 0; i < chunkCount; ++i) {
+		auto index = firstChunk + i;
+		auto chunk = chunks[index]; // the vector may grow while the job runs
+
+		ThreadPool::getDefault().enqueue([this, index, chunk]() {
+			auto bytesRead = chunk.file->readAt(chunk.offset, chunk.dst, chunk.size);
+
+			std::lock_guard<std::mutex> lock(mutex);
+			if (bytesRead != int64_t(chunk.size))
+				failChunk(bytesRead < 0 ? "failed to read file" : "unexpected end of file");
+			completeChunk(index);
+			chunkDone.notify_one();
+		});
+	}
+}
+
+// called with the mutex held
+void AsyncFileReader::completeChunk(size_t chunk)
+{
+	assert(pendingChunks > 0);
+	pendingChunks--;
+
+	auto &request = requests[chunks[chunk].request];
+	assert(request.pendingChunks > 0);
+	if (--request.pendingChunks > 0)
+		return;
+
+	auto now = Clock::now();
+	auto latency = std::chrono::duration<double>(now - request.start).count();
+
+	statistics.minLatency = statistics.requestCount > 0 ? std::min(statistics.minLatency, latency) : latency;
+	statistics.maxLatency = std::max(statistics.maxLatency, latency);
+	statistics.totalLatency += latency;
+	statistics.requestCount++;
+	statistics.byteCount += request.size;
+
+	assert(pendingRequests > 0);
+	if (--pendingRequests == 0)
+		statistics.busyTime += std::chrono::duration<double>(now - busyStart).count();
+}
+
+// called with the mutex held; the first error wins
+void AsyncFileReader::failChunk(const char *message)
+{
+	if (error.empty())
+		error = message;
+}
+
+void AsyncFileReader::pumpRing(bool block)
+{
+#ifdef HAVE_IO_URING
+	auto uring = static_cast<io_uring *>(ring);
+
+	while (!queuedChunks.empty() && chunksInFlight < queueDepth) {
+		auto sqe = io_uring_get_sqe(uring);
+		if (sqe == nullptr)
+			break;
+
+		auto index = queuedChunks.front();
+		queuedChunks.pop_front();
+
+		auto &chunk = chunks[index];
+		io_uring_prep_read(sqe, chunk.file->getDescriptor(), chunk.dst, unsigned(chunk.size), chunk.offset);
+		io_uring_sqe_set_data(sqe, reinterpret_cast<void *>(uintptr_t(index)));
+		chunksInFlight++;
+	}
+
+	// also retries entries a failed submit left behind
+	if (chunksInFlight > 0) {
+		auto ret = io_uring_submit(uring);
+		if (ret < 0 && ret != -EINTR && ret != -EAGAIN && ret != -EBUSY)
+			throw runtime_error("failed to submit reads");
+	}
+
+	while (chunksInFlight > 0) {
+		io_uring_cqe *cqe;
+		auto ret = block ? io_uring_wait_cqe(uring, &cqe) : io_uring_peek_cqe(uring, &cqe);
+		if (ret == -EAGAIN || ret == -EINTR) {
+			if (block)
+				continue;
+			break;
+		}
+		if (ret < 0)
+			throw runtime_error("failed to wait for reads");
+
+		auto index = size_t(reinterpret_cast<uintptr_t>(io_uring_cqe_get_data(cqe)));
+		auto result = cqe->res;
+		io_uring_cqe_seen(uring, cqe);
+		chunksInFlight--;
+
+		auto &chunk = chunks[index];
+		if (result == -EAGAIN || result == -EINTR) {
+			queuedChunks.push_back(index);
+		} else if (result > 0 && size_t(result) < chunk.size) {
+			// short read; queue the rest
+			chunk.offset += unsigned(result);
+			chunk.dst += result;
+			chunk.size -= unsigned(result);
+			queuedChunks.push_back(index);
+		} else {
+			std::lock_guard<std::mutex> lock(mutex);
+			if (result < 0)
+				failChunk("failed to read file");
+			else if (result == 0)
+				failChunk("unexpected end of file");
+			completeChunk(index);
+		}
+
+		// only block for the first completion, then refill the queue
+		if (block && !queuedChunks.empty())
+			break;
+		block = false;
+	}
+#else
+	(void)block;
+	assert(!"no io_uring support compiled in");
+#endif
+}
+
+void AsyncFileReader::wait()
+{
+	if (ring != nullptr) {
+		while (!queuedChunks.empty() || chunksInFlight > 0)
+			pumpRing(true);
+	}
+
+	std::unique_lock<std::mutex> lock(mutex);
+	chunkDone.wait(lock, [this]() { return pendingChunks == 0; });
+
+	chunks.clear();
+	requests.clear();
+
+	if (!error.empty()) {
+		auto message = error;
+		error.clear();
+		throw runtime_error(message);
+	}
+}
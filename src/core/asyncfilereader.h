@@ -0,0 +1,131 @@
+#ifndef ASYNCFILEREADER_H
+#define ASYNCFILEREADER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#ifdef WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#endif
+
+// an open file that AsyncFileReader can read from; must outlive the reads
+class ReadableFile {
+public:
+	explicit ReadableFile(const char *path);
+	~ReadableFile();
+
+	uint64_t getSize() const { return size; }
+
+#ifdef WIN32
+	HANDLE getHandle() const { return handle; }
+#else
+	int getDescriptor() const { return fd; }
+#endif
+
+	// positional read on the calling thread; returns the number of bytes read, or -1
+	int64_t readAt(uint64_t offset, void *dst, size_t count) const;
+
+private:
+	ReadableFile(const ReadableFile &) = delete;
+	ReadableFile &operator=(const ReadableFile &) = delete;
+
+#ifdef WIN32
+	HANDLE handle;
+#else
+	int fd;
+#endif
+	uint64_t size;
+};
+
+/*
+ * Queues many reads at once and keeps them in flight together, so bulk
+ * loads keep a fast SSD busy instead of faulting in one page at a time.
+ * Requests are split into chunks; on Linux these go through io_uring when
+ * liburing is available at build time and the kernel lets us set up a ring,
+ * otherwise each chunk is a positional read on the default thread pool.
+ *
+ * read() only queues; the destination has to stay untouched until wait()
+ * returns. One reader belongs to one thread, and wait() must not be called
+ * from a thread pool worker.
+ */
+class AsyncFileReader {
+public:
+	struct Statistics {
+		uint64_t requestCount;
+		uint64_t byteCount;
+		double minLatency, maxLatency, totalLatency; // seconds, from read() to completion
+		double busyTime; // seconds with at least one request in flight
+
+		double getAverageLatency() const { return requestCount > 0 ? totalLatency / requestCount : 0.0; }
+
+		// bytes per second while busy
+		double getThroughput() const { return busyTime > 0.0 ? byteCount / busyTime : 0.0; }
+	};
+
+	explicit AsyncFileReader(unsigned queueDepth = 64, size_t chunkSize = 1024 * 1024);
+	~AsyncFileReader();
+
+	void read(const ReadableFile &file, uint64_t offset, size_t size, void *dst);
+
+	// blocks until every queued read has completed; throws if any of them failed
+	void wait();
+
+	bool usesIoUring() const { return ring != nullptr; }
+
+	const Statistics &getStatistics() const { return statistics; }
+	void resetStatistics();
+
+private:
+	AsyncFileReader(const AsyncFileReader &) = delete;
+	AsyncFileReader &operator=(const AsyncFileReader &) = delete;
+
+	typedef std::chrono::steady_clock Clock;
+
+	struct Chunk {
+		const ReadableFile *file;
+		uint64_t offset;
+		size_t size;
+		uint8_t *dst;
+		size_t request;
+	};
+
+	struct Request {
+		Clock::time_point start;
+		size_t pendingChunks;
+		size_t size;
+	};
+
+	void completeChunk(size_t chunk);
+	void failChunk(const char *error);
+
+	// io_uring only: fills the submission queue and reaps completions
+	void pumpRing(bool block);
+
+	unsigned queueDepth;
+	size_t chunkSize;
+
+	std::vector<Chunk> chunks;
+	std::vector<Request> requests;
+	size_t pendingRequests;
+	Clock::time_point busyStart;
+	std::string error;
+	Statistics statistics;
+
+	void *ring; // struct io_uring, when in use
+	std::deque<size_t> queuedChunks;
+	unsigned chunksInFlight;
+
+	// thread pool fallback
+	std::mutex mutex;
+	std::condition_variable chunkDone;
+	size_t pendingChunks;
+};
+
+#endif // ASYNCFILEREADER_H
@@ -0,0 +1,97 @@
+#ifndef CPUINFO_H
+#define CPUINFO_H
+
+#include <stdint.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#include <x86intrin.h>
+#endif
+
+/*
+ * GCC and Clang refuse to inline intrinsics for instruction sets that are
+ * not enabled on the command line, so code paths picked at runtime need to
+ * be tagged with the ISA they use. MSVC accepts them anywhere.
+ */
+#ifdef _MSC_VER
+#define TARGET_SSSE3
+#define TARGET_AVX
+#define TARGET_AVX2
+#define TARGET_F16C
+#define TARGET_AVX_F16C
+#else
+#define TARGET_SSSE3 __attribute__((target("ssse3")))
+#define TARGET_AVX __attribute__((target("avx")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#define TARGET_F16C __attribute__((target("f16c")))
+#define TARGET_AVX_F16C __attribute__((target("avx,f16c")))
+#endif
+
+struct CpuFeatures {
+	bool sse41;
+	bool ssse3;
+	bool avx;
+	bool avx2;
+	bool f16c;
+};
+
+static inline void cpuid(uint32_t leaf, uint32_t subleaf, uint32_t regs[4])
+{
+#ifdef _MSC_VER
+	int info[4];
+	__cpuidex(info, int(leaf), int(subleaf));
+	for (int i = 0; i < 4; ++i)
+		regs[i] = uint32_t(info[i]);
+#else
+	__cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+static inline CpuFeatures detectCpuFeatures()
+{
+	CpuFeatures features = {};
+
+	uint32_t regs[4];
+	cpuid(0, 0, regs);
+	auto maxLeaf = regs[0];
+	if (maxLeaf < 1)
+		return features;
+
+	cpuid(1, 0, regs);
+	features.ssse3 = (regs[2] & (1 << 9)) != 0;
+	features.sse41 = (regs[2] & (1 << 19)) != 0;
+
+	// AVX state must also be enabled by the OS
+	bool osxsave = (regs[2] & (1 << 27)) != 0;
+	bool avxState = false;
+	if (osxsave) {
+#ifdef _MSC_VER
+		auto xcr0 = _xgetbv(0);
+#else
+		uint32_t eax, edx;
+		__asm__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+		uint64_t xcr0 = (uint64_t(edx) << 32) | eax;
+#endif
+		avxState = (xcr0 & 6) == 6;
+	}
+
+	features.avx = avxState && (regs[2] & (1 << 28)) != 0;
+	features.f16c = features.avx && (regs[2] & (1 << 29)) != 0;
+
+	if (maxLeaf >= 7) {
+		cpuid(7, 0, regs);
+		features.avx2 = features.avx && (regs[1] & (1 << 5)) != 0;
+	}
+
+	return features;
+}
+
+static inline const CpuFeatures &getCpuFeatures()
+{
+	static const CpuFeatures features = detectCpuFeatures();
+	return features;
+}
+
+#endif // CPUINFO_H
@@ -1,52 +1,238 @@
 #ifndef MEMORYMAPPEDFILE_H
 #define MEMORYMAPPEDFILE_H
 
+#include <stddef.h>
+#include <stdint.h>
+#include <stdexcept>
+
 #ifdef WIN32
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #endif
 
+/*
+ * Read-only view of a file, or of a range of it. The pages are shared with
+ * the OS file cache, so nothing is copied until the data is used.
+ */
 class MemoryMappedFile
 {
 public:
-	explicit MemoryMappedFile(const char *path)
-	{
-		WIN32_FILE_ATTRIBUTE_DATA attr;
-		if (!GetFileAttributesEx(path, GetFileExInfoStandard, &attr))
-			throw std::runtime_error("failed to get file attributes");
-		size = attr.nFileSizeLow;
+	enum Hints {
+		NO_HINTS = 0,
+		SEQUENTIAL = 1 << 0,    // read front to back; more aggressive read-ahead
+		RANDOM_ACCESS = 1 << 1, // no read-ahead
+		WILL_NEED = 1 << 2,     // start reading the range in the background
+		HUGE_PAGES = 1 << 3,    // transparent huge pages, where the file system supports them
+		PREFETCH = 1 << 4,      // fault the whole range in before the constructor returns
+	};
 
-		if (attr.nFileSizeHigh != 0)
-			throw std::runtime_error("too large file");
+	static const uint64_t wholeFile = ~uint64_t(0);
+
+	explicit MemoryMappedFile(const char *path, unsigned hints = NO_HINTS, uint64_t offset = 0, uint64_t length = wholeFile) :
+		mapping(nullptr),
+		data(nullptr),
+		size(0),
+		mappingSize(0)
+	{
+#ifdef WIN32
+		DWORD flags = FILE_ATTRIBUTE_NORMAL;
+		if (hints & SEQUENTIAL)
+			flags |= FILE_FLAG_SEQUENTIAL_SCAN;
+		else if (hints & RANDOM_ACCESS)
+			flags |= FILE_FLAG_RANDOM_ACCESS;
 
-		hfile = CreateFile(path, GENERIC_READ, 0, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		hfile = CreateFile(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, flags, nullptr);
 		if (INVALID_HANDLE_VALUE == hfile)
 			throw std::runtime_error("failed to open file for reading");
 
+		LARGE_INTEGER fileSize;
+		if (!GetFileSizeEx(hfile, &fileSize)) {
+			CloseHandle(hfile);
+			throw std::runtime_error("failed to get file size");
+		}
+		this->fileSize = uint64_t(fileSize.QuadPart);
+
+		hmap = nullptr;
+#else
+		fd = open(path, O_RDONLY | O_CLOEXEC);
+		if (fd < 0)
+			throw std::runtime_error("failed to open file for reading");
+
+		struct stat st;
+		if (fstat(fd, &st) < 0) {
+			close(fd);
+			throw std::runtime_error("failed to get file size");
+		}
+		fileSize = uint64_t(st.st_size);
+#endif
+
+		try {
+			map(offset, length, hints);
+		} catch (...) {
+			release();
+#ifndef WIN32
+			close(fd);
+#endif
+			throw;
+		}
+
+#ifndef WIN32
+		// the mapping keeps its own reference to the file
+		close(fd);
+		fd = -1;
+#endif
+	}
+
+	~MemoryMappedFile()
+	{
+		release();
+	}
+
+	const void *getData() const { return data; }
+	size_t getSize() const { return size; }
+
+	// of the whole file, not just the mapped range
+	uint64_t getFileSize() const { return fileSize; }
+
+	// hints for part of the mapped range; offset is relative to getData()
+	void advise(unsigned hints, size_t offset = 0, size_t length = ~size_t(0))
+	{
+		if (offset >= size)
+			return;
+		length = length < size - offset ? length : size - offset;
+
+		auto begin = static_cast<const uint8_t *>(data) + offset;
+#ifdef WIN32
+		if (hints & (WILL_NEED | PREFETCH)) {
+#if _WIN32_WINNT >= 0x0602
+			WIN32_MEMORY_RANGE_ENTRY range = { const_cast<uint8_t *>(begin), length };
+			PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#endif
+		}
+#else
+		// madvise wants page-aligned addresses
+		auto pageMask = uintptr_t(sysconf(_SC_PAGESIZE)) - 1;
+		auto alignedBegin = reinterpret_cast<uint8_t *>(uintptr_t(begin) & ~pageMask);
+		length += begin - alignedBegin;
+
+		if (hints & SEQUENTIAL)
+			madvise(alignedBegin, length, MADV_SEQUENTIAL);
+		else if (hints & RANDOM_ACCESS)
+			madvise(alignedBegin, length, MADV_RANDOM);
+
+		if (hints & (WILL_NEED | PREFETCH))
+			madvise(alignedBegin, length, MADV_WILLNEED);
+
+#ifdef MADV_HUGEPAGE
+		if (hints & HUGE_PAGES)
+			madvise(alignedBegin, length, MADV_HUGEPAGE);
+#endif
+#endif
+	}
+
+private:
+	MemoryMappedFile(const MemoryMappedFile &) = delete;
+	MemoryMappedFile &operator=(const MemoryMappedFile &) = delete;
+
+	void map(uint64_t offset, uint64_t length, unsigned hints)
+	{
+		if (offset > fileSize)
+			throw std::runtime_error("mapped range outside of file");
+		if (length > fileSize - offset)
+			length = fileSize - offset;
+
+		if (length > uint64_t(SIZE_MAX))
+			throw std::runtime_error("too large file");
+
+		// mappings can't be empty
+		if (length == 0)
+			return;
+
+		// views have to start on a granularity boundary
+		auto alignedOffset = offset & ~(getAllocationGranularity() - 1);
+		auto padding = size_t(offset - alignedOffset);
+		size = size_t(length);
+		mappingSize = padding + size;
+
+#ifdef WIN32
 		hmap = CreateFileMapping(hfile, 0, PAGE_READONLY, 0, 0, nullptr);
 		if (!hmap)
 			throw std::runtime_error("failed to create file mapping");
 
-		data = MapViewOfFile(hmap, FILE_MAP_READ, 0, 0, 0);
-		if (!data)
+		mapping = MapViewOfFile(hmap, FILE_MAP_READ, DWORD(alignedOffset >> 32), DWORD(alignedOffset), mappingSize);
+		if (!mapping)
 			throw std::runtime_error("failed to map view of file");
+#else
+		int flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+		if (hints & PREFETCH)
+			flags |= MAP_POPULATE;
+#endif
+
+		mapping = mmap(nullptr, mappingSize, PROT_READ, flags, fd, off_t(alignedOffset));
+		if (mapping == MAP_FAILED) {
+			mapping = nullptr;
+			throw std::runtime_error("failed to map view of file");
+		}
+#endif
+
+		data = static_cast<uint8_t *>(mapping) + padding;
+		advise(hints);
+
+#if defined(WIN32) || !defined(MAP_POPULATE)
+		// no populate flag here, so fault the pages in by hand
+		if (hints & PREFETCH) {
+			const size_t pageSize = 4096; // the smallest one on any target
+			volatile uint8_t sink = 0;
+			for (size_t i = 0; i < mappingSize; i += pageSize)
+				sink += static_cast<const uint8_t *>(mapping)[i];
+			(void)sink;
+		}
+#endif
 	}
 
-	~MemoryMappedFile()
+	void release()
 	{
-		UnmapViewOfFile(data);
-		CloseHandle(hmap);
+#ifdef WIN32
+		if (mapping)
+			UnmapViewOfFile(mapping);
+		if (hmap)
+			CloseHandle(hmap);
 		CloseHandle(hfile);
+#else
+		if (mapping)
+			munmap(mapping, mappingSize);
+#endif
+		mapping = nullptr;
 	}
 
-	const void *getData() const { return data; }
-	size_t getSize() const { return size; }
+	static uint64_t getAllocationGranularity()
+	{
+#ifdef WIN32
+		SYSTEM_INFO systemInfo;
+		GetSystemInfo(&systemInfo);
+		return systemInfo.dwAllocationGranularity;
+#else
+		return uint64_t(sysconf(_SC_PAGESIZE));
+#endif
+	}
 
-private:
+#ifdef WIN32
 	HANDLE hfile;
 	HANDLE hmap;
-	void *data;
+#else
+	int fd; // only open during construction
+#endif
+	void *mapping; // starts at or before data, on a granularity boundary
+	const void *data;
 	size_t size;
+	size_t mappingSize;
+	uint64_t fileSize;
 };
 
 #endif // MEMORYMAPPEDFILE_H
@@ -0,0 +1,50 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+#include "cpuinfo.h"
+
+#include <emmintrin.h>
+#include <immintrin.h>
+
+/*
+ * 4x4 matrix products on column-major float[16] storage (the glm::mat4
+ * layout): out = a * b. The pointers don't need to be aligned, and out may
+ * alias b but not a.
+ */
+
+static inline void multiplyMatrix4SSE(const float *a, const float *b, float *out)
+{
+	__m128 a0 = _mm_loadu_ps(a + 0);
+	__m128 a1 = _mm_loadu_ps(a + 4);
+	__m128 a2 = _mm_loadu_ps(a + 8);
+	__m128 a3 = _mm_loadu_ps(a + 12);
+
+	for (int j = 0; j < 4; ++j) {
+		__m128 col = _mm_loadu_ps(b + j * 4);
+		__m128 r = _mm_mul_ps(a0, _mm_shuffle_ps(col, col, _MM_SHUFFLE(0, 0, 0, 0)));
+		r = _mm_add_ps(r, _mm_mul_ps(a1, _mm_shuffle_ps(col, col, _MM_SHUFFLE(1, 1, 1, 1))));
+		r = _mm_add_ps(r, _mm_mul_ps(a2, _mm_shuffle_ps(col, col, _MM_SHUFFLE(2, 2, 2, 2))));
+		r = _mm_add_ps(r, _mm_mul_ps(a3, _mm_shuffle_ps(col, col, _MM_SHUFFLE(3, 3, 3, 3))));
+		_mm_storeu_ps(out + j * 4, r);
+	}
+}
+
+// two columns per iteration; each 128-bit lane works on its own column
+TARGET_AVX static inline void multiplyMatrix4AVX(const float *a, const float *b, float *out)
+{
+	__m256 a0 = _mm256_broadcast_ps(reinterpret_cast<const __m128 *>(a + 0));
+	__m256 a1 = _mm256_broadcast_ps(reinterpret_cast<const __m128 *>(a + 4));
+	__m256 a2 = _mm256_broadcast_ps(reinterpret_cast<const __m128 *>(a + 8));
+	__m256 a3 = _mm256_broadcast_ps(reinterpret_cast<const __m128 *>(a + 12));
+
+	for (int j = 0; j < 4; j += 2) {
+		__m256 cols = _mm256_loadu_ps(b + j * 4);
+		__m256 r = _mm256_mul_ps(a0, _mm256_shuffle_ps(cols, cols, _MM_SHUFFLE(0, 0, 0, 0)));
+		r = _mm256_add_ps(r, _mm256_mul_ps(a1, _mm256_shuffle_ps(cols, cols, _MM_SHUFFLE(1, 1, 1, 1))));
+		r = _mm256_add_ps(r, _mm256_mul_ps(a2, _mm256_shuffle_ps(cols, cols, _MM_SHUFFLE(2, 2, 2, 2))));
+		r = _mm256_add_ps(r, _mm256_mul_ps(a3, _mm256_shuffle_ps(cols, cols, _MM_SHUFFLE(3, 3, 3, 3))));
+		_mm256_storeu_ps(out + j * 4, r);
+	}
+}
+
+#endif // SIMD_H
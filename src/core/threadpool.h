@@ -0,0 +1,160 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool {
+public:
+	explicit ThreadPool(unsigned threadCount = defaultThreadCount()) :
+		quit(false)
+	{
+		for (auto i = 0u; i < threadCount; ++i)
+			threads.push_back(std::thread([this]() { workerLoop(); }));
+	}
+
+	~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			quit = true;
+		}
+		jobAvailable.notify_all();
+
+		for (auto &thread : threads)
+			thread.join();
+	}
+
+	// the calling thread also does work, so leave one core for it
+	static unsigned defaultThreadCount()
+	{
+		auto hardwareThreads = std::thread::hardware_concurrency();
+		return hardwareThreads > 1 ? hardwareThreads - 1 : 0;
+	}
+
+	static ThreadPool &getDefault()
+	{
+		static ThreadPool pool;
+		return pool;
+	}
+
+	unsigned getThreadCount() const { return unsigned(threads.size()); }
+
+	void enqueue(std::function<void()> job)
+	{
+		if (threads.empty()) {
+			job();
+			return;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			jobs.push_back(std::move(job));
+		}
+		jobAvailable.notify_one();
+	}
+
+	/*
+	 * Calls func(begin, end) for consecutive sub-ranges of [0, count) of at
+	 * most grainSize elements, spread over the pool and the calling thread.
+	 * Returns once every sub-range has been processed.
+	 */
+	void parallelFor(size_t count, size_t grainSize, const std::function<void(size_t, size_t)> &func)
+	{
+		grainSize = std::max(grainSize, size_t(1));
+		auto chunkCount = (count + grainSize - 1) / grainSize;
+		if (chunkCount <= 1 || threads.empty()) {
+			if (count > 0)
+				func(0, count);
+			return;
+		}
+
+		struct {
+			std::atomic<size_t> nextChunk;
+			std::mutex mutex;
+			std::condition_variable finished;
+			size_t activeHelpers;
+		} state;
+		state.nextChunk = 0;
+
+		auto runChunks = [&]() {
+			for (;;) {
+				auto chunk = state.nextChunk++;
+				if (chunk >= chunkCount)
+					break;
+
+				auto begin = chunk * grainSize;
+				func(begin, std::min(begin + grainSize, count));
+			}
+		};
+
+		auto helperCount = std::min(size_t(threads.size()), chunkCount - 1);
+		state.activeHelpers = helperCount;
+		for (size_t i = 0; i < helperCount; ++i) {
+			enqueue([&]() {
+				runChunks();
+
+				std::lock_guard<std::mutex> lock(state.mutex);
+				if (--state.activeHelpers == 0)
+					state.finished.notify_one();
+			});
+		}
+
+		runChunks();
+
+		// helpers reference our stack, so wait for all of them to leave.
+		// Run queued jobs meanwhile, so nested calls can't starve the pool.
+		while (runPendingJob())
+			;
+
+		std::unique_lock<std::mutex> lock(state.mutex);
+		state.finished.wait(lock, [&]() { return state.activeHelpers == 0; });
+	}
+
+private:
+	bool runPendingJob()
+	{
+		std::function<void()> job;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (jobs.empty())
+				return false;
+
+			job = std::move(jobs.front());
+			jobs.pop_front();
+		}
+		job();
+		return true;
+	}
+
+	void workerLoop()
+	{
+		for (;;) {
+			std::function<void()> job;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				jobAvailable.wait(lock, [this]() { return quit || !jobs.empty(); });
+				if (jobs.empty())
+					return;
+
+				job = std::move(jobs.front());
+				jobs.pop_front();
+			}
+			job();
+		}
+	}
+
+	std::vector<std::thread> threads;
+	std::deque<std::function<void()>> jobs;
+	std::mutex mutex;
+	std::condition_variable jobAvailable;
+	bool quit;
+};
+
+#endif // THREADPOOL_H
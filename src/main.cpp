@@ -7,7 +7,6 @@
 #include <cmath>
 #include <algorithm>
 #include <list>
-#include <map>
 #include <stdexcept>
 
 #include "vulkan.h"
@@ -25,7 +24,6 @@
 using namespace vulkan;
 
 using std::vector;
-using std::map;
 using std::exception;
 using std::runtime_error;
 
@@ -37,9 +35,13 @@ static vector<const char *> getRequiredInstanceExtensions()
 }
 
 #include "scene/scene.h"
+#include "scene/clustered-mesh.h"
+#include "scene/occlusion-cull.h"
 #include "scene/rendertarget.h"
+#include "scene/uniformring.h"
+#include "scene/uploadbatch.h"
 
-static VkPipeline createGraphicsPipeline(VkPipelineLayout layout, VkRenderPass renderPass, const VkPipelineVertexInputStateCreateInfo &pipelineVertexInputStateCreateInfo)
+static VkPipeline createGraphicsPipeline(VkPipelineLayout layout, VkRenderPass renderPass, const VkPipelineVertexInputStateCreateInfo &pipelineVertexInputStateCreateInfo, const char *vertexShaderPath = "data/shaders/triangle.vert.spv")
 {
 	VkPipelineInputAssemblyStateCreateInfo pipelineInputAssemblyStateCreateInfo = {};
 	pipelineInputAssemblyStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
@@ -94,7 +96,7 @@ static VkPipeline createGraphicsPipeline(VkPipelineLayout layout, VkRenderPass r
 		nullptr,
 		0,
 		VK_SHADER_STAGE_VERTEX_BIT,
-		loadShaderModule("data/shaders/triangle.vert.spv"),
+		loadShaderModule(vertexShaderPath),
 		"main",
 		NULL
 	}, {
@@ -129,21 +131,8 @@ static VkPipeline createGraphicsPipeline(VkPipelineLayout layout, VkRenderPass r
 	return pipeline;
 }
 
-static VkPipeline createComputePipeline(VkPipelineLayout layout, VkShaderModule shaderModule, const char *name = "main")
-{
-	VkComputePipelineCreateInfo computePipelineCreateInfo = {};
-	computePipelineCreateInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
-	computePipelineCreateInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-	computePipelineCreateInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
-	computePipelineCreateInfo.stage.module = shaderModule;
-	computePipelineCreateInfo.stage.pName = name;
-	computePipelineCreateInfo.layout = layout;
-
-	VkPipeline computePipeline;
-	auto err = vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &computePipelineCreateInfo, nullptr, &computePipeline);
-	assert(err == VK_SUCCESS);
-	return computePipeline;
-}
+// toggled with G: all objects culled and drawn by a handful of commands, instead of a few each
+static bool gpuDrivenRendering = false;
 
 namespace CubeData
 {
@@ -272,6 +261,8 @@ int main(int argc, char *argv[])
 		glfwSetKeyCallback(win, [](GLFWwindow* window, int key, int scancode, int action, int mods) {
 			if (action == GLFW_PRESS && key == GLFW_KEY_ESCAPE)
 				glfwSetWindowShouldClose(window, GLFW_TRUE);
+			if (action == GLFW_PRESS && key == GLFW_KEY_G)
+				gpuDrivenRendering = !gpuDrivenRendering;
 			});
 
 
@@ -300,8 +291,10 @@ int main(int argc, char *argv[])
 			VK_FORMAT_D16_UNORM,
 		};
 
-		auto depthFormat = findBestFormat(depthCandidates, VK_IMAGE_TILING_OPTIMAL, VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT);
-		DepthRenderTarget depthRenderTarget(depthFormat, width, height);
+		// the depth pyramid gets built from it, so it has to be sampled too
+		auto depthFormat = findBestFormat(depthCandidates, VK_IMAGE_TILING_OPTIMAL, VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT);
+		DepthRenderTarget depthRenderTarget(depthFormat, width, height, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
+		DepthPyramidRenderTarget depthPyramid(width, height);
 
 		auto renderTargetFormat = VK_FORMAT_R16G16B16A16_SFLOAT;
 		ColorRenderTarget colorRenderTarget(renderTargetFormat, width, height, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
@@ -312,7 +305,7 @@ int main(int argc, char *argv[])
 		attachments[0].format = depthFormat;
 		attachments[0].samples = VK_SAMPLE_COUNT_1_BIT;
 		attachments[0].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-		attachments[0].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		attachments[0].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
 		attachments[0].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 		attachments[0].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 		attachments[0].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
@@ -326,7 +319,7 @@ int main(int argc, char *argv[])
 		attachments[1].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 		attachments[1].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 		attachments[1].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-		attachments[1].finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		attachments[1].finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
 		VkAttachmentReference depthStencilReference = {};
 		depthStencilReference.attachment = 0;
@@ -353,6 +346,18 @@ int main(int argc, char *argv[])
 		err = vkCreateRenderPass(device, &renderpassCreateInfo, nullptr, &renderPass);
 		assert(err == VK_SUCCESS);
 
+		// the late occlusion phase draws on top of what the early one left
+		attachments[0].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+		attachments[0].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		attachments[0].initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+		attachments[1].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+		attachments[1].initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+		attachments[1].finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+		VkRenderPass lateRenderPass;
+		err = vkCreateRenderPass(device, &renderpassCreateInfo, nullptr, &lateRenderPass);
+		assert(err == VK_SUCCESS);
+
 
 		auto framebuffer = createFramebuffer(
 			width, height, 1,
@@ -364,8 +369,10 @@ int main(int argc, char *argv[])
 
 		Scene scene;
 
+		// triangle.vert only reads positions
+		VertexLayout vertexLayout(NormalEncoding::NONE, false, 0);
+
 		Vertex v = {};
-		v.position = glm::vec3(0, 0, 0);
 		vector<Vertex> vertices;
 		for (auto i = 0u; i < ARRAY_SIZE(CubeData::vertexPositions); ++i) {
 			glm::vec3 pos = CubeData::vertexPositions[i];
@@ -373,11 +380,9 @@ int main(int argc, char *argv[])
 			v.uv[0] = 0.5f + 0.5f * glm::vec2(pos.x, pos.y);
 			vertices.push_back(v);
 		}
-		vector<uint32_t> indices;
-		indices.push_back(0);
-		indices.push_back(1);
-		indices.push_back(2);
-		auto mesh = Mesh(vertices, indices);
+		vector<uint32_t> indices(CubeData::vertexIndices, CubeData::vertexIndices + ARRAY_SIZE(CubeData::vertexIndices));
+		ClusteredMesh clusteredMesh(vertexLayout, vertexLayout.pack(vertices), indices);
+		auto &mesh = clusteredMesh.getMesh();
 		auto material = Material();
 		auto model = new Model(&mesh, &material);
 		auto t1 = scene.createMatrixTransform();
@@ -395,23 +400,15 @@ int main(int argc, char *argv[])
 		});
 		auto pipelineLayout = createPipelineLayout({ descriptorSetLayout }, {});
 
-		VkVertexInputBindingDescription vertexInputBindingDesc[1];
-		vertexInputBindingDesc[0].binding = 0;
-		vertexInputBindingDesc[0].stride = sizeof(float) * 3;
-		vertexInputBindingDesc[0].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
-
-		VkVertexInputAttributeDescription vertexInputAttributeDescription[1];
-		vertexInputAttributeDescription[0].binding = 0;
-		vertexInputAttributeDescription[0].location = 0;
-		vertexInputAttributeDescription[0].format = VK_FORMAT_R32G32B32_SFLOAT;
-		vertexInputAttributeDescription[0].offset = 0;
+		auto vertexInputBindingDesc = vertexLayout.getBindingDescription(0);
+		auto vertexInputAttributeDescriptions = vertexLayout.getAttributeDescriptions(0);
 
 		VkPipelineVertexInputStateCreateInfo pipelineVertexInputStateCreateInfo = {};
 		pipelineVertexInputStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-		pipelineVertexInputStateCreateInfo.vertexBindingDescriptionCount = ARRAY_SIZE(vertexInputBindingDesc);
-		pipelineVertexInputStateCreateInfo.pVertexBindingDescriptions = vertexInputBindingDesc;
-		pipelineVertexInputStateCreateInfo.vertexAttributeDescriptionCount = ARRAY_SIZE(vertexInputAttributeDescription);
-		pipelineVertexInputStateCreateInfo.pVertexAttributeDescriptions = vertexInputAttributeDescription;
+		pipelineVertexInputStateCreateInfo.vertexBindingDescriptionCount = 1;
+		pipelineVertexInputStateCreateInfo.pVertexBindingDescriptions = &vertexInputBindingDesc;
+		pipelineVertexInputStateCreateInfo.vertexAttributeDescriptionCount = uint32_t(vertexInputAttributeDescriptions.size());
+		pipelineVertexInputStateCreateInfo.pVertexAttributeDescriptions = vertexInputAttributeDescriptions.data();
 
 		auto pipeline = createGraphicsPipeline(pipelineLayout, renderPass, pipelineVertexInputStateCreateInfo);
 
@@ -427,11 +424,16 @@ int main(int argc, char *argv[])
 		auto uniformBufferSpacing = uint32_t(alignSize(uniformSize, deviceProperties.limits.minUniformBufferOffsetAlignment));
 		auto uniformBufferSize = VkDeviceSize(uniformBufferSpacing * scene.getTransforms().size());
 
-		auto uniformBuffer = Buffer(uniformBufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+		// the objects for occlusion culling and GPU-driven rendering go in the same ring, in blocks after the uniforms
+		auto cullObjectsSize = VkDeviceSize(sizeof(OcclusionCullObject) * scene.getObjects().size());
+		auto gpuObjectsSize = VkDeviceSize(sizeof(GpuObject) * scene.getObjects().size());
+		auto ringAlignment = std::max(deviceProperties.limits.minUniformBufferOffsetAlignment, deviceProperties.limits.minStorageBufferOffsetAlignment);
+		UniformRing uniformRing(uniformBufferSize + ringAlignment + cullObjectsSize + ringAlignment + gpuObjectsSize, int(imageViews.size()),
+			VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
 
 		auto descriptorSet = allocateDescriptorSet(descriptorPool, descriptorSetLayout);
 
-		VkDescriptorBufferInfo descriptorBufferInfo = uniformBuffer.getDescriptorBufferInfo();
+		VkDescriptorBufferInfo descriptorBufferInfo = uniformRing.getDescriptorBufferInfo(uniformSize);
 
 		VkWriteDescriptorSet writeDescriptorSets[2] = {};
 		writeDescriptorSets[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
@@ -454,19 +456,300 @@ int main(int argc, char *argv[])
 		vkUpdateDescriptorSets(device, ARRAY_SIZE(writeDescriptorSets), writeDescriptorSets, 0, nullptr);
 
 		// Go make vertex buffer yo!
-#if 1
-		auto vertexStagingBuffer = new StagingBuffer(sizeof(CubeData::vertexPositions));
-		vertexStagingBuffer->uploadMemory(0, CubeData::vertexPositions, sizeof(CubeData::vertexPositions));
+		UploadBatch uploadBatch;
+		clusteredMesh.upload(uploadBatch);
+		uploadBatch.submit();
+
+		// every object gets its meshlets culled into an index buffer of its own
+		auto cullDescriptorSetLayout = createDescriptorSetLayout({
+			{ 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT },
+			{ 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT },
+			{ 2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT },
+			{ 3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT },
+			{ 4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT },
+		});
+		auto cullPipelineLayout = createPipelineLayout({ cullDescriptorSetLayout }, {
+			{ VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ClusterCullConstants) },
+		});
+		auto cullPipeline = createComputePipeline(cullPipelineLayout, loadShaderModule("data/shaders/cluster-cull.comp.spv"));
+
+		auto objectCount = scene.getObjects().size();
+		auto cullDescriptorPool = createDescriptorPool({
+			{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, uint32_t(5 * objectCount) },
+		}, int(objectCount));
+
+		vector<ClusterCullTarget *> cullTargets;
+		vector<VkDescriptorSet> cullDescriptorSets;
+		for (size_t i = 0; i < objectCount; ++i) {
+			auto cullTarget = new ClusterCullTarget(clusteredMesh);
+			auto cullDescriptorSet = allocateDescriptorSet(cullDescriptorPool, cullDescriptorSetLayout);
+
+			VkDescriptorBufferInfo cullBufferInfos[] = {
+				clusteredMesh.getMeshletBuffer().getDescriptorBufferInfo(),
+				clusteredMesh.getMeshletVertexBuffer().getDescriptorBufferInfo(),
+				clusteredMesh.getMeshletTriangleBuffer().getDescriptorBufferInfo(),
+				cullTarget->getIndexBuffer().getDescriptorBufferInfo(),
+				cullTarget->getDrawCommandBuffer().getDescriptorBufferInfo(),
+			};
 
-		auto vertexBuffer = Buffer(sizeof(CubeData::vertexPositions), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-		vertexBuffer.uploadFromStagingBuffer(vertexStagingBuffer, 0, 0, sizeof(CubeData::vertexPositions));
-#else
-		auto vertexBuffer = Buffer(sizeof(CubeData::vertexPositions), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
-		vertexBuffer.uploadMemory(0, CubeData::vertexPositions, sizeof(CubeData::vertexPositions));
-#endif
+			// the bindings are consecutive, so one write covers them all
+			VkWriteDescriptorSet writeDescriptorSet = {};
+			writeDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			writeDescriptorSet.dstSet = cullDescriptorSet;
+			writeDescriptorSet.dstBinding = 0;
+			writeDescriptorSet.descriptorCount = ARRAY_SIZE(cullBufferInfos);
+			writeDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			writeDescriptorSet.pBufferInfo = cullBufferInfos;
+			vkUpdateDescriptorSets(device, 1, &writeDescriptorSet, 0, nullptr);
+
+			cullTargets.push_back(cullTarget);
+			cullDescriptorSets.push_back(cullDescriptorSet);
+		}
+		vector<uint32_t> visibleObjects;
+
+		// whole objects against last frame's visibility, then against the depth pyramid
+		OcclusionCullState occlusionCullState(uint32_t(objectCount));
+		VkSampler depthSampler = createSampler(float(depthPyramid.getMipLevels()), false, false, VK_FILTER_NEAREST);
+
+		auto occlusionCullDescriptorSetLayout = createDescriptorSetLayout({
+			{ 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 1, VK_SHADER_STAGE_COMPUTE_BIT },
+			{ 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT },
+			{ 2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT },
+			{ 3, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT },
+		});
+		auto occlusionCullPipelineLayout = createPipelineLayout({ occlusionCullDescriptorSetLayout }, {
+			{ VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(OcclusionCullConstants) },
+		});
+		auto occlusionCullPipeline = createComputePipeline(occlusionCullPipelineLayout, loadShaderModule("data/shaders/occlusion-cull.comp.spv"));
+
+		auto depthReduceDescriptorSetLayout = createDescriptorSetLayout({
+			{ 0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT },
+			{ 1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT },
+		});
+		auto depthReducePipelineLayout = createPipelineLayout({ depthReduceDescriptorSetLayout }, {});
+		auto depthReducePipeline = createComputePipeline(depthReducePipelineLayout, loadShaderModule("data/shaders/depth-reduce.comp.spv"));
+
+		auto pyramidLevels = depthPyramid.getMipLevels();
+		auto occlusionDescriptorPool = createDescriptorPool({
+			{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 1 },
+			{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2 },
+			{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, uint32_t(pyramidLevels) },
+			{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, uint32_t(pyramidLevels + 1) },
+		}, pyramidLevels + 1);
+
+		auto occlusionCullDescriptorSet = allocateDescriptorSet(occlusionDescriptorPool, occlusionCullDescriptorSetLayout);
+		{
+			VkDescriptorBufferInfo bufferInfos[] = {
+				uniformRing.getDescriptorBufferInfo(cullObjectsSize),
+				occlusionCullState.getVisibilityBuffer().getDescriptorBufferInfo(),
+				occlusionCullState.getDispatchCommandBuffer().getDescriptorBufferInfo(),
+			};
+
+			VkDescriptorImageInfo pyramidImageInfo = {};
+			pyramidImageInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+			pyramidImageInfo.imageView = depthPyramid.getImageView();
+			pyramidImageInfo.sampler = depthSampler;
+
+			VkWriteDescriptorSet writeDescriptorSets[4] = {};
+			for (int i = 0; i < 3; ++i) {
+				writeDescriptorSets[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+				writeDescriptorSets[i].dstSet = occlusionCullDescriptorSet;
+				writeDescriptorSets[i].dstBinding = i;
+				writeDescriptorSets[i].descriptorCount = 1;
+				writeDescriptorSets[i].descriptorType = i == 0 ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+				writeDescriptorSets[i].pBufferInfo = &bufferInfos[i];
+			}
+			writeDescriptorSets[3].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			writeDescriptorSets[3].dstSet = occlusionCullDescriptorSet;
+			writeDescriptorSets[3].dstBinding = 3;
+			writeDescriptorSets[3].descriptorCount = 1;
+			writeDescriptorSets[3].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+			writeDescriptorSets[3].pImageInfo = &pyramidImageInfo;
+			vkUpdateDescriptorSets(device, ARRAY_SIZE(writeDescriptorSets), writeDescriptorSets, 0, nullptr);
+		}
+
+		// each level reads the one below it, and the first one the depth buffer
+		vector<VkDescriptorSet> depthReduceDescriptorSets;
+		for (int level = 0; level < pyramidLevels; ++level) {
+			auto depthReduceDescriptorSet = allocateDescriptorSet(occlusionDescriptorPool, depthReduceDescriptorSetLayout);
+
+			VkDescriptorImageInfo outputImageInfo = {};
+			outputImageInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+			outputImageInfo.imageView = depthPyramid.getMipImageViews()[level];
+
+			VkDescriptorImageInfo inputImageInfo = {};
+			inputImageInfo.imageLayout = level == 0 ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_GENERAL;
+			inputImageInfo.imageView = level == 0 ? depthRenderTarget.getImageView() : depthPyramid.getMipImageViews()[level - 1];
+			inputImageInfo.sampler = depthSampler;
+
+			VkWriteDescriptorSet writeDescriptorSets[2] = {};
+			writeDescriptorSets[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			writeDescriptorSets[0].dstSet = depthReduceDescriptorSet;
+			writeDescriptorSets[0].dstBinding = 0;
+			writeDescriptorSets[0].descriptorCount = 1;
+			writeDescriptorSets[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+			writeDescriptorSets[0].pImageInfo = &outputImageInfo;
+			writeDescriptorSets[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			writeDescriptorSets[1].dstSet = depthReduceDescriptorSet;
+			writeDescriptorSets[1].dstBinding = 1;
+			writeDescriptorSets[1].descriptorCount = 1;
+			writeDescriptorSets[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+			writeDescriptorSets[1].pImageInfo = &inputImageInfo;
+			vkUpdateDescriptorSets(device, ARRAY_SIZE(writeDescriptorSets), writeDescriptorSets, 0, nullptr);
 
-		auto indexBuffer = Buffer(sizeof(CubeData::vertexIndices), VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
-		indexBuffer.uploadMemory(0, CubeData::vertexIndices, sizeof(CubeData::vertexIndices));
+			depthReduceDescriptorSets.push_back(depthReduceDescriptorSet);
+		}
+
+		// GPU-driven rendering: one cull dispatch for the meshlets of every object, and multi-draw indirect
+		auto canDrawGpuDriven = enabledFeatures.drawIndirectFirstInstance == VK_TRUE;
+		// the culled indices of all objects share one buffer; when it's full, the rest are skipped for the frame
+		const VkDeviceSize cullIndexBudget = 64 * 1024 * 1024;
+		ClusterCullBatchTarget cullBatchTarget(clusteredMesh, uint32_t(objectCount), cullIndexBudget);
+
+		// compacted commands need a count to draw by, which can't be split up like plain ones
+		auto useDrawCount = deviceFuncs.vkCmdDrawIndexedIndirectCountKHR != nullptr && objectCount <= deviceProperties.limits.maxDrawIndirectCount;
+
+		vector<const Material *> materials;
+		vector<uint32_t> objectMaterials;
+		for (auto &object : scene.getObjects()) {
+			auto objectMaterial = object.getModel()->getMaterial();
+			auto it = std::find(materials.begin(), materials.end(), objectMaterial);
+			objectMaterials.push_back(uint32_t(it - materials.begin()));
+			if (it == materials.end())
+				materials.push_back(objectMaterial);
+		}
+
+		auto cullAllocateDescriptorSetLayout = createDescriptorSetLayout({
+			{ 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT },
+			{ 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT },
+			{ 2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT },
+		});
+		auto cullAllocatePipelineLayout = createPipelineLayout({ cullAllocateDescriptorSetLayout }, {
+			{ VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ClusterCullBatchConstants) },
+		});
+		auto cullAllocatePipeline = createComputePipeline(cullAllocatePipelineLayout, loadShaderModule("data/shaders/cluster-cull-allocate.comp.spv"));
+
+		auto batchCullDescriptorSetLayout = createDescriptorSetLayout({
+			{ 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT },
+			{ 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT },
+			{ 2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT },
+			{ 3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT },
+			{ 4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT },
+			{ 5, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 1, VK_SHADER_STAGE_COMPUTE_BIT },
+			{ 6, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT },
+			{ 7, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT },
+		});
+		auto batchCullPipelineLayout = createPipelineLayout({ batchCullDescriptorSetLayout }, {
+			{ VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ClusterCullConstants) },
+		});
+		auto batchCullPipeline = createComputePipeline(batchCullPipelineLayout, loadShaderModule("data/shaders/cluster-cull-batched.comp.spv"));
+
+		auto drawCompactDescriptorSetLayout = createDescriptorSetLayout({
+			{ 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT },
+			{ 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT },
+			{ 2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT },
+			{ 3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT },
+		});
+		auto drawCompactPipelineLayout = createPipelineLayout({ drawCompactDescriptorSetLayout }, {
+			{ VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ClusterCullBatchConstants) },
+		});
+		auto drawCompactPipeline = createComputePipeline(drawCompactPipelineLayout, loadShaderModule("data/shaders/draw-compact.comp.spv"));
+
+		auto batchedDescriptorSetLayout = createDescriptorSetLayout({
+			{ 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 1, VK_SHADER_STAGE_VERTEX_BIT },
+			{ 1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT },
+		});
+		auto batchedPipelineLayout = createPipelineLayout({ batchedDescriptorSetLayout }, {
+			{ VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(glm::mat4) },
+		});
+		auto batchedPipeline = createGraphicsPipeline(batchedPipelineLayout, renderPass, pipelineVertexInputStateCreateInfo, "data/shaders/triangle-batched.vert.spv");
+
+		auto gpuDrivenDescriptorPool = createDescriptorPool({
+			{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 14 },
+			{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 2 },
+			{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1 },
+		}, 4);
+
+		auto cullAllocateDescriptorSet = allocateDescriptorSet(gpuDrivenDescriptorPool, cullAllocateDescriptorSetLayout);
+		auto batchCullDescriptorSet = allocateDescriptorSet(gpuDrivenDescriptorPool, batchCullDescriptorSetLayout);
+		auto drawCompactDescriptorSet = allocateDescriptorSet(gpuDrivenDescriptorPool, drawCompactDescriptorSetLayout);
+		auto batchedDescriptorSet = allocateDescriptorSet(gpuDrivenDescriptorPool, batchedDescriptorSetLayout);
+		{
+			VkDescriptorBufferInfo cullAllocateBufferInfos[] = {
+				occlusionCullState.getDispatchCommandBuffer().getDescriptorBufferInfo(),
+				cullBatchTarget.getRegionOffsetBuffer().getDescriptorBufferInfo(),
+				cullBatchTarget.getIndexCursorBuffer().getDescriptorBufferInfo(),
+			};
+
+			VkDescriptorBufferInfo batchCullBufferInfos[] = {
+				clusteredMesh.getMeshletBuffer().getDescriptorBufferInfo(),
+				clusteredMesh.getMeshletVertexBuffer().getDescriptorBufferInfo(),
+				clusteredMesh.getMeshletTriangleBuffer().getDescriptorBufferInfo(),
+				cullBatchTarget.getIndexBuffer().getDescriptorBufferInfo(),
+				cullBatchTarget.getIndexCountBuffer().getDescriptorBufferInfo(),
+			};
+			auto gpuObjectsBufferInfo = uniformRing.getDescriptorBufferInfo(gpuObjectsSize);
+			VkDescriptorBufferInfo batchCullRegionBufferInfos[] = {
+				occlusionCullState.getDispatchCommandBuffer().getDescriptorBufferInfo(),
+				cullBatchTarget.getRegionOffsetBuffer().getDescriptorBufferInfo(),
+			};
+
+			VkDescriptorBufferInfo drawCompactBufferInfos[] = {
+				cullBatchTarget.getIndexCountBuffer().getDescriptorBufferInfo(),
+				cullBatchTarget.getDrawCommandBuffer().getDescriptorBufferInfo(),
+				cullBatchTarget.getDrawCountBuffer().getDescriptorBufferInfo(),
+				cullBatchTarget.getRegionOffsetBuffer().getDescriptorBufferInfo(),
+			};
+
+			VkWriteDescriptorSet writeDescriptorSets[7] = {};
+			for (auto &writeDescriptorSet : writeDescriptorSets)
+				writeDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+
+			// consecutive bindings of the same type share a write
+			writeDescriptorSets[0].dstSet = batchCullDescriptorSet;
+			writeDescriptorSets[0].dstBinding = 0;
+			writeDescriptorSets[0].descriptorCount = ARRAY_SIZE(batchCullBufferInfos);
+			writeDescriptorSets[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			writeDescriptorSets[0].pBufferInfo = batchCullBufferInfos;
+
+			writeDescriptorSets[1].dstSet = batchCullDescriptorSet;
+			writeDescriptorSets[1].dstBinding = 5;
+			writeDescriptorSets[1].descriptorCount = 1;
+			writeDescriptorSets[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+			writeDescriptorSets[1].pBufferInfo = &gpuObjectsBufferInfo;
+
+			writeDescriptorSets[2].dstSet = batchCullDescriptorSet;
+			writeDescriptorSets[2].dstBinding = 6;
+			writeDescriptorSets[2].descriptorCount = ARRAY_SIZE(batchCullRegionBufferInfos);
+			writeDescriptorSets[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			writeDescriptorSets[2].pBufferInfo = batchCullRegionBufferInfos;
+
+			writeDescriptorSets[3].dstSet = drawCompactDescriptorSet;
+			writeDescriptorSets[3].dstBinding = 0;
+			writeDescriptorSets[3].descriptorCount = ARRAY_SIZE(drawCompactBufferInfos);
+			writeDescriptorSets[3].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			writeDescriptorSets[3].pBufferInfo = drawCompactBufferInfos;
+
+			writeDescriptorSets[4].dstSet = batchedDescriptorSet;
+			writeDescriptorSets[4].dstBinding = 0;
+			writeDescriptorSets[4].descriptorCount = 1;
+			writeDescriptorSets[4].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+			writeDescriptorSets[4].pBufferInfo = &gpuObjectsBufferInfo;
+
+			writeDescriptorSets[5].dstSet = batchedDescriptorSet;
+			writeDescriptorSets[5].dstBinding = 1;
+			writeDescriptorSets[5].descriptorCount = 1;
+			writeDescriptorSets[5].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+			writeDescriptorSets[5].pImageInfo = &descriptorImageInfo;
+
+			writeDescriptorSets[6].dstSet = cullAllocateDescriptorSet;
+			writeDescriptorSets[6].dstBinding = 0;
+			writeDescriptorSets[6].descriptorCount = ARRAY_SIZE(cullAllocateBufferInfos);
+			writeDescriptorSets[6].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			writeDescriptorSets[6].pBufferInfo = cullAllocateBufferInfos;
+
+			vkUpdateDescriptorSets(device, ARRAY_SIZE(writeDescriptorSets), writeDescriptorSets, 0, nullptr);
+		}
 
 		VkDescriptorSetLayoutBinding computeDescriptorSetLayoutBindings[] = {
 			{ 0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT, 0 },
@@ -541,6 +824,10 @@ int main(int argc, char *argv[])
 			err = vkResetFences(device, 1, &commandBufferFences[currentSwapImage]);
 			assert(err == VK_SUCCESS);
 
+			// the GPU is done with this frame's uniforms now
+			uniformRing.beginFrame(currentSwapImage);
+			UploadBatch::collectGarbage();
+
 			auto commandBuffer = commandBuffers[currentSwapImage];
 			VkCommandBufferBeginInfo commandBufferBeginInfo = {};
 			commandBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
@@ -558,27 +845,12 @@ int main(int argc, char *argv[])
 				1.0f
 			};
 
-			VkRenderPassBeginInfo renderPassBeginInfo = {};
-			renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-			renderPassBeginInfo.renderPass = renderPass;
-			renderPassBeginInfo.renderArea.offset.x = 0;
-			renderPassBeginInfo.renderArea.offset.y = 0;
-			renderPassBeginInfo.renderArea.extent.width = width;
-			renderPassBeginInfo.renderArea.extent.height = height;
-			renderPassBeginInfo.clearValueCount = ARRAY_SIZE(clearValues);
-			renderPassBeginInfo.pClearValues = clearValues;
-			renderPassBeginInfo.framebuffer = framebuffer;
-
-			vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
-
-			setViewport(commandBuffer, 0, 0, float(width), float(height));
-			setScissor(commandBuffer, 0, 0, width, height);
-
 			auto th = float(time);
 
 			// animate, yo
-			t1->setLocalMatrix(glm::rotate(glm::mat4(1), th, glm::vec3(0, 0, 1)));
-			t2->setLocalMatrix(glm::translate(glm::mat4(1), glm::vec3(cos(th), 1, 1)));
+			t1.setLocalMatrix(glm::rotate(glm::mat4(1), th, glm::vec3(0, 0, 1)));
+			t2.setLocalMatrix(glm::translate(glm::mat4(1), glm::vec3(cos(th), 1, 1)));
+			scene.updateWorldMatrices();
 
 			auto viewPosition = glm::vec3(sin(th * 0.1f) * 10.0f, 0, cos(th * 0.1f) * 10.0f);
 			auto viewMatrix = glm::lookAt(viewPosition, glm::vec3(0), glm::vec3(0, 1, 0));
@@ -589,38 +861,207 @@ int main(int argc, char *argv[])
 			auto projectionMatrix = glm::perspective(fov * float(M_PI / 180.0f), aspect, znear, zfar);
 			auto viewProjectionMatrix = projectionMatrix * viewMatrix;
 
-			auto offset = 0u;
-			map<const Transform*, unsigned int> offsetMap;
-			auto transforms = scene.getTransforms();
-			auto ptr = uniformBuffer.map(0, uniformBufferSpacing * transforms.size());
-			for (auto transform : transforms) {
-				auto modelMatrix = transform->getAbsoluteMatrix();
-				auto modelViewProjectionMatrix = viewProjectionMatrix * modelMatrix;
-				perObjectUniforms.modelViewProjectionMatrix = modelViewProjectionMatrix;
-				memcpy(static_cast<uint8_t *>(ptr) + offset, &perObjectUniforms, sizeof(perObjectUniforms));
-				offsetMap[transform] = offset;
-				offset += uniformBufferSpacing;
+			auto gpuDriven = gpuDrivenRendering && canDrawGpuDriven;
+			auto &transforms = scene.getTransforms();
+			auto &objects = scene.getObjects();
+
+			// every transform owns the uniform slot matching its handle
+			VkDeviceSize uniformBaseOffset = 0, gpuObjectsOffset = 0;
+			if (!gpuDriven) {
+				auto ptr = static_cast<uint8_t *>(uniformRing.allocate(uniformBufferSpacing * transforms.size(), &uniformBaseOffset));
+				for (TransformHandle transform = 0; transform < transforms.size(); ++transform) {
+					auto modelViewProjectionMatrix = viewProjectionMatrix * transforms.getWorldMatrix(transform);
+					perObjectUniforms.modelViewProjectionMatrix = modelViewProjectionMatrix;
+					memcpy(ptr + transform * uniformBufferSpacing, &perObjectUniforms, sizeof(perObjectUniforms));
+				}
+			} else {
+				auto gpuObjects = static_cast<GpuObject *>(uniformRing.allocate(gpuObjectsSize, &gpuObjectsOffset));
+				for (size_t i = 0; i < objects.size(); ++i)
+					gpuObjects[i] = GpuObject(transforms.getWorldMatrix(objects[i].getTransform()), objectMaterials[i]);
 			}
-			uniformBuffer.unmap();
-
-			VkDeviceSize vertexBufferOffsets[1] = { 0 };
-			VkBuffer vertexBuffers[1] = { vertexBuffer.getBuffer() };
-			vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, vertexBufferOffsets);
-			vkCmdBindIndexBuffer(commandBuffer, indexBuffer.getBuffer(), 0, VK_INDEX_TYPE_UINT16);
-			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
-
-			for (auto object : scene.getObjects()) {
-				assert(offsetMap.count(object->getTransform()) > 0);
-
-				auto offset = offsetMap[object->getTransform()];
-				assert(offset <= uniformBufferSize - uniformSize);
-				uint32_t dynamicOffsets[] = { (uint32_t)offset };
-				vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSet, 1, dynamicOffsets);
-				// vkCmdDraw(commandBuffer, ARRAY_SIZE(vertexPositions), 1, 0, 0);
-				vkCmdDrawIndexed(commandBuffer, ARRAY_SIZE(CubeData::vertexIndices), 1, 0, 0, 0);
+
+			// whole objects first, then the meshlets of the ones left that are off-screen or facing away;
+			// GPU-driven, the occlusion cull does the frustum too, so there's nothing to do per object here
+			visibleObjects.clear();
+			if (!gpuDriven)
+				scene.findVisibleObjects(Frustum(viewProjectionMatrix), visibleObjects);
+
+			VkDeviceSize cullObjectsOffset;
+			auto cullObjects = static_cast<OcclusionCullObject *>(uniformRing.allocate(cullObjectsSize, &cullObjectsOffset));
+			for (size_t i = 0; i < objects.size(); ++i)
+				cullObjects[i] = OcclusionCullObject(scene.getWorldBounds(i), clusteredMesh.getMeshletCount());
+
+			// sizes the meshlet cull of every object, which draws nothing if it's culled
+			auto cullObjectsPhase = [&](OcclusionCullConstants::Phase phase) {
+				OcclusionCullConstants occlusionCullConstants(viewProjectionMatrix, width, height, uint32_t(objects.size()), phase);
+				uint32_t dynamicOffsets[] = { (uint32_t)cullObjectsOffset };
+
+				occlusionCullState.beginCull(commandBuffer);
+				vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, occlusionCullPipeline);
+				vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, occlusionCullPipelineLayout, 0, 1, &occlusionCullDescriptorSet, 1, dynamicOffsets);
+				vkCmdPushConstants(commandBuffer, occlusionCullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(occlusionCullConstants), &occlusionCullConstants);
+				vkCmdDispatch(commandBuffer, (uint32_t(objects.size()) + 63) / 64, 1, 1);
+				occlusionCullState.endCull(commandBuffer);
+
+				if (gpuDriven) {
+					// y alone may not reach every object, see cluster-cull-batched.comp
+					auto objectCount = uint32_t(objects.size());
+					auto groupCountY = std::min(objectCount, deviceProperties.limits.maxComputeWorkGroupCount[1]);
+					auto groupCountZ = (objectCount + groupCountY - 1) / groupCountY;
+					ClusterCullConstants cullConstants(viewProjectionMatrix, viewPosition);
+					uint32_t gpuObjectsOffsets[] = { (uint32_t)gpuObjectsOffset };
+
+					ClusterCullBatchConstants batchConstants(cullBatchTarget, useDrawCount);
+
+					cullBatchTarget.beginCull(commandBuffer);
+					vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullAllocatePipeline);
+					vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullAllocatePipelineLayout, 0, 1, &cullAllocateDescriptorSet, 0, nullptr);
+					vkCmdPushConstants(commandBuffer, cullAllocatePipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(batchConstants), &batchConstants);
+					vkCmdDispatch(commandBuffer, (objectCount + 63) / 64, 1, 1);
+					cullBatchTarget.endAllocate(commandBuffer);
+
+					vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, batchCullPipeline);
+					vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, batchCullPipelineLayout, 0, 1, &batchCullDescriptorSet, 1, gpuObjectsOffsets);
+					vkCmdPushConstants(commandBuffer, batchCullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(cullConstants), &cullConstants);
+					vkCmdDispatch(commandBuffer, clusteredMesh.getMeshletCount(), groupCountY, groupCountZ);
+					cullBatchTarget.endCull(commandBuffer);
+
+					vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, drawCompactPipeline);
+					vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, drawCompactPipelineLayout, 0, 1, &drawCompactDescriptorSet, 0, nullptr);
+					vkCmdPushConstants(commandBuffer, drawCompactPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(batchConstants), &batchConstants);
+					vkCmdDispatch(commandBuffer, (objectCount + 63) / 64, 1, 1);
+					cullBatchTarget.endCompact(commandBuffer);
+					return;
+				}
+
+				vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipeline);
+				for (auto i : visibleObjects) {
+					auto &worldMatrix = transforms.getWorldMatrix(objects[i].getTransform());
+					auto objectSpaceCamera = glm::vec3(glm::inverse(worldMatrix) * glm::vec4(viewPosition, 1.0f));
+					ClusterCullConstants cullConstants(viewProjectionMatrix * worldMatrix, objectSpaceCamera);
+
+					cullTargets[i]->beginCull(commandBuffer);
+					vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipelineLayout, 0, 1, &cullDescriptorSets[i], 0, nullptr);
+					vkCmdPushConstants(commandBuffer, cullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(cullConstants), &cullConstants);
+					vkCmdDispatchIndirect(commandBuffer, occlusionCullState.getDispatchCommandBuffer().getBuffer(), occlusionCullState.getDispatchCommandOffset(i));
+					cullTargets[i]->endCull(commandBuffer);
+				}
+			};
+
+			auto drawObjects = [&](VkRenderPass objectRenderPass) {
+				VkRenderPassBeginInfo renderPassBeginInfo = {};
+				renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+				renderPassBeginInfo.renderPass = objectRenderPass;
+				renderPassBeginInfo.renderArea.offset.x = 0;
+				renderPassBeginInfo.renderArea.offset.y = 0;
+				renderPassBeginInfo.renderArea.extent.width = width;
+				renderPassBeginInfo.renderArea.extent.height = height;
+				renderPassBeginInfo.clearValueCount = ARRAY_SIZE(clearValues);
+				renderPassBeginInfo.pClearValues = clearValues;
+				renderPassBeginInfo.framebuffer = framebuffer;
+
+				vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+				setViewport(commandBuffer, 0, 0, float(width), float(height));
+				setScissor(commandBuffer, 0, 0, width, height);
+
+				VkDeviceSize vertexBufferOffsets[1] = { 0 };
+				VkBuffer vertexBuffers[1] = { mesh.getVertexBuffer().getBuffer() };
+				vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, vertexBufferOffsets);
+
+				if (gpuDriven) {
+					uint32_t gpuObjectsOffsets[] = { (uint32_t)gpuObjectsOffset };
+					vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, batchedPipeline);
+					vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, batchedPipelineLayout, 0, 1, &batchedDescriptorSet, 1, gpuObjectsOffsets);
+					vkCmdPushConstants(commandBuffer, batchedPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(viewProjectionMatrix), &viewProjectionMatrix);
+					vkCmdBindIndexBuffer(commandBuffer, cullBatchTarget.getIndexBuffer().getBuffer(), 0, VK_INDEX_TYPE_UINT32);
+
+					auto drawCount = cullBatchTarget.getInstanceCount();
+					auto drawCommandBuffer = cullBatchTarget.getDrawCommandBuffer().getBuffer();
+					auto stride = uint32_t(sizeof(VkDrawIndexedIndirectCommand));
+					if (useDrawCount) {
+						deviceFuncs.vkCmdDrawIndexedIndirectCountKHR(commandBuffer, drawCommandBuffer, 0,
+							cullBatchTarget.getDrawCountBuffer().getBuffer(), 0, drawCount, stride);
+					} else {
+						// one command per object, the culled ones empty; as many at a time as the device takes
+						auto maxDrawCount = enabledFeatures.multiDrawIndirect ? deviceProperties.limits.maxDrawIndirectCount : 1;
+						for (uint32_t first = 0; first < drawCount; first += maxDrawCount)
+							vkCmdDrawIndexedIndirect(commandBuffer, drawCommandBuffer, first * stride, std::min(maxDrawCount, drawCount - first), stride);
+					}
+
+					vkCmdEndRenderPass(commandBuffer);
+					return;
+				}
+
+				vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+				for (auto i : visibleObjects) {
+					auto offset = uniformBaseOffset + objects[i].getTransform() * uniformBufferSpacing;
+					uint32_t dynamicOffsets[] = { (uint32_t)offset };
+					vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSet, 1, dynamicOffsets);
+					vkCmdBindIndexBuffer(commandBuffer, cullTargets[i]->getIndexBuffer().getBuffer(), 0, VK_INDEX_TYPE_UINT32);
+					vkCmdDrawIndexedIndirect(commandBuffer, cullTargets[i]->getDrawCommandBuffer().getBuffer(), 0, 1, sizeof(VkDrawIndexedIndirectCommand));
+				}
+
+				vkCmdEndRenderPass(commandBuffer);
+			};
+
+			// what was visible last frame is likely to be now, and makes a good occluder
+			cullObjectsPhase(OcclusionCullConstants::EARLY_PHASE);
+			drawObjects(renderPass);
+
+			// build the depth pyramid from that, the farthest depth of each level down to 1x1
+			imageBarrier(
+				commandBuffer,
+				depthRenderTarget.getImage(),
+				VK_IMAGE_ASPECT_DEPTH_BIT,
+				VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+				VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT,
+				VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+			// the last frame's late phase may still be reading the old one
+			imageBarrier(
+				commandBuffer,
+				depthPyramid.getImage(),
+				VK_IMAGE_ASPECT_COLOR_BIT,
+				VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+				VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+				VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, depthReducePipeline);
+			for (int level = 0; level < pyramidLevels; ++level) {
+				vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, depthReducePipelineLayout, 0, 1, &depthReduceDescriptorSets[level], 0, nullptr);
+				vkCmdDispatch(commandBuffer, (depthPyramid.getMipWidth(level) + 7) / 8, (depthPyramid.getMipHeight(level) + 7) / 8, 1);
+
+				VkImageSubresourceRange levelRange = { VK_IMAGE_ASPECT_COLOR_BIT, uint32_t(level), 1, 0, 1 };
+				imageBarrier(
+					commandBuffer,
+					depthPyramid.getImage(),
+					levelRange,
+					VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+					VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT,
+					VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL);
 			}
 
-			vkCmdEndRenderPass(commandBuffer);
+			imageBarrier(
+				commandBuffer,
+				depthRenderTarget.getImage(),
+				VK_IMAGE_ASPECT_DEPTH_BIT,
+				VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT,
+				VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+				VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
+
+			// the late pass loads the colors the early one stored
+			imageBarrier(
+				commandBuffer,
+				colorRenderTarget.getImage(),
+				VK_IMAGE_ASPECT_COLOR_BIT,
+				VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+				VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+				VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+
+			// then whatever else passes against it
+			cullObjectsPhase(OcclusionCullConstants::LATE_PHASE);
+			drawObjects(lateRenderPass);
 
 			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, computePipeline);
 			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, computePipelineLayout, 0, 1, &computeDescriptorSet, 0, nullptr);
@@ -0,0 +1,47 @@
+#ifndef BAKED_TEXTURE_FORMAT_H
+#define BAKED_TEXTURE_FORMAT_H
+
+#include <stdint.h>
+
+/*
+ * Container written by the bake-texture tool: a header, one level entry per
+ * (array layer, mip level), layer-major, and then the payload with every
+ * level in its final GPU format. Loading is a straight copy of the payload
+ * into staging memory. All fields are little-endian.
+ */
+
+const uint32_t bakedTextureMagic = 0x58544c45; // "ELTX"
+const uint32_t bakedTextureVersion = 1;
+
+// the payload starts page-aligned, so it can also be read with unbuffered I/O
+const uint64_t bakedTexturePayloadAlignment = 4096;
+
+enum BakedTextureType {
+	BAKED_TEXTURE_2D = 0,
+	BAKED_TEXTURE_2D_ARRAY = 1,
+	BAKED_TEXTURE_CUBE = 2,
+};
+
+struct BakedTextureHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t type;   // BakedTextureType
+	uint32_t format; // VkFormat
+	uint32_t width, height;
+	uint32_t mipLevels, arrayLayers;
+	uint64_t payloadOffset; // from the start of the file
+	uint64_t payloadSize;
+};
+
+// every level starts on this, and its size is padded to it
+const uint64_t bakedTextureLevelAlignment = 16;
+
+struct BakedTextureLevel {
+	uint64_t offset; // from payloadOffset
+	uint64_t size;   // including the padding
+};
+
+static_assert(sizeof(BakedTextureHeader) == 48, "unexpected padding");
+static_assert(sizeof(BakedTextureLevel) == 16, "unexpected padding");
+
+#endif // BAKED_TEXTURE_FORMAT_H
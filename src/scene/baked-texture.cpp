@@ -0,0 +1,288 @@
+#include "baked-texture.h"
+#include "baked-texture-format.h"
+#include "uploadbatch.h"
+#include "../core/asyncfilereader.h"
+#include "../core/core.h"
+
+#include <algorithm>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+using std::string;
+using std::runtime_error;
+using std::unique_ptr;
+using std::vector;
+
+namespace
+{
+	struct BakedTextureFile {
+		explicit BakedTextureFile(const string &filename) :
+			file(filename.c_str())
+		{
+		}
+
+		ReadableFile file;
+		BakedTextureHeader header;
+		vector<BakedTextureLevel> levels;
+	};
+}
+
+static uint64_t getLevelSize(VkFormat format, uint32_t width, uint32_t height, uint32_t mipLevel)
+{
+	uint64_t levelWidth = std::max(width >> mipLevel, 1u);
+	uint64_t levelHeight = std::max(height >> mipLevel, 1u);
+	if (TextureBase::getBlockSize(format) != 0) {
+		levelWidth = (levelWidth + 3) / 4;
+		levelHeight = (levelHeight + 3) / 4;
+	}
+
+	auto size = levelWidth * levelHeight * TextureBase::getTexelSize(format);
+	return (size + bakedTextureLevelAlignment - 1) & ~(bakedTextureLevelAlignment - 1);
+}
+
+static void validateHeader(const BakedTextureFile &baked, BakedTextureType expectedType)
+{
+	auto size = baked.file.getSize();
+	auto &header = baked.header;
+
+	if (header.magic != bakedTextureMagic)
+		throw runtime_error("not a baked texture!");
+	if (header.version != bakedTextureVersion)
+		throw runtime_error("unsupported baked texture version!");
+	if (header.type != uint32_t(expectedType))
+		throw runtime_error("unexpected texture type!");
+	if (header.mipLevels == 0 || header.arrayLayers == 0)
+		throw runtime_error("empty texture!");
+
+	// the textures take int dimensions, and the chain can't go past 1x1
+	if (header.width == 0 || header.height == 0 || header.width > INT32_MAX || header.height > INT32_MAX ||
+	    header.mipLevels > 32 - clz(std::max(header.width, header.height)) ||
+	    TextureBase::getTexelSize(VkFormat(header.format)) == 0)
+		throw runtime_error("corrupt texture file!");
+
+	if (expectedType == BAKED_TEXTURE_CUBE && (header.arrayLayers != 6 || header.width != header.height))
+		throw runtime_error("unexpected cube map layout!");
+
+	if (!TextureBase::canSample(VkFormat(header.format)))
+		throw runtime_error("unsupported texture format!");
+
+	auto levelCount = uint64_t(header.mipLevels) * header.arrayLayers;
+	if (sizeof(BakedTextureHeader) + levelCount * sizeof(BakedTextureLevel) > header.payloadOffset ||
+	    header.payloadOffset > size || header.payloadSize > size - header.payloadOffset)
+		throw runtime_error("truncated texture file!");
+}
+
+// the alignment is a multiple of every texel and block size
+static void validateLevels(const BakedTextureFile &baked)
+{
+	auto &header = baked.header;
+	for (size_t i = 0; i < baked.levels.size(); ++i) {
+		auto &level = baked.levels[i];
+		auto mipLevel = uint32_t(i % header.mipLevels);
+		if (level.offset % bakedTextureLevelAlignment != 0 ||
+		    level.size != getLevelSize(VkFormat(header.format), header.width, header.height, mipLevel) ||
+		    level.offset > header.payloadSize || level.size > header.payloadSize - level.offset)
+			throw runtime_error("corrupt texture file!");
+	}
+}
+
+static void queueLevelTableRead(AsyncFileReader &reader, BakedTextureFile *baked)
+{
+	auto &header = baked->header;
+	baked->levels.resize(size_t(uint64_t(header.mipLevels) * header.arrayLayers));
+	reader.read(baked->file, sizeof(BakedTextureHeader), baked->levels.size() * sizeof(BakedTextureLevel), baked->levels.data());
+}
+
+// for a payload that has landed in staging memory
+static void uploadLevels(UploadBatch &uploadBatch, TextureBase &texture, const BakedTextureFile &baked, const StagingSlice &payloadSlice)
+{
+	auto &header = baked.header;
+	for (auto arrayLayer = 0u; arrayLayer < header.arrayLayers; ++arrayLayer) {
+		for (auto mipLevel = 0u; mipLevel < header.mipLevels; ++mipLevel) {
+			auto &level = baked.levels[arrayLayer * header.mipLevels + mipLevel];
+
+			auto levelSlice = payloadSlice;
+			levelSlice.offset += level.offset;
+			levelSlice.data = static_cast<uint8_t *>(levelSlice.data) + level.offset;
+			texture.uploadFromStagingBuffer(uploadBatch, levelSlice, int(mipLevel), int(arrayLayer));
+		}
+	}
+
+	texture.finishUpload(uploadBatch);
+}
+
+// for a payload too large for the staging ring, which has been read into memory instead
+static void uploadLevelsInPieces(UploadBatch &uploadBatch, TextureBase &texture, const BakedTextureFile &baked, const uint8_t *payload)
+{
+	auto &header = baked.header;
+	for (auto arrayLayer = 0u; arrayLayer < header.arrayLayers; ++arrayLayer) {
+		for (auto mipLevel = 0u; mipLevel < header.mipLevels; ++mipLevel) {
+			auto &level = baked.levels[arrayLayer * header.mipLevels + mipLevel];
+			texture.upload(uploadBatch, payload + level.offset, int(mipLevel), int(arrayLayer));
+		}
+	}
+
+	texture.finishUpload(uploadBatch);
+}
+
+/*
+ * Payloads are read straight into staging memory, for as many textures at
+ * once as fit into one allocation, with their reads in flight together.
+ * The allocation has to come before the reads, and the reads have to land
+ * before the copies are recorded: allocateStaging() may submit the batch
+ * when the ring runs full. A payload larger than the ring goes through
+ * memory, and into staging in pieces from there.
+ */
+static void uploadPayloads(UploadBatch &uploadBatch, AsyncFileReader &reader, const vector<unique_ptr<BakedTextureFile>> &files, const vector<TextureBase *> &textures)
+{
+	auto maxStagingSize = UploadBatch::getMaxStagingSize();
+
+	size_t first = 0;
+	while (first < files.size()) {
+		auto &firstFile = *files[first];
+		if (firstFile.header.payloadSize > maxStagingSize) {
+			vector<uint8_t> payload(size_t(firstFile.header.payloadSize));
+			reader.read(firstFile.file, firstFile.header.payloadOffset, payload.size(), payload.data());
+			reader.wait();
+
+			uploadLevelsInPieces(uploadBatch, *textures[first], firstFile, payload.data());
+			first++;
+			continue;
+		}
+
+		vector<VkDeviceSize> offsets;
+		VkDeviceSize groupSize = 0;
+		auto end = first;
+		for (; end < files.size(); ++end) {
+			auto offset = vulkan::alignSize(groupSize, bakedTextureLevelAlignment);
+			if (offset > maxStagingSize || files[end]->header.payloadSize > maxStagingSize - offset)
+				break;
+
+			offsets.push_back(offset);
+			groupSize = offset + files[end]->header.payloadSize;
+		}
+
+		auto stagingSlice = uploadBatch.allocateStaging(groupSize, bakedTextureLevelAlignment);
+		for (auto i = first; i < end; ++i) {
+			auto &header = files[i]->header;
+			auto data = static_cast<uint8_t *>(stagingSlice.data) + offsets[i - first];
+			reader.read(files[i]->file, header.payloadOffset, size_t(header.payloadSize), data);
+		}
+		reader.wait();
+
+		for (auto i = first; i < end; ++i) {
+			auto payloadSlice = stagingSlice;
+			payloadSlice.offset += offsets[i - first];
+			payloadSlice.data = static_cast<uint8_t *>(payloadSlice.data) + offsets[i - first];
+			uploadLevels(uploadBatch, *textures[i], *files[i], payloadSlice);
+		}
+
+		first = end;
+	}
+}
+
+/*
+ * All headers are read together, then all level tables, then the payloads.
+ * Everything that can throw happens while no read is in flight, as the
+ * reads target memory that unwinding would free.
+ */
+template <typename Texture, typename CreateTexture>
+static vector<Texture> loadBakedTextures(UploadBatch &uploadBatch, const vector<string> &filenames, AsyncFileReader *reader, BakedTextureType type, CreateTexture createTexture)
+{
+	vector<unique_ptr<BakedTextureFile>> files;
+	for (auto &filename : filenames) {
+		files.emplace_back(new BakedTextureFile(filename));
+		if (files.back()->file.getSize() < sizeof(BakedTextureHeader))
+			throw runtime_error("truncated texture file!");
+	}
+
+	// after the files, so its destructor waits for reads into them
+	AsyncFileReader localReader;
+	if (reader == nullptr)
+		reader = &localReader;
+
+	for (auto &baked : files)
+		reader->read(baked->file, 0, sizeof(BakedTextureHeader), &baked->header);
+	reader->wait();
+
+	for (auto &baked : files)
+		validateHeader(*baked, type);
+	for (auto &baked : files)
+		queueLevelTableRead(*reader, baked.get());
+	reader->wait();
+
+	vector<Texture> textures;
+	textures.reserve(files.size());
+	for (auto &baked : files) {
+		validateLevels(*baked);
+		textures.push_back(createTexture(baked->header));
+	}
+
+	vector<TextureBase *> texturePointers;
+	for (auto &texture : textures)
+		texturePointers.push_back(&texture);
+	uploadPayloads(uploadBatch, *reader, files, texturePointers);
+
+	return textures;
+}
+
+vector<Texture2D> loadBakedTextures2D(UploadBatch &uploadBatch, const vector<string> &filenames, AsyncFileReader *reader)
+{
+	return loadBakedTextures<Texture2D>(uploadBatch, filenames, reader, BAKED_TEXTURE_2D, [](const BakedTextureHeader &header) {
+		return Texture2D(VkFormat(header.format), header.width, header.height, header.mipLevels, 1, true);
+	});
+}
+
+vector<Texture2DArray> loadBakedTextures2DArray(UploadBatch &uploadBatch, const vector<string> &filenames, AsyncFileReader *reader)
+{
+	return loadBakedTextures<Texture2DArray>(uploadBatch, filenames, reader, BAKED_TEXTURE_2D_ARRAY, [](const BakedTextureHeader &header) {
+		return Texture2DArray(VkFormat(header.format), header.width, header.height, header.arrayLayers, header.mipLevels, true);
+	});
+}
+
+vector<TextureCube> loadBakedTexturesCube(UploadBatch &uploadBatch, const vector<string> &filenames, AsyncFileReader *reader)
+{
+	return loadBakedTextures<TextureCube>(uploadBatch, filenames, reader, BAKED_TEXTURE_CUBE, [](const BakedTextureHeader &header) {
+		return TextureCube(VkFormat(header.format), header.width, header.mipLevels);
+	});
+}
+
+Texture2D loadBakedTexture2D(UploadBatch &uploadBatch, const string &filename, AsyncFileReader *reader)
+{
+	return loadBakedTextures2D(uploadBatch, vector<string>(1, filename), reader)[0];
+}
+
+Texture2DArray loadBakedTexture2DArray(UploadBatch &uploadBatch, const string &filename, AsyncFileReader *reader)
+{
+	return loadBakedTextures2DArray(uploadBatch, vector<string>(1, filename), reader)[0];
+}
+
+TextureCube loadBakedTextureCube(UploadBatch &uploadBatch, const string &filename, AsyncFileReader *reader)
+{
+	return loadBakedTexturesCube(uploadBatch, vector<string>(1, filename), reader)[0];
+}
+
+Texture2D loadBakedTexture2D(const string &filename)
+{
+	UploadBatch uploadBatch;
+	auto texture = loadBakedTexture2D(uploadBatch, filename);
+	uploadBatch.submit();
+	return texture;
+}
+
+Texture2DArray loadBakedTexture2DArray(const string &filename)
+{
+	UploadBatch uploadBatch;
+	auto texture = loadBakedTexture2DArray(uploadBatch, filename);
+	uploadBatch.submit();
+	return texture;
+}
+
+TextureCube loadBakedTextureCube(const string &filename)
+{
+	UploadBatch uploadBatch;
+	auto texture = loadBakedTextureCube(uploadBatch, filename);
+	uploadBatch.submit();
+	return texture;
+}
@@ -0,0 +1,29 @@
+#ifndef BAKED_TEXTURE_H
+#define BAKED_TEXTURE_H
+
+#include "texture.h"
+#include <string>
+#include <vector>
+
+class AsyncFileReader;
+
+/*
+ * Loaders for files written by the bake-texture tool. The payload is read
+ * straight into staging memory as is; there's no decoding or conversion
+ * left to do at run-time. Loading several files in one call keeps their
+ * reads in flight together. Pass a reader to share its queue and
+ * statistics across loads; otherwise each call sets up its own.
+ */
+std::vector<Texture2D> loadBakedTextures2D(UploadBatch &uploadBatch, const std::vector<std::string> &filenames, AsyncFileReader *reader = nullptr);
+std::vector<Texture2DArray> loadBakedTextures2DArray(UploadBatch &uploadBatch, const std::vector<std::string> &filenames, AsyncFileReader *reader = nullptr);
+std::vector<TextureCube> loadBakedTexturesCube(UploadBatch &uploadBatch, const std::vector<std::string> &filenames, AsyncFileReader *reader = nullptr);
+
+Texture2D loadBakedTexture2D(UploadBatch &uploadBatch, const std::string &filename, AsyncFileReader *reader = nullptr);
+Texture2DArray loadBakedTexture2DArray(UploadBatch &uploadBatch, const std::string &filename, AsyncFileReader *reader = nullptr);
+TextureCube loadBakedTextureCube(UploadBatch &uploadBatch, const std::string &filename, AsyncFileReader *reader = nullptr);
+
+Texture2D loadBakedTexture2D(const std::string &filename);
+Texture2DArray loadBakedTexture2DArray(const std::string &filename);
+TextureCube loadBakedTextureCube(const std::string &filename);
+
+#endif // BAKED_TEXTURE_H
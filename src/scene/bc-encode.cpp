@@ -0,0 +1,716 @@
+#include "bc-encode.h"
+#include "../core/threadpool.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+#include <emmintrin.h>
+
+using std::min;
+using std::max;
+using std::vector;
+
+namespace
+{
+	// writes fields LSB first, the way BC6H and BC7 blocks are laid out
+	class BlockWriter {
+	public:
+		explicit BlockWriter(uint8_t *block) :
+			block(block),
+			position(0)
+		{
+			memset(block, 0, 16);
+		}
+
+		void write(uint32_t value, int bits)
+		{
+			for (auto i = 0; i < bits; ++i, ++position) {
+				if (value & (1u << i))
+					block[position >> 3] |= uint8_t(1 << (position & 7));
+			}
+		}
+
+		int getPosition() const { return position; }
+
+	private:
+		uint8_t *block;
+		int position;
+	};
+
+	// interpolation weights of the 4-bit index modes, out of 64
+	const int indexWeights4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+	// the largest finite half; BC6H can't represent anything above it
+	const int maxHalf = 0x7bff;
+}
+
+size_t getBlockSize(BlockCompression compression)
+{
+	return compression == BlockCompression::BC1 ? 8 : 16;
+}
+
+size_t layoutCompressedMipChain(BlockCompression compression, int width, int height, int mipLevels, vector<size_t> *offsets)
+{
+	assert(offsets != nullptr);
+	offsets->clear();
+
+	size_t offset = 0;
+	for (auto mipLevel = 0; mipLevel < mipLevels; ++mipLevel) {
+		offsets->push_back(offset);
+		auto blocksX = size_t(max(width >> mipLevel, 1) + 3) / 4;
+		auto blocksY = size_t(max(height >> mipLevel, 1) + 3) / 4;
+		auto size = blocksX * blocksY * getBlockSize(compression);
+		offset += (size + 15) & ~size_t(15);
+	}
+	offsets->push_back(offset);
+
+	return offset;
+}
+
+// gathers a 4x4 block, clamping at the edges
+static void loadBlock(const uint8_t *src, int width, int height, size_t pixelSize, int blockX, int blockY, uint8_t *block)
+{
+	auto x0 = blockX * 4;
+	for (auto y = 0; y < 4; ++y) {
+		auto row = src + size_t(min(blockY * 4 + y, height - 1)) * width * pixelSize;
+		auto dst = block + y * 4 * pixelSize;
+
+		if (x0 + 4 <= width) {
+			memcpy(dst, row + x0 * pixelSize, 4 * pixelSize);
+			continue;
+		}
+
+		for (auto x = 0; x < 4; ++x)
+			memcpy(dst + x * pixelSize, row + min(x0 + x, width - 1) * pixelSize, pixelSize);
+	}
+}
+
+static void getBoundingBox(const uint8_t block[64], uint8_t minColor[4], uint8_t maxColor[4])
+{
+	auto pixels = reinterpret_cast<const __m128i *>(block);
+	__m128i p0 = _mm_loadu_si128(pixels + 0);
+	__m128i p1 = _mm_loadu_si128(pixels + 1);
+	__m128i p2 = _mm_loadu_si128(pixels + 2);
+	__m128i p3 = _mm_loadu_si128(pixels + 3);
+
+	__m128i lo = _mm_min_epu8(_mm_min_epu8(p0, p1), _mm_min_epu8(p2, p3));
+	__m128i hi = _mm_max_epu8(_mm_max_epu8(p0, p1), _mm_max_epu8(p2, p3));
+
+	// fold the four pixels of each register into one
+	lo = _mm_min_epu8(lo, _mm_shuffle_epi32(lo, _MM_SHUFFLE(1, 0, 3, 2)));
+	hi = _mm_max_epu8(hi, _mm_shuffle_epi32(hi, _MM_SHUFFLE(1, 0, 3, 2)));
+	lo = _mm_min_epu8(lo, _mm_shuffle_epi32(lo, _MM_SHUFFLE(2, 3, 0, 1)));
+	hi = _mm_max_epu8(hi, _mm_shuffle_epi32(hi, _MM_SHUFFLE(2, 3, 0, 1)));
+
+	auto minBits = uint32_t(_mm_cvtsi128_si32(lo));
+	auto maxBits = uint32_t(_mm_cvtsi128_si32(hi));
+	memcpy(minColor, &minBits, 4);
+	memcpy(maxColor, &maxBits, 4);
+}
+
+/*
+ * For each pixel, the index of the closest palette entry by squared error
+ * over the channels in channelMask (bit 0 is red), the lowest index on
+ * ties. Returns the sum of the errors. Four pixels at a time, against one
+ * entry at a time: differences fit in 16 bits, and _mm_madd_epi16 squares
+ * and adds pairs of them into 32 bits.
+ */
+static int findClosestEntries(const uint8_t block[64], const int palette[][4], int paletteSize, int channelMask, int indices[16])
+{
+	assert(paletteSize > 0 && paletteSize <= 16);
+
+	__m128i mask = _mm_setr_epi16(
+		channelMask & 1 ? -1 : 0, channelMask & 2 ? -1 : 0, channelMask & 4 ? -1 : 0, channelMask & 8 ? -1 : 0,
+		channelMask & 1 ? -1 : 0, channelMask & 2 ? -1 : 0, channelMask & 4 ? -1 : 0, channelMask & 8 ? -1 : 0);
+
+	// each entry twice, for the two pixels in a register of 16-bit channels
+	__m128i entries[16];
+	for (auto j = 0; j < paletteSize; ++j) {
+		auto &entry = palette[j];
+		entries[j] = _mm_and_si128(mask, _mm_setr_epi16(
+			int16_t(entry[0]), int16_t(entry[1]), int16_t(entry[2]), int16_t(entry[3]),
+			int16_t(entry[0]), int16_t(entry[1]), int16_t(entry[2]), int16_t(entry[3])));
+	}
+
+	auto zero = _mm_setzero_si128();
+	auto totalErrors = zero;
+	for (auto i = 0; i < 16; i += 4) {
+		__m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i *>(block + i * 4));
+		__m128i pixels01 = _mm_and_si128(mask, _mm_unpacklo_epi8(pixels, zero));
+		__m128i pixels23 = _mm_and_si128(mask, _mm_unpackhi_epi8(pixels, zero));
+
+		__m128i bestErrors = _mm_set1_epi32(INT32_MAX);
+		__m128i bestIndices = zero;
+		for (auto j = 0; j < paletteSize; ++j) {
+			__m128i d01 = _mm_sub_epi16(pixels01, entries[j]);
+			__m128i d23 = _mm_sub_epi16(pixels23, entries[j]);
+
+			// red + green and blue + alpha of each pixel, then the two halves added up
+			__m128 e01 = _mm_castsi128_ps(_mm_madd_epi16(d01, d01));
+			__m128 e23 = _mm_castsi128_ps(_mm_madd_epi16(d23, d23));
+			__m128i errors = _mm_add_epi32(
+				_mm_castps_si128(_mm_shuffle_ps(e01, e23, _MM_SHUFFLE(2, 0, 2, 0))),
+				_mm_castps_si128(_mm_shuffle_ps(e01, e23, _MM_SHUFFLE(3, 1, 3, 1))));
+
+			__m128i better = _mm_cmplt_epi32(errors, bestErrors);
+			bestErrors = _mm_or_si128(_mm_and_si128(better, errors), _mm_andnot_si128(better, bestErrors));
+			bestIndices = _mm_or_si128(_mm_and_si128(better, _mm_set1_epi32(j)), _mm_andnot_si128(better, bestIndices));
+		}
+
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(indices + i), bestIndices);
+		totalErrors = _mm_add_epi32(totalErrors, bestErrors);
+	}
+
+	totalErrors = _mm_add_epi32(totalErrors, _mm_shuffle_epi32(totalErrors, _MM_SHUFFLE(1, 0, 3, 2)));
+	totalErrors = _mm_add_epi32(totalErrors, _mm_shuffle_epi32(totalErrors, _MM_SHUFFLE(2, 3, 0, 1)));
+	return _mm_cvtsi128_si32(totalErrors);
+}
+
+// the same for one channel, by distance: eight pixels at a time in 16-bit lanes
+static void findClosestValues(const uint8_t block[64], int channel, const int palette[8], int indices[16])
+{
+	auto pixels = reinterpret_cast<const __m128i *>(block);
+	__m128i shift = _mm_cvtsi32_si128(channel * 8);
+	__m128i byteMask = _mm_set1_epi32(0xff);
+
+	__m128i values[2];
+	for (auto k = 0; k < 2; ++k) {
+		__m128i v0 = _mm_and_si128(_mm_srl_epi32(_mm_loadu_si128(pixels + k * 2), shift), byteMask);
+		__m128i v1 = _mm_and_si128(_mm_srl_epi32(_mm_loadu_si128(pixels + k * 2 + 1), shift), byteMask);
+		values[k] = _mm_packs_epi32(v0, v1);
+	}
+
+	auto zero = _mm_setzero_si128();
+	for (auto k = 0; k < 2; ++k) {
+		__m128i bestErrors = _mm_set1_epi16(INT16_MAX);
+		__m128i bestIndices = zero;
+		for (auto j = 0; j < 8; ++j) {
+			__m128i d = _mm_sub_epi16(values[k], _mm_set1_epi16(int16_t(palette[j])));
+			__m128i errors = _mm_max_epi16(d, _mm_sub_epi16(zero, d));
+
+			__m128i better = _mm_cmplt_epi16(errors, bestErrors);
+			bestErrors = _mm_min_epi16(errors, bestErrors);
+			bestIndices = _mm_or_si128(_mm_and_si128(better, _mm_set1_epi16(int16_t(j))), _mm_andnot_si128(better, bestIndices));
+		}
+
+		int16_t lanes[8];
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(lanes), bestIndices);
+		for (auto i = 0; i < 8; ++i)
+			indices[k * 8 + i] = lanes[i];
+	}
+}
+
+/*
+ * Least-squares endpoints for pixels that are interpolated with the given
+ * weights (0 is e0, 1 is e1). Returns false if the weights don't pin down
+ * two endpoints, i.e. all pixels use the same one.
+ */
+static bool refitEndpoints(const float pixels[16][4], int channels, const float weights[16], float e0[4], float e1[4])
+{
+	float a = 0.0f, b = 0.0f, c = 0.0f;
+	float x0[4] = {}, x1[4] = {};
+	for (auto i = 0; i < 16; ++i) {
+		auto w1 = weights[i], w0 = 1.0f - w1;
+		a += w0 * w0;
+		b += w1 * w1;
+		c += w0 * w1;
+		for (auto ch = 0; ch < channels; ++ch) {
+			x0[ch] += w0 * pixels[i][ch];
+			x1[ch] += w1 * pixels[i][ch];
+		}
+	}
+
+	auto det = a * b - c * c;
+	if (fabsf(det) < 1e-6f)
+		return false;
+
+	for (auto ch = 0; ch < channels; ++ch) {
+		e0[ch] = (x0[ch] * b - x1[ch] * c) / det;
+		e1[ch] = (x1[ch] * a - x0[ch] * c) / det;
+	}
+	return true;
+}
+
+// endpoints on the principal axis, spanning the projections of all pixels
+static void fitLine(const float pixels[16][4], int channels, float e0[4], float e1[4])
+{
+	float mean[4] = {};
+	for (auto i = 0; i < 16; ++i) {
+		for (auto ch = 0; ch < channels; ++ch)
+			mean[ch] += pixels[i][ch] * (1.0f / 16);
+	}
+
+	float covariance[4][4] = {};
+	for (auto i = 0; i < 16; ++i) {
+		for (auto r = 0; r < channels; ++r) {
+			for (auto c = 0; c < channels; ++c)
+				covariance[r][c] += (pixels[i][r] - mean[r]) * (pixels[i][c] - mean[c]);
+		}
+	}
+
+	// power iteration, starting from the channel with the largest variance
+	auto start = 0;
+	for (auto ch = 1; ch < channels; ++ch) {
+		if (covariance[ch][ch] > covariance[start][start])
+			start = ch;
+	}
+
+	float axis[4] = {};
+	for (auto ch = 0; ch < channels; ++ch)
+		axis[ch] = covariance[start][ch];
+
+	for (auto iteration = 0; iteration < 8; ++iteration) {
+		float next[4] = {};
+		float length = 0.0f;
+		for (auto r = 0; r < channels; ++r) {
+			for (auto c = 0; c < channels; ++c)
+				next[r] += covariance[r][c] * axis[c];
+			length += next[r] * next[r];
+		}
+
+		if (length < 1e-12f)
+			break;
+
+		length = 1.0f / sqrtf(length);
+		for (auto ch = 0; ch < channels; ++ch)
+			axis[ch] = next[ch] * length;
+	}
+
+	auto tMin = 0.0f, tMax = 0.0f;
+	for (auto i = 0; i < 16; ++i) {
+		auto t = 0.0f;
+		for (auto ch = 0; ch < channels; ++ch)
+			t += (pixels[i][ch] - mean[ch]) * axis[ch];
+		tMin = min(tMin, t);
+		tMax = max(tMax, t);
+	}
+
+	for (auto ch = 0; ch < channels; ++ch) {
+		e0[ch] = mean[ch] + axis[ch] * tMin;
+		e1[ch] = mean[ch] + axis[ch] * tMax;
+	}
+}
+
+static uint16_t packColor565(const int color[3])
+{
+	auto r = (min(max(color[0], 0), 255) * 31 + 127) / 255;
+	auto g = (min(max(color[1], 0), 255) * 63 + 127) / 255;
+	auto b = (min(max(color[2], 0), 255) * 31 + 127) / 255;
+	return uint16_t((r << 11) | (g << 5) | b);
+}
+
+static void unpackColor565(uint16_t packed, int color[3])
+{
+	auto r = (packed >> 11) & 31, g = (packed >> 5) & 63, b = packed & 31;
+	color[0] = (r << 3) | (r >> 2);
+	color[1] = (g << 2) | (g >> 4);
+	color[2] = (b << 3) | (b >> 2);
+}
+
+// c0 > c1 selects the four-color mode, which is all we ever use
+static uint32_t findColorIndices(const uint8_t block[64], uint16_t c0, uint16_t c1, int *error)
+{
+	int palette[4][4] = {};
+	unpackColor565(c0, palette[0]);
+	unpackColor565(c1, palette[1]);
+	for (auto ch = 0; ch < 3; ++ch) {
+		palette[2][ch] = (2 * palette[0][ch] + palette[1][ch]) / 3;
+		palette[3][ch] = (palette[0][ch] + 2 * palette[1][ch]) / 3;
+	}
+
+	// equal endpoints decode in three-color mode, where index 3 is black
+	auto paletteSize = c0 == c1 ? 1 : 4;
+
+	int pixelIndices[16];
+	*error = findClosestEntries(block, palette, paletteSize, 7, pixelIndices);
+
+	uint32_t indices = 0;
+	for (auto i = 0; i < 16; ++i)
+		indices |= uint32_t(pixelIndices[i]) << (i * 2);
+	return indices;
+}
+
+static void writeColorBlock(uint16_t c0, uint16_t c1, uint32_t indices, uint8_t out[8])
+{
+	out[0] = uint8_t(c0);
+	out[1] = uint8_t(c0 >> 8);
+	out[2] = uint8_t(c1);
+	out[3] = uint8_t(c1 >> 8);
+	for (auto i = 0; i < 4; ++i)
+		out[4 + i] = uint8_t(indices >> (i * 8));
+}
+
+static void encodeColorBlock(const uint8_t block[64], uint8_t out[8])
+{
+	uint8_t minColor[4], maxColor[4];
+	getBoundingBox(block, minColor, maxColor);
+
+	int e0[3], e1[3];
+	for (auto ch = 0; ch < 3; ++ch) {
+		e0[ch] = maxColor[ch];
+		e1[ch] = minColor[ch];
+	}
+
+	// pick the bounding box diagonal that follows the colors, relative to green
+	int center[3], covarianceRG = 0, covarianceBG = 0;
+	for (auto ch = 0; ch < 3; ++ch)
+		center[ch] = (minColor[ch] + maxColor[ch] + 1) / 2;
+	for (auto i = 0; i < 16; ++i) {
+		auto pixel = block + i * 4;
+		auto dg = pixel[1] - center[1];
+		covarianceRG += (pixel[0] - center[0]) * dg;
+		covarianceBG += (pixel[2] - center[2]) * dg;
+	}
+	if (covarianceRG < 0)
+		std::swap(e0[0], e1[0]);
+	if (covarianceBG < 0)
+		std::swap(e0[2], e1[2]);
+
+	// inset by 1/16th of the range, so the extremes don't dominate
+	for (auto ch = 0; ch < 3; ++ch) {
+		auto inset = (e0[ch] - e1[ch]) / 16;
+		e0[ch] -= inset;
+		e1[ch] += inset;
+	}
+
+	auto c0 = packColor565(e0), c1 = packColor565(e1);
+	if (c0 < c1)
+		std::swap(c0, c1);
+
+	int error;
+	auto indices = findColorIndices(block, c0, c1, &error);
+
+	// one least-squares pass over the chosen indices
+	static const float indexWeights[4] = { 0.0f, 1.0f, 1.0f / 3, 2.0f / 3 };
+	float pixels[16][4], weights[16];
+	for (auto i = 0; i < 16; ++i) {
+		for (auto ch = 0; ch < 3; ++ch)
+			pixels[i][ch] = block[i * 4 + ch];
+		weights[i] = indexWeights[(indices >> (i * 2)) & 3];
+	}
+
+	float r0[4], r1[4];
+	if (error > 0 && refitEndpoints(pixels, 3, weights, r0, r1)) {
+		int q0[3], q1[3];
+		for (auto ch = 0; ch < 3; ++ch) {
+			q0[ch] = int(r0[ch] + 0.5f);
+			q1[ch] = int(r1[ch] + 0.5f);
+		}
+
+		auto refit0 = packColor565(q0), refit1 = packColor565(q1);
+		if (refit0 < refit1)
+			std::swap(refit0, refit1);
+
+		int refitError;
+		auto refitIndices = findColorIndices(block, refit0, refit1, &refitError);
+		if (refitError < error) {
+			c0 = refit0;
+			c1 = refit1;
+			indices = refitIndices;
+		}
+	}
+
+	writeColorBlock(c0, c1, indices, out);
+}
+
+// BC4, on one channel of four-channel pixels
+static void encodeChannelBlock(const uint8_t block[64], int channel, uint8_t out[8])
+{
+	int lo = 255, hi = 0;
+	for (auto i = 0; i < 16; ++i) {
+		lo = min<int>(lo, block[i * 4 + channel]);
+		hi = max<int>(hi, block[i * 4 + channel]);
+	}
+
+	memset(out, 0, 8);
+	out[0] = uint8_t(hi);
+	out[1] = uint8_t(lo);
+	if (lo == hi)
+		return;
+
+	// hi > lo selects the mode with six interpolated values
+	int palette[8] = { hi, lo };
+	for (auto i = 1; i < 7; ++i)
+		palette[i + 1] = ((7 - i) * hi + i * lo) / 7;
+
+	int pixelIndices[16];
+	findClosestValues(block, channel, palette, pixelIndices);
+
+	uint64_t indices = 0;
+	for (auto i = 0; i < 16; ++i)
+		indices |= uint64_t(pixelIndices[i]) << (i * 3);
+
+	for (auto i = 0; i < 6; ++i)
+		out[2 + i] = uint8_t(indices >> (i * 8));
+}
+
+/*
+ * BC7 mode 6: a single subset with 7-bit RGBA endpoints plus one p-bit each,
+ * and a 4-bit index per pixel shared by color and alpha.
+ */
+struct Mode6Endpoints {
+	int values[2][4]; // 8-bit, p-bit included
+};
+
+static Mode6Endpoints quantizeMode6(const float e0[4], const float e1[4])
+{
+	Mode6Endpoints endpoints;
+	const float *source[2] = { e0, e1 };
+	for (auto e = 0; e < 2; ++e) {
+		auto bestError = INFINITY;
+		for (auto p = 0; p < 2; ++p) {
+			auto error = 0.0f;
+			int values[4];
+			for (auto ch = 0; ch < 4; ++ch) {
+				auto q = min(max(int((source[e][ch] - p) * 0.5f + 0.5f), 0), 127);
+				values[ch] = (q << 1) | p;
+				error += (values[ch] - source[e][ch]) * (values[ch] - source[e][ch]);
+			}
+
+			if (error < bestError) {
+				bestError = error;
+				memcpy(endpoints.values[e], values, sizeof(values));
+			}
+		}
+	}
+	return endpoints;
+}
+
+static int findMode6Indices(const uint8_t block[64], const Mode6Endpoints &endpoints, int indices[16])
+{
+	int palette[16][4];
+	for (auto j = 0; j < 16; ++j) {
+		for (auto ch = 0; ch < 4; ++ch)
+			palette[j][ch] = ((64 - indexWeights4[j]) * endpoints.values[0][ch] + indexWeights4[j] * endpoints.values[1][ch] + 32) >> 6;
+	}
+
+	return findClosestEntries(block, palette, 16, 15, indices);
+}
+
+static void encodeBlockBC7(const uint8_t block[64], uint8_t out[16])
+{
+	float pixels[16][4];
+	for (auto i = 0; i < 16; ++i) {
+		for (auto ch = 0; ch < 4; ++ch)
+			pixels[i][ch] = block[i * 4 + ch];
+	}
+
+	float e0[4], e1[4];
+	fitLine(pixels, 4, e0, e1);
+
+	auto endpoints = quantizeMode6(e0, e1);
+	int indices[16];
+	auto error = findMode6Indices(block, endpoints, indices);
+
+	float weights[16];
+	for (auto i = 0; i < 16; ++i)
+		weights[i] = indexWeights4[indices[i]] / 64.0f;
+
+	if (error > 0 && refitEndpoints(pixels, 4, weights, e0, e1)) {
+		auto refit = quantizeMode6(e0, e1);
+		int refitIndices[16];
+		if (findMode6Indices(block, refit, refitIndices) < error) {
+			endpoints = refit;
+			memcpy(indices, refitIndices, sizeof(indices));
+		}
+	}
+
+	// the first index is stored without its top bit, which must be zero
+	if (indices[0] & 8) {
+		std::swap(endpoints.values[0], endpoints.values[1]);
+		for (auto i = 0; i < 16; ++i)
+			indices[i] = 15 - indices[i];
+	}
+
+	BlockWriter writer(out);
+	writer.write(1 << 6, 7);
+	for (auto ch = 0; ch < 4; ++ch) {
+		writer.write(endpoints.values[0][ch] >> 1, 7);
+		writer.write(endpoints.values[1][ch] >> 1, 7);
+	}
+	writer.write(endpoints.values[0][0] & 1, 1);
+	writer.write(endpoints.values[1][0] & 1, 1);
+
+	writer.write(indices[0], 3);
+	for (auto i = 1; i < 16; ++i)
+		writer.write(indices[i], 4);
+	assert(writer.getPosition() == 128);
+}
+
+/*
+ * BC6H mode 11: a single region with 10-bit unsigned endpoints, no deltas,
+ * and 4-bit indices. Everything happens on the half-float bit patterns, which
+ * is also the space the hardware interpolates in.
+ */
+static int unquantizeBC6H(int value)
+{
+	if (value == 0)
+		return 0;
+	if (value == 1023)
+		return 0xffff;
+	return ((value << 16) + 0x8000) >> 10;
+}
+
+// unquantized value to half bits
+static int finishBC6H(int value)
+{
+	return (value * 31) >> 6;
+}
+
+static int quantizeBC6H(float half)
+{
+	auto guess = int(half / 31.0f);
+	auto best = 0;
+	auto bestError = INFINITY;
+	for (auto value = max(guess - 1, 0); value <= min(guess + 1, 1023); ++value) {
+		auto error = fabsf(finishBC6H(unquantizeBC6H(value)) - half);
+		if (error < bestError) {
+			best = value;
+			bestError = error;
+		}
+	}
+	return best;
+}
+
+static float findBC6HIndices(const float pixels[16][4], const int endpoints[2][3], int indices[16])
+{
+	int palette[16][3];
+	for (auto j = 0; j < 16; ++j) {
+		for (auto ch = 0; ch < 3; ++ch) {
+			auto a = unquantizeBC6H(endpoints[0][ch]), b = unquantizeBC6H(endpoints[1][ch]);
+			palette[j][ch] = finishBC6H(((64 - indexWeights4[j]) * a + indexWeights4[j] * b + 32) >> 6);
+		}
+	}
+
+	auto totalError = 0.0f;
+	for (auto i = 0; i < 16; ++i) {
+		auto best = 0;
+		auto bestError = INFINITY;
+		for (auto j = 0; j < 16; ++j) {
+			auto error = 0.0f;
+			for (auto ch = 0; ch < 3; ++ch)
+				error += (pixels[i][ch] - palette[j][ch]) * (pixels[i][ch] - palette[j][ch]);
+			if (error < bestError) {
+				best = j;
+				bestError = error;
+			}
+		}
+		indices[i] = best;
+		totalError += bestError;
+	}
+	return totalError;
+}
+
+static void quantizeBC6HEndpoints(const float e0[4], const float e1[4], int endpoints[2][3])
+{
+	for (auto ch = 0; ch < 3; ++ch) {
+		endpoints[0][ch] = quantizeBC6H(min(max(e0[ch], 0.0f), float(maxHalf)));
+		endpoints[1][ch] = quantizeBC6H(min(max(e1[ch], 0.0f), float(maxHalf)));
+	}
+}
+
+static void encodeBlockBC6H(const uint16_t block[64], uint8_t out[16])
+{
+	float pixels[16][4];
+	for (auto i = 0; i < 16; ++i) {
+		for (auto ch = 0; ch < 3; ++ch) {
+			auto half = block[i * 4 + ch];
+			// negatives become zero; infinities and NaNs the largest value
+			if (half & 0x8000)
+				half = 0;
+			pixels[i][ch] = float(min<int>(half, maxHalf));
+		}
+		pixels[i][3] = 0.0f;
+	}
+
+	float e0[4], e1[4];
+	fitLine(pixels, 3, e0, e1);
+
+	int endpoints[2][3];
+	quantizeBC6HEndpoints(e0, e1, endpoints);
+
+	int indices[16];
+	auto error = findBC6HIndices(pixels, endpoints, indices);
+
+	float weights[16];
+	for (auto i = 0; i < 16; ++i)
+		weights[i] = indexWeights4[indices[i]] / 64.0f;
+
+	if (error > 0.0f && refitEndpoints(pixels, 3, weights, e0, e1)) {
+		int refit[2][3], refitIndices[16];
+		quantizeBC6HEndpoints(e0, e1, refit);
+		if (findBC6HIndices(pixels, refit, refitIndices) < error) {
+			memcpy(endpoints, refit, sizeof(endpoints));
+			memcpy(indices, refitIndices, sizeof(indices));
+		}
+	}
+
+	if (indices[0] & 8) {
+		std::swap(endpoints[0], endpoints[1]);
+		for (auto i = 0; i < 16; ++i)
+			indices[i] = 15 - indices[i];
+	}
+
+	BlockWriter writer(out);
+	writer.write(0x03, 5);
+	for (auto e = 0; e < 2; ++e) {
+		for (auto ch = 0; ch < 3; ++ch)
+			writer.write(endpoints[e][ch], 10);
+	}
+
+	writer.write(indices[0], 3);
+	for (auto i = 1; i < 16; ++i)
+		writer.write(indices[i], 4);
+	assert(writer.getPosition() == 128);
+}
+
+static void compressBlock(BlockCompression compression, const uint8_t *block, uint8_t *out)
+{
+	switch (compression) {
+	case BlockCompression::BC1:
+		encodeColorBlock(block, out);
+		break;
+
+	case BlockCompression::BC3:
+		encodeChannelBlock(block, 3, out);
+		encodeColorBlock(block, out + 8);
+		break;
+
+	case BlockCompression::BC5:
+		encodeChannelBlock(block, 0, out);
+		encodeChannelBlock(block, 1, out + 8);
+		break;
+
+	case BlockCompression::BC6H:
+		encodeBlockBC6H(reinterpret_cast<const uint16_t *>(block), out);
+		break;
+
+	case BlockCompression::BC7:
+		encodeBlockBC7(block, out);
+		break;
+	}
+}
+
+void compressLevel(BlockCompression compression, const uint8_t *src, int width, int height, uint8_t *dst)
+{
+	auto pixelSize = compression == BlockCompression::BC6H ? size_t(8) : size_t(4);
+	auto blockSize = getBlockSize(compression);
+	auto blocksX = (width + 3) / 4;
+	auto blocksY = (height + 3) / 4;
+
+	ThreadPool::getDefault().parallelFor(size_t(blocksY), 1, [&](size_t begin, size_t end) {
+		uint16_t block[64]; // 16 pixels of up to 8 bytes, aligned for the half-float path
+		auto blockBytes = reinterpret_cast<uint8_t *>(block);
+
+		for (auto blockY = int(begin); blockY < int(end); ++blockY) {
+			auto out = dst + size_t(blockY) * blocksX * blockSize;
+			for (auto blockX = 0; blockX < blocksX; ++blockX, out += blockSize) {
+				loadBlock(src, width, height, pixelSize, blockX, blockY, blockBytes);
+				compressBlock(compression, blockBytes, out);
+			}
+		}
+	});
+}
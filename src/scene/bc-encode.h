@@ -0,0 +1,33 @@
+#ifndef BC_ENCODE_H
+#define BC_ENCODE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+enum class BlockCompression {
+	BC1,  // RGB at 4 bits per pixel, alpha is dropped
+	BC3,  // RGBA, BC1 color plus a separate alpha block
+	BC5,  // red and green only, for normal maps
+	BC6H, // unsigned half-float RGB, for HDR images
+	BC7   // RGBA, best quality of the 8 bits per pixel ones
+};
+
+// bytes per 4x4 block
+size_t getBlockSize(BlockCompression compression);
+
+/*
+ * The layoutMipChain() equivalent for compressed levels: offsets gets
+ * mipLevels + 1 entries, each level starting 16-byte aligned; the last entry
+ * is the total size.
+ */
+size_t layoutCompressedMipChain(BlockCompression compression, int width, int height, int mipLevels, std::vector<size_t> *offsets);
+
+/*
+ * Compresses one level of tightly packed RGBA8 pixels, or RGBA16F ones for
+ * BC6H. Blocks sticking out over the right or bottom edge repeat the edge
+ * pixels. Block rows are spread over the default thread pool.
+ */
+void compressLevel(BlockCompression compression, const uint8_t *src, int width, int height, uint8_t *dst);
+
+#endif // BC_ENCODE_H
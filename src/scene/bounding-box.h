@@ -0,0 +1,77 @@
+#ifndef BOUNDING_BOX_H
+#define BOUNDING_BOX_H
+
+#include <glm/glm.hpp>
+
+#include <math.h>
+
+// axis-aligned; default constructed boxes are empty and grow from there
+struct BoundingBox {
+	glm::vec3 min, max;
+
+	BoundingBox() :
+		min(INFINITY),
+		max(-INFINITY)
+	{
+	}
+
+	BoundingBox(const glm::vec3 &min, const glm::vec3 &max) :
+		min(min),
+		max(max)
+	{
+	}
+
+	bool isEmpty() const { return min.x > max.x || min.y > max.y || min.z > max.z; }
+
+	glm::vec3 getCenter() const { return (min + max) * 0.5f; }
+	glm::vec3 getExtents() const { return (max - min) * 0.5f; }
+
+	// half the actual area, which is all the surface area heuristic needs
+	float getSurfaceArea() const
+	{
+		auto size = max - min;
+		return size.x * size.y + size.y * size.z + size.z * size.x;
+	}
+
+	void grow(const glm::vec3 &point)
+	{
+		min = glm::min(min, point);
+		max = glm::max(max, point);
+	}
+
+	void grow(const BoundingBox &box)
+	{
+		min = glm::min(min, box.min);
+		max = glm::max(max, box.max);
+	}
+
+	bool contains(const BoundingBox &box) const
+	{
+		return box.min.x >= min.x && box.min.y >= min.y && box.min.z >= min.z &&
+		       box.max.x <= max.x && box.max.y <= max.y && box.max.z <= max.z;
+	}
+
+	// the box around this one after an affine transform (Arvo)
+	BoundingBox transformed(const glm::mat4 &matrix) const
+	{
+		if (isEmpty())
+			return *this;
+
+		auto center = getCenter(), extents = getExtents();
+		auto newCenter = glm::vec3(matrix[3]);
+		auto newExtents = glm::vec3(0.0f);
+		for (int i = 0; i < 3; ++i) {
+			auto column = glm::vec3(matrix[i]);
+			newCenter += column * center[i];
+			newExtents += glm::abs(column) * extents[i];
+		}
+		return BoundingBox(newCenter - newExtents, newCenter + newExtents);
+	}
+
+	static BoundingBox merge(const BoundingBox &a, const BoundingBox &b)
+	{
+		return BoundingBox(glm::min(a.min, b.min), glm::max(a.max, b.max));
+	}
+};
+
+#endif // BOUNDING_BOX_H
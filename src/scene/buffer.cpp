@@ -1,4 +1,7 @@
 #include "buffer.h"
+#include "uploadbatch.h"
+
+#include <algorithm>
 
 using namespace vulkan;
 
@@ -15,47 +18,36 @@ Buffer::Buffer(VkDeviceSize size, VkBufferUsageFlags usageFlags, VkMemoryPropert
 	VkMemoryRequirements memoryRequirements;
 	vkGetBufferMemoryRequirements(device, buffer, &memoryRequirements);
 
-	auto memoryTypeIndex = getMemoryTypeIndex(memoryRequirements, memoryPropertyFlags);
-	deviceMemory = allocateDeviceMemory(memoryRequirements.size, memoryTypeIndex);
+	memory = allocateDeviceMemory(memoryRequirements, memoryPropertyFlags, true);
 
-	err = vkBindBufferMemory(device, buffer, deviceMemory, 0);
+	err = vkBindBufferMemory(device, buffer, memory.deviceMemory, memory.offset);
 	assert(err == VK_SUCCESS);
 }
 
 Buffer::~Buffer()
 {
 	vkDestroyBuffer(device, buffer, nullptr);
-	vkFreeMemory(device, deviceMemory, nullptr);
+	freeDeviceMemory(memory);
 }
 
-void Buffer::uploadFromStagingBuffer(StagingBuffer *stagingBuffer, VkDeviceSize srcOffset, VkDeviceSize dstOffset, VkDeviceSize size)
+void Buffer::uploadFromStagingBuffer(UploadBatch &uploadBatch, const StagingSlice &stagingSlice, VkDeviceSize dstOffset, VkDeviceSize size)
 {
-	assert(stagingBuffer != nullptr);
-
-	auto commandBuffer = allocateCommandBuffers(setupCommandPool, 1)[0];
-
-	VkCommandBufferBeginInfo commandBufferBeginInfo = {};
-	commandBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-	commandBufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-
-	VkResult err = vkBeginCommandBuffer(commandBuffer, &commandBufferBeginInfo);
-	assert(err == VK_SUCCESS);
-
 	VkBufferCopy bufferCopy = {};
-	bufferCopy.srcOffset = srcOffset;
+	bufferCopy.srcOffset = stagingSlice.offset;
 	bufferCopy.dstOffset = dstOffset;
 	bufferCopy.size = size;
-	vkCmdCopyBuffer(commandBuffer, stagingBuffer->getBuffer(), buffer, 1, &bufferCopy);
-
-	err = vkEndCommandBuffer(commandBuffer);
-	assert(err == VK_SUCCESS);
-
-	VkSubmitInfo submitInfo = {};
-	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	submitInfo.commandBufferCount = 1;
-	submitInfo.pCommandBuffers = &commandBuffer;
+	vkCmdCopyBuffer(uploadBatch.getCommandBuffer(), stagingSlice.buffer, buffer, 1, &bufferCopy);
+}
 
-	// Submit draw command buffer
-	err = vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
-	assert(err == VK_SUCCESS);
-}
\ No newline at end of file
+void Buffer::upload(UploadBatch &uploadBatch, VkDeviceSize dstOffset, const void *data, VkDeviceSize size)
+{
+	auto bytes = static_cast<const uint8_t *>(data);
+	auto maxChunkSize = UploadBatch::getMaxStagingSize();
+
+	for (VkDeviceSize offset = 0; offset < size; offset += maxChunkSize) {
+		auto chunkSize = std::min(size - offset, maxChunkSize);
+		auto stagingSlice = uploadBatch.allocateStaging(chunkSize);
+		memcpy(stagingSlice.data, bytes + offset, size_t(chunkSize));
+		uploadFromStagingBuffer(uploadBatch, stagingSlice, dstOffset + offset, chunkSize);
+	}
+}
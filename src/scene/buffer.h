@@ -6,23 +6,31 @@
 #include <cstring>
 
 class StagingBuffer;
+class UploadBatch;
+
+// a mapped piece of some staging buffer, see UploadBatch::allocateStaging()
+struct StagingSlice {
+	VkBuffer buffer;
+	VkDeviceSize offset;
+	void *data;
+};
 
 class Buffer {
 public:
 	Buffer(VkDeviceSize size, VkBufferUsageFlags usageFlags, VkMemoryPropertyFlags memoryPropertyFlags);
 	~Buffer();
 
+	// host visible memory stays mapped, so this is just pointer arithmetic
 	void *map(VkDeviceSize offset, VkDeviceSize size)
 	{
-		void *ret;
-		VkResult err = vkMapMemory(vulkan::device, deviceMemory, offset, size, 0, &ret);
-		assert(err == VK_SUCCESS);
-		return ret;
+		assert(memory.mappedData != nullptr);
+		assert(size == VK_WHOLE_SIZE || offset + size <= memory.size);
+		return static_cast<uint8_t *>(memory.mappedData) + offset;
 	}
 
 	void unmap()
 	{
-		vkUnmapMemory(vulkan::device, deviceMemory);
+		vulkan::flushDeviceMemory(memory);
 	}
 
 	void uploadMemory(VkDeviceSize offset, void *data, VkDeviceSize size)
@@ -37,7 +45,7 @@ public:
 		return buffer;
 	}
 
-	VkDescriptorBufferInfo getDescriptorBufferInfo(VkDeviceSize offset = 0, VkDeviceSize range = VK_WHOLE_SIZE)
+	VkDescriptorBufferInfo getDescriptorBufferInfo(VkDeviceSize offset = 0, VkDeviceSize range = VK_WHOLE_SIZE) const
 	{
 		VkDescriptorBufferInfo descriptorBufferInfo;
 		descriptorBufferInfo.buffer = buffer;
@@ -46,11 +54,14 @@ public:
 		return descriptorBufferInfo;
 	}
 
-	void uploadFromStagingBuffer(StagingBuffer *stagingBuffer, VkDeviceSize srcOffset, VkDeviceSize dstOffset, VkDeviceSize size);
+	void uploadFromStagingBuffer(UploadBatch &uploadBatch, const StagingSlice &stagingSlice, VkDeviceSize dstOffset, VkDeviceSize size);
+
+	// stages data through the batch, in as many pieces as the staging ring needs
+	void upload(UploadBatch &uploadBatch, VkDeviceSize dstOffset, const void *data, VkDeviceSize size);
 
 private:
 	VkBuffer buffer;
-	VkDeviceMemory deviceMemory;
+	vulkan::DeviceMemoryAllocation memory;
 };
 
 class StagingBuffer : public Buffer {
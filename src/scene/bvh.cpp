@@ -0,0 +1,289 @@
+#include "bvh.h"
+
+#include <assert.h>
+#include <algorithm>
+
+using std::vector;
+
+const BoundingVolumeHierarchy::NodeHandle BoundingVolumeHierarchy::invalidNode;
+
+// room to move before a leaf counts as misplaced, relative to its size
+static BoundingBox loosen(const BoundingBox &bounds)
+{
+	auto margin = (bounds.max - bounds.min) * 0.25f + glm::vec3(1e-3f);
+	return BoundingBox(bounds.min - margin, bounds.max + margin);
+}
+
+BoundingVolumeHierarchy::NodeHandle BoundingVolumeHierarchy::allocateNode()
+{
+	NodeHandle node;
+	if (freeList != invalidNode) {
+		node = freeList;
+		freeList = nodes[node].parent;
+	} else {
+		node = NodeHandle(nodes.size());
+		nodes.push_back(Node());
+		dirtyFlags.push_back(0);
+	}
+
+	auto &n = nodes[node];
+	n.bounds = BoundingBox();
+	n.parent = invalidNode;
+	n.children[0] = n.children[1] = invalidNode;
+	n.item = UINT32_MAX;
+	n.pendingReinsert = false;
+	dirtyFlags[node] = 0;
+	return node;
+}
+
+void BoundingVolumeHierarchy::freeNode(NodeHandle node)
+{
+	nodes[node].parent = freeList;
+	nodes[node].children[0] = nodes[node].children[1] = invalidNode;
+	freeList = node;
+}
+
+BoundingVolumeHierarchy::NodeHandle BoundingVolumeHierarchy::insert(uint32_t item, const BoundingBox &bounds)
+{
+	auto leaf = allocateNode();
+	nodes[leaf].item = item;
+	nodes[leaf].bounds = bounds;
+	insertLeaf(leaf);
+	leafCount++;
+	return leaf;
+}
+
+void BoundingVolumeHierarchy::remove(NodeHandle leaf)
+{
+	assert(nodes[leaf].isLeaf());
+	removeLeaf(leaf);
+
+	// a queued reinsert would resurrect it
+	if (nodes[leaf].pendingReinsert)
+		reinsertQueue.erase(std::find(reinsertQueue.begin(), reinsertQueue.end(), leaf));
+
+	freeNode(leaf);
+	leafCount--;
+}
+
+void BoundingVolumeHierarchy::update(NodeHandle leaf, const BoundingBox &bounds)
+{
+	auto &node = nodes[leaf];
+	assert(node.isLeaf());
+	if (node.bounds.min == bounds.min && node.bounds.max == bounds.max)
+		return;
+
+	node.bounds = bounds;
+
+	// the parents only need to be marked, refit() does them in order
+	for (auto parent = node.parent; parent != invalidNode && !dirtyFlags[parent]; parent = nodes[parent].parent)
+		dirtyFlags[parent] = 1;
+	anyDirty = true;
+
+	if (!node.pendingReinsert && !node.looseBounds.contains(bounds)) {
+		node.pendingReinsert = true;
+		reinsertQueue.push_back(leaf);
+	}
+}
+
+/*
+ * Descends towards the sibling that makes the new parent cheapest, by the
+ * surface area heuristic: every node the leaf passes grows, and that
+ * growth is paid no matter which child it ends up under.
+ */
+void BoundingVolumeHierarchy::insertLeaf(NodeHandle leaf)
+{
+	nodes[leaf].looseBounds = loosen(nodes[leaf].bounds);
+	if (root == invalidNode) {
+		root = leaf;
+		nodes[leaf].parent = invalidNode;
+		return;
+	}
+
+	auto bounds = nodes[leaf].bounds;
+	auto sibling = root;
+	while (!nodes[sibling].isLeaf()) {
+		auto &node = nodes[sibling];
+		auto area = node.bounds.getSurfaceArea();
+		auto combinedArea = BoundingBox::merge(node.bounds, bounds).getSurfaceArea();
+
+		// making this node the sibling costs a new parent of the combined size
+		auto cost = 2.0f * combinedArea;
+		auto inheritedCost = 2.0f * (combinedArea - area);
+
+		float childCosts[2];
+		for (int i = 0; i < 2; ++i) {
+			auto &child = nodes[node.children[i]];
+			auto childArea = BoundingBox::merge(child.bounds, bounds).getSurfaceArea();
+			childCosts[i] = (child.isLeaf() ? childArea : childArea - child.bounds.getSurfaceArea()) + inheritedCost;
+		}
+
+		if (cost < childCosts[0] && cost < childCosts[1])
+			break;
+
+		sibling = childCosts[0] < childCosts[1] ? node.children[0] : node.children[1];
+	}
+
+	auto oldParent = nodes[sibling].parent;
+	auto newParent = allocateNode();
+	nodes[newParent].parent = oldParent;
+	nodes[newParent].bounds = BoundingBox::merge(bounds, nodes[sibling].bounds);
+	nodes[newParent].children[0] = sibling;
+	nodes[newParent].children[1] = leaf;
+	nodes[sibling].parent = newParent;
+	nodes[leaf].parent = newParent;
+
+	// dirty nodes only ever have dirty parents, which oldParent already is
+	dirtyFlags[newParent] = dirtyFlags[sibling];
+
+	if (oldParent == invalidNode) {
+		root = newParent;
+	} else {
+		auto &parent = nodes[oldParent];
+		parent.children[parent.children[0] == sibling ? 0 : 1] = newParent;
+		refitAncestors(oldParent);
+	}
+}
+
+// the leaf's sibling takes the place of their parent
+void BoundingVolumeHierarchy::removeLeaf(NodeHandle leaf)
+{
+	if (leaf == root) {
+		root = invalidNode;
+		return;
+	}
+
+	auto parent = nodes[leaf].parent;
+	auto grandParent = nodes[parent].parent;
+	auto sibling = nodes[parent].children[nodes[parent].children[0] == leaf ? 1 : 0];
+
+	if (grandParent == invalidNode) {
+		root = sibling;
+		nodes[sibling].parent = invalidNode;
+	} else {
+		auto &node = nodes[grandParent];
+		node.children[node.children[0] == parent ? 0 : 1] = sibling;
+		nodes[sibling].parent = grandParent;
+		refitAncestors(grandParent);
+	}
+
+	freeNode(parent);
+	nodes[leaf].parent = invalidNode;
+}
+
+void BoundingVolumeHierarchy::refitAncestors(NodeHandle node)
+{
+	for (; node != invalidNode; node = nodes[node].parent) {
+		auto &n = nodes[node];
+		n.bounds = BoundingBox::merge(nodes[n.children[0]].bounds, nodes[n.children[1]].bounds);
+	}
+}
+
+// dirty nodes only have dirty parents, so the clean subtrees are skipped whole
+void BoundingVolumeHierarchy::refitDirty(NodeHandle node)
+{
+	auto &n = nodes[node];
+	if (!dirtyFlags[node] || n.isLeaf())
+		return;
+
+	refitDirty(n.children[0]);
+	refitDirty(n.children[1]);
+	n.bounds = BoundingBox::merge(nodes[n.children[0]].bounds, nodes[n.children[1]].bounds);
+	dirtyFlags[node] = 0;
+}
+
+void BoundingVolumeHierarchy::refit(size_t maxReinserts)
+{
+	if (root == invalidNode)
+		return;
+
+	if (anyDirty) {
+		refitDirty(root);
+		anyDirty = false;
+	}
+
+	// with the boxes up to date, insertion costs are right too; removing and inserting refit their own paths
+	auto reinsertCount = std::min(maxReinserts, reinsertQueue.size());
+	for (size_t i = 0; i < reinsertCount; ++i) {
+		auto leaf = reinsertQueue[i];
+		nodes[leaf].pendingReinsert = false;
+		removeLeaf(leaf);
+		insertLeaf(leaf);
+	}
+
+	// oldest first; whatever didn't fit the budget waits for the next call
+	reinsertQueue.erase(reinsertQueue.begin(), reinsertQueue.begin() + reinsertCount);
+}
+
+void BoundingVolumeHierarchy::collectLeaves(NodeHandle node, vector<uint32_t> &items, vector<NodeHandle> &stack) const
+{
+	auto base = stack.size();
+	stack.push_back(node);
+	while (stack.size() > base) {
+		auto &n = nodes[stack.back()];
+		stack.pop_back();
+		if (n.isLeaf()) {
+			items.push_back(n.item);
+		} else {
+			stack.push_back(n.children[0]);
+			stack.push_back(n.children[1]);
+		}
+	}
+}
+
+void BoundingVolumeHierarchy::findVisible(const Frustum &frustum, vector<uint32_t> &items) const
+{
+	if (root == invalidNode)
+		return;
+
+	struct Entry {
+		NodeHandle node;
+		uint32_t planeMask;
+	};
+
+	vector<Entry> stack;
+	vector<NodeHandle> leafStack;
+	stack.reserve(64);
+
+	Entry rootEntry = { root, Frustum::allPlanes };
+	stack.push_back(rootEntry);
+	while (!stack.empty()) {
+		auto entry = stack.back();
+		stack.pop_back();
+
+		auto &node = nodes[entry.node];
+		auto containment = frustum.testBox(node.bounds, entry.planeMask);
+		if (containment == Containment::OUTSIDE)
+			continue;
+
+		// everything below is visible, no more tests needed
+		if (containment == Containment::INSIDE || node.isLeaf()) {
+			collectLeaves(entry.node, items, leafStack);
+			continue;
+		}
+
+		for (int i = 0; i < 2; ++i) {
+			Entry child = { node.children[i], entry.planeMask };
+			stack.push_back(child);
+		}
+	}
+}
+
+float BoundingVolumeHierarchy::getCost() const
+{
+	float cost = 0.0f;
+	if (root == invalidNode)
+		return cost;
+
+	vector<NodeHandle> stack(1, root);
+	while (!stack.empty()) {
+		auto &node = nodes[stack.back()];
+		stack.pop_back();
+		if (!node.isLeaf()) {
+			cost += node.bounds.getSurfaceArea();
+			stack.push_back(node.children[0]);
+			stack.push_back(node.children[1]);
+		}
+	}
+	return cost;
+}
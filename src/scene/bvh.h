@@ -0,0 +1,90 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include "bounding-box.h"
+#include "frustum.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+/*
+ * A dynamic bounding volume hierarchy: a binary tree of boxes over items
+ * that move around. Leaves are inserted where they add the least surface
+ * area, and the tree is kept up to date in two ways:
+ *
+ * - refit() recomputes the internal boxes above leaves that changed,
+ *   bottom-up, which keeps culling exact whatever moved, but lets the tree
+ *   degrade as things drift apart.
+ * - Leaves that moved well away from where they were inserted get
+ *   reinserted by refit(), a limited number per call, which rebuilds the
+ *   tree bit by bit instead of all at once.
+ */
+class BoundingVolumeHierarchy {
+public:
+	typedef uint32_t NodeHandle;
+	static const NodeHandle invalidNode = UINT32_MAX;
+
+	BoundingVolumeHierarchy() :
+		root(invalidNode),
+		freeList(invalidNode),
+		leafCount(0),
+		anyDirty(false)
+	{
+	}
+
+	// returns the leaf, which stays valid until it's removed
+	NodeHandle insert(uint32_t item, const BoundingBox &bounds);
+	void remove(NodeHandle leaf);
+
+	// the tree is out of date until the next refit()
+	void update(NodeHandle leaf, const BoundingBox &bounds);
+
+	// reinserts at most maxReinserts leaves that moved far, then refits the rest
+	void refit(size_t maxReinserts = 256);
+
+	// appends the items of all leaves that intersect the frustum
+	void findVisible(const Frustum &frustum, std::vector<uint32_t> &items) const;
+
+	size_t getLeafCount() const { return leafCount; }
+	BoundingBox getBounds() const { return root != invalidNode ? nodes[root].bounds : BoundingBox(); }
+
+	// sum of internal node areas; lower is better, for comparing tree quality
+	float getCost() const;
+
+private:
+	struct Node {
+		BoundingBox bounds;
+		NodeHandle parent;
+		NodeHandle children[2]; // invalidNode for leaves
+		uint32_t item;
+
+		// leaves only: the slack box they may move in before they get reinserted
+		BoundingBox looseBounds;
+		bool pendingReinsert;
+
+		bool isLeaf() const { return children[0] == invalidNode; }
+	};
+
+	NodeHandle allocateNode();
+	void freeNode(NodeHandle node);
+
+	void insertLeaf(NodeHandle leaf);
+	void removeLeaf(NodeHandle leaf);
+	void refitAncestors(NodeHandle node);
+	void refitDirty(NodeHandle node);
+	void collectLeaves(NodeHandle node, std::vector<uint32_t> &items, std::vector<NodeHandle> &stack) const;
+
+	std::vector<Node> nodes;
+	NodeHandle root;
+	NodeHandle freeList; // threaded through Node::parent
+	size_t leafCount;
+
+	std::vector<NodeHandle> reinsertQueue;
+
+	// nodes whose box needs recomputing; apart from the nodes so refit() touches less memory
+	std::vector<uint8_t> dirtyFlags;
+	bool anyDirty;
+};
+
+#endif // BVH_H
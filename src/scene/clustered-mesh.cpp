@@ -0,0 +1,250 @@
+#include "clustered-mesh.h"
+#include "frustum.h"
+#include "uploadbatch.h"
+
+#include <string.h>
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
+using namespace vulkan;
+
+using std::vector;
+
+ClusteredMesh::ClusteredMesh(const VertexLayout &vertexLayout, vector<uint8_t> vertexData, const vector<uint32_t> &indices) :
+	meshletCount(0),
+	meshletBuffer(nullptr),
+	meshletVertexBuffer(nullptr),
+	meshletTriangleBuffer(nullptr)
+{
+	auto position = vertexLayout.findAttribute(VERTEX_POSITION);
+	if (position == nullptr || position->format != VK_FORMAT_R32G32B32_SFLOAT)
+		throw std::runtime_error("ClusteredMesh needs float positions!");
+
+	MeshOptimizeOptions optimizeOptions = { true, false, 1.05f, true };
+	Mesh optimized(vertexLayout, std::move(vertexData), indices);
+	optimizeReport = optimized.optimize(optimizeOptions);
+
+	auto stride = vertexLayout.getStride();
+	auto optimizedVertices = optimized.getVertexData();
+	auto optimizedIndices = optimized.getIndices();
+	meshletData = buildMeshlets(optimizedIndices.data(), optimizedIndices.size(),
+		optimizedVertices.data() + position->offset, stride, optimized.getVertexCount());
+	meshletCount = uint32_t(meshletData.meshlets.size());
+
+	// the same triangles in meshlet order, for drawing without culling
+	vector<uint32_t> meshletIndices;
+	meshletIndices.reserve(optimizedIndices.size());
+	for (auto &meshlet : meshletData.meshlets) {
+		for (uint32_t i = 0; i < meshlet.triangleCount; ++i) {
+			auto triangle = meshletData.triangles[meshlet.triangleOffset + i];
+			for (int j = 0; j < 3; ++j)
+				meshletIndices.push_back(meshletData.vertices[meshlet.vertexOffset + ((triangle >> (j * 8)) & 0xff)]);
+		}
+	}
+
+	vector<uint8_t> meshletVertexData(optimizedVertices.begin(), optimizedVertices.end());
+	mesh = Mesh(vertexLayout, std::move(meshletVertexData), std::move(meshletIndices));
+}
+
+ClusteredMesh::~ClusteredMesh()
+{
+	delete meshletBuffer;
+	delete meshletVertexBuffer;
+	delete meshletTriangleBuffer;
+}
+
+void ClusteredMesh::upload(UploadBatch &uploadBatch)
+{
+	assert(!isUploaded());
+	assert(meshletCount > 0);
+
+	mesh.upload(uploadBatch);
+
+	auto meshletBytes = VkDeviceSize(meshletCount * sizeof(GpuMeshlet));
+	auto vertexBytes = VkDeviceSize(meshletData.vertices.size() * sizeof(uint32_t));
+	auto triangleBytes = VkDeviceSize(meshletData.triangles.size() * sizeof(uint32_t));
+
+	auto usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+	meshletBuffer = new Buffer(meshletBytes, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	meshletVertexBuffer = new Buffer(vertexBytes, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	meshletTriangleBuffer = new Buffer(triangleBytes, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+	vector<GpuMeshlet> gpuMeshlets(meshletCount);
+	for (uint32_t i = 0; i < meshletCount; ++i) {
+		gpuMeshlets[i].bounds = meshletData.bounds[i];
+		gpuMeshlets[i].meshlet = meshletData.meshlets[i];
+	}
+
+	auto upload = [&](Buffer *buffer, const void *data, VkDeviceSize size) {
+		buffer->upload(uploadBatch, 0, data, size);
+		uploadBatch.finishBuffer(buffer->getBuffer(), VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+	};
+	upload(meshletBuffer, gpuMeshlets.data(), meshletBytes);
+	upload(meshletVertexBuffer, meshletData.vertices.data(), vertexBytes);
+	upload(meshletTriangleBuffer, meshletData.triangles.data(), triangleBytes);
+
+	meshletData = MeshletData();
+}
+
+ClusterCullConstants::ClusterCullConstants(const glm::mat4 &modelViewProjection, const glm::vec3 &objectSpaceCamera) :
+	cameraPosition(objectSpaceCamera),
+	padding(0)
+{
+	Frustum frustum(modelViewProjection);
+	for (int i = 0; i < Frustum::PLANE_COUNT; ++i)
+		frustumPlanes[i] = frustum.planes[i];
+}
+
+ClusterCullTarget::ClusterCullTarget(const ClusteredMesh &clusteredMesh)
+{
+	auto indexBytes = VkDeviceSize(clusteredMesh.getMesh().getIndexCount() * sizeof(uint32_t));
+	indexBuffer = new Buffer(indexBytes, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	drawCommandBuffer = new Buffer(sizeof(VkDrawIndexedIndirectCommand),
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+}
+
+ClusterCullTarget::~ClusterCullTarget()
+{
+	delete indexBuffer;
+	delete drawCommandBuffer;
+}
+
+void ClusterCullTarget::beginCull(VkCommandBuffer commandBuffer)
+{
+	// the last frame to draw from these may still be running
+	bufferBarrier(commandBuffer, drawCommandBuffer->getBuffer(), 0, VK_WHOLE_SIZE,
+		VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+		VK_ACCESS_INDIRECT_COMMAND_READ_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+	bufferBarrier(commandBuffer, indexBuffer->getBuffer(), 0, VK_WHOLE_SIZE,
+		VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		VK_ACCESS_INDEX_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT);
+
+	// the cull pass counts indexCount up from zero
+	VkDrawIndexedIndirectCommand drawCommand = { 0, 1, 0, 0, 0 };
+	vkCmdUpdateBuffer(commandBuffer, drawCommandBuffer->getBuffer(), 0, sizeof(drawCommand), &drawCommand);
+
+	bufferBarrier(commandBuffer, drawCommandBuffer->getBuffer(), 0, VK_WHOLE_SIZE,
+		VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+}
+
+void ClusterCullTarget::endCull(VkCommandBuffer commandBuffer)
+{
+	bufferBarrier(commandBuffer, drawCommandBuffer->getBuffer(), 0, VK_WHOLE_SIZE,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+		VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT);
+	bufferBarrier(commandBuffer, indexBuffer->getBuffer(), 0, VK_WHOLE_SIZE,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+		VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_INDEX_READ_BIT);
+}
+
+ClusterCullBatchTarget::ClusterCullBatchTarget(const ClusteredMesh &clusteredMesh, uint32_t instanceCount, VkDeviceSize indexBudget) :
+	instanceCount(instanceCount),
+	indicesPerInstance(clusteredMesh.getMesh().getIndexCount())
+{
+	assert(instanceCount > 0);
+
+	// one storage buffer binding, whose size also keeps the index math of the shaders within 32 bits
+	auto maxIndexBytes = std::min(indexBudget, VkDeviceSize(deviceProperties.limits.maxStorageBufferRange));
+	if (VkDeviceSize(indicesPerInstance) * sizeof(uint32_t) > maxIndexBytes)
+		throw std::runtime_error("cluster cull index budget is too small for one instance!");
+
+	auto indexBytes = std::min(VkDeviceSize(instanceCount) * indicesPerInstance * sizeof(uint32_t), maxIndexBytes);
+	indexCapacity = uint32_t(indexBytes / sizeof(uint32_t));
+
+	indexBuffer = new Buffer(VkDeviceSize(indexCapacity) * sizeof(uint32_t),
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	indexCountBuffer = new Buffer(VkDeviceSize(instanceCount) * sizeof(uint32_t),
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	regionOffsetBuffer = new Buffer(VkDeviceSize(instanceCount) * sizeof(uint32_t),
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	indexCursorBuffer = new Buffer(sizeof(uint32_t),
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	drawCommandBuffer = new Buffer(VkDeviceSize(instanceCount) * sizeof(VkDrawIndexedIndirectCommand),
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	drawCountBuffer = new Buffer(sizeof(uint32_t),
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+}
+
+ClusterCullBatchTarget::~ClusterCullBatchTarget()
+{
+	delete indexBuffer;
+	delete indexCountBuffer;
+	delete regionOffsetBuffer;
+	delete indexCursorBuffer;
+	delete drawCommandBuffer;
+	delete drawCountBuffer;
+}
+
+void ClusterCullBatchTarget::beginCull(VkCommandBuffer commandBuffer)
+{
+	// the last pass to draw from these may still be running, and the last compaction reading the counts
+	bufferBarrier(commandBuffer, indexBuffer->getBuffer(), 0, VK_WHOLE_SIZE,
+		VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		VK_ACCESS_INDEX_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT);
+	bufferBarrier(commandBuffer, indexCountBuffer->getBuffer(), 0, VK_WHOLE_SIZE,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+		VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+	bufferBarrier(commandBuffer, drawCountBuffer->getBuffer(), 0, VK_WHOLE_SIZE,
+		VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+		VK_ACCESS_INDIRECT_COMMAND_READ_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+	bufferBarrier(commandBuffer, indexCursorBuffer->getBuffer(), 0, VK_WHOLE_SIZE,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+		VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+	bufferBarrier(commandBuffer, regionOffsetBuffer->getBuffer(), 0, VK_WHOLE_SIZE,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT);
+
+	// the cull pass counts indices, the compaction draws, and the allocation regions, up from zero
+	vkCmdFillBuffer(commandBuffer, indexCountBuffer->getBuffer(), 0, VK_WHOLE_SIZE, 0);
+	vkCmdFillBuffer(commandBuffer, drawCountBuffer->getBuffer(), 0, VK_WHOLE_SIZE, 0);
+	vkCmdFillBuffer(commandBuffer, indexCursorBuffer->getBuffer(), 0, VK_WHOLE_SIZE, 0);
+
+	bufferBarrier(commandBuffer, indexCountBuffer->getBuffer(), 0, VK_WHOLE_SIZE,
+		VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+	bufferBarrier(commandBuffer, drawCountBuffer->getBuffer(), 0, VK_WHOLE_SIZE,
+		VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+	bufferBarrier(commandBuffer, indexCursorBuffer->getBuffer(), 0, VK_WHOLE_SIZE,
+		VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+}
+
+void ClusterCullBatchTarget::endAllocate(VkCommandBuffer commandBuffer)
+{
+	bufferBarrier(commandBuffer, regionOffsetBuffer->getBuffer(), 0, VK_WHOLE_SIZE,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT);
+}
+
+void ClusterCullBatchTarget::endCull(VkCommandBuffer commandBuffer)
+{
+	bufferBarrier(commandBuffer, indexCountBuffer->getBuffer(), 0, VK_WHOLE_SIZE,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT);
+	bufferBarrier(commandBuffer, indexBuffer->getBuffer(), 0, VK_WHOLE_SIZE,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+		VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_INDEX_READ_BIT);
+
+	// the previous pass may still be drawing from the old commands
+	bufferBarrier(commandBuffer, drawCommandBuffer->getBuffer(), 0, VK_WHOLE_SIZE,
+		VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		VK_ACCESS_INDIRECT_COMMAND_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT);
+}
+
+void ClusterCullBatchTarget::endCompact(VkCommandBuffer commandBuffer)
+{
+	bufferBarrier(commandBuffer, drawCommandBuffer->getBuffer(), 0, VK_WHOLE_SIZE,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+		VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT);
+	bufferBarrier(commandBuffer, drawCountBuffer->getBuffer(), 0, VK_WHOLE_SIZE,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+		VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT);
+}
@@ -0,0 +1,186 @@
+#ifndef CLUSTERED_MESH_H
+#define CLUSTERED_MESH_H
+
+#include "mesh.h"
+#include "meshlet.h"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+/*
+ * A Mesh split into meshlets, for culling on the GPU. Besides the mesh
+ * itself, whose indices are in meshlet order and still draw everything,
+ * there are three storage buffers for the cull pass (cluster-cull.comp):
+ * the meshlets with their bounds, their vertex lists and their packed
+ * triangles.
+ *
+ * Meshlets are filled greedily in index order, so the geometry goes through
+ * Mesh::optimize() for the vertex cache and vertex fetch first.
+ */
+class ClusteredMesh {
+public:
+	// layout of the meshlet buffer; matches MeshletCullData in cluster-cull.comp
+	struct GpuMeshlet {
+		MeshletBounds bounds;
+		Meshlet meshlet;
+	};
+	static_assert(sizeof(GpuMeshlet) == 48, "GpuMeshlet must match the std430 layout");
+
+	ClusteredMesh(const VertexLayout &vertexLayout, std::vector<uint8_t> vertexData, const std::vector<uint32_t> &indices);
+	~ClusteredMesh();
+
+	const Mesh &getMesh() const { return mesh; }
+	uint32_t getMeshletCount() const { return meshletCount; }
+
+	// the vertex cache statistics of the source order, and of the optimized order before it was split
+	const MeshOptimizeReport &getOptimizeReport() const { return optimizeReport; }
+
+	// both the mesh and the meshlet buffers; the host copies are released
+	void upload(UploadBatch &uploadBatch);
+	bool isUploaded() const { return meshletBuffer != nullptr; }
+
+	const Buffer &getMeshletBuffer() const
+	{
+		assert(isUploaded());
+		return *meshletBuffer;
+	}
+
+	const Buffer &getMeshletVertexBuffer() const
+	{
+		assert(isUploaded());
+		return *meshletVertexBuffer;
+	}
+
+	const Buffer &getMeshletTriangleBuffer() const
+	{
+		assert(isUploaded());
+		return *meshletTriangleBuffer;
+	}
+
+private:
+	ClusteredMesh(const ClusteredMesh &) = delete;
+	ClusteredMesh &operator=(const ClusteredMesh &) = delete;
+
+	Mesh mesh;
+	MeshOptimizeReport optimizeReport;
+	MeshletData meshletData;
+	uint32_t meshletCount;
+
+	Buffer *meshletBuffer;
+	Buffer *meshletVertexBuffer;
+	Buffer *meshletTriangleBuffer;
+};
+
+// push constants of cluster-cull.comp, and in world space of cluster-cull-batched.comp
+struct ClusterCullConstants {
+	glm::vec4 frustumPlanes[6]; // object space, see Frustum
+	glm::vec3 cameraPosition;   // object space
+	uint32_t padding;
+
+	ClusterCullConstants(const glm::mat4 &modelViewProjection, const glm::vec3 &objectSpaceCamera);
+};
+
+/*
+ * Where the cull pass writes the triangles of one ClusteredMesh instance
+ * that survive: a 32-bit index buffer with room for all of them, and the
+ * VkDrawIndexedIndirectCommand to draw it with.
+ *
+ * The pass goes between beginCull() and endCull(), which reset the draw
+ * command and put the barriers around it, including the one against the
+ * previous frame still drawing from these buffers.
+ */
+class ClusterCullTarget {
+public:
+	explicit ClusterCullTarget(const ClusteredMesh &clusteredMesh);
+	~ClusterCullTarget();
+
+	const Buffer &getIndexBuffer() const { return *indexBuffer; }
+	const Buffer &getDrawCommandBuffer() const { return *drawCommandBuffer; }
+
+	void beginCull(VkCommandBuffer commandBuffer);
+	void endCull(VkCommandBuffer commandBuffer);
+
+private:
+	ClusterCullTarget(const ClusterCullTarget &) = delete;
+	ClusterCullTarget &operator=(const ClusterCullTarget &) = delete;
+
+	Buffer *indexBuffer;
+	Buffer *drawCommandBuffer;
+};
+
+/*
+ * The same for many instances of one ClusteredMesh at once, culled by a
+ * single dispatch of cluster-cull-batched.comp. The index buffer is shared,
+ * and no bigger than the budget: cluster-cull-allocate.comp first gives
+ * every instance that the occlusion cull kept a region of it, big enough
+ * for the whole mesh, from an atomic cursor. Those that don't fit any more
+ * are skipped for the frame. Each instance counts its indices up from zero
+ * in its region, and draw-compact.comp then turns the counts into draw
+ * commands. Those draw instance i with firstInstance i, so the vertex
+ * shader finds its object by gl_InstanceIndex.
+ *
+ * With compaction, only the instances that kept any triangles get a
+ * command, and their number goes in the draw count buffer, for
+ * vkCmdDrawIndexedIndirectCountKHR(). Without it, there is one command
+ * per instance, in order, and the empty ones draw nothing.
+ *
+ * The allocation goes between beginCull() and endAllocate(), the cull
+ * pass between that and endCull(), and the compaction between endCull()
+ * and endCompact().
+ */
+class ClusterCullBatchTarget {
+public:
+	// the index buffer is also kept within maxStorageBufferRange; throws if one instance doesn't fit
+	ClusterCullBatchTarget(const ClusteredMesh &clusteredMesh, uint32_t instanceCount, VkDeviceSize indexBudget);
+	~ClusterCullBatchTarget();
+
+	uint32_t getInstanceCount() const { return instanceCount; }
+	uint32_t getIndicesPerInstance() const { return indicesPerInstance; }
+	uint32_t getIndexCapacity() const { return indexCapacity; }
+
+	const Buffer &getIndexBuffer() const { return *indexBuffer; }
+	const Buffer &getIndexCountBuffer() const { return *indexCountBuffer; }
+	const Buffer &getRegionOffsetBuffer() const { return *regionOffsetBuffer; }
+	const Buffer &getIndexCursorBuffer() const { return *indexCursorBuffer; }
+	const Buffer &getDrawCommandBuffer() const { return *drawCommandBuffer; }
+	const Buffer &getDrawCountBuffer() const { return *drawCountBuffer; }
+
+	void beginCull(VkCommandBuffer commandBuffer);
+	void endAllocate(VkCommandBuffer commandBuffer);
+	void endCull(VkCommandBuffer commandBuffer);
+	void endCompact(VkCommandBuffer commandBuffer);
+
+private:
+	ClusterCullBatchTarget(const ClusterCullBatchTarget &) = delete;
+	ClusterCullBatchTarget &operator=(const ClusterCullBatchTarget &) = delete;
+
+	uint32_t instanceCount;
+	uint32_t indicesPerInstance;
+	uint32_t indexCapacity;
+
+	Buffer *indexBuffer;
+	Buffer *indexCountBuffer;
+	Buffer *regionOffsetBuffer;
+	Buffer *indexCursorBuffer;
+	Buffer *drawCommandBuffer;
+	Buffer *drawCountBuffer;
+};
+
+// push constants of cluster-cull-allocate.comp and draw-compact.comp
+struct ClusterCullBatchConstants {
+	uint32_t instanceCount;
+	uint32_t indicesPerInstance;
+	uint32_t indexCapacity;
+	uint32_t compact;
+
+	ClusterCullBatchConstants(const ClusterCullBatchTarget &target, bool compact) :
+		instanceCount(target.getInstanceCount()),
+		indicesPerInstance(target.getIndicesPerInstance()),
+		indexCapacity(target.getIndexCapacity()),
+		compact(compact ? 1 : 0)
+	{
+	}
+};
+
+#endif // CLUSTERED_MESH_H
@@ -0,0 +1,360 @@
+#include "decode-texture.h"
+#include "bc-encode.h"
+#include "mipmap.h"
+#include "pixel-convert.h"
+#include "../core/core.h"
+#include "../core/threadpool.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <string>
+#include <stdexcept>
+#include <algorithm>
+#include <exception>
+#include <functional>
+#include <vector>
+
+#include <sys/stat.h>
+
+using std::string;
+using std::runtime_error;
+using std::max;
+using std::vector;
+
+#include <FreeImage.h>
+
+static FIBITMAP *loadBitmap(string filename, VkFormat *format)
+{
+	FREE_IMAGE_FORMAT fif = FreeImage_GetFileType(filename.c_str(), 0);
+	if (fif == FIF_UNKNOWN) {
+		fif = FreeImage_GetFIFFromFilename(filename.c_str());
+		if (fif == FIF_UNKNOWN)
+			throw runtime_error("unknown image type");
+	}
+
+	if (!FreeImage_FIFSupportsReading(fif))
+		throw runtime_error(string("file format can't be read: ") + FreeImage_GetFIFDescription(fif));
+
+	FIBITMAP *dib = FreeImage_Load(fif, filename.c_str());
+	if (!dib)
+		throw runtime_error("failed to load image");
+
+	auto imageType = FreeImage_GetImageType(dib);
+	FIBITMAP *temp;
+	switch (imageType)
+	{
+	case FIT_BITMAP:
+		temp = dib;
+		dib = FreeImage_ConvertTo32Bits(dib);
+		FreeImage_Unload(temp);
+		if (!dib)
+			throw runtime_error("failed to convert to 32bits!");
+		*format = VK_FORMAT_R8G8B8A8_UNORM;
+		break;
+
+	case FIT_RGBF:
+		*format = VK_FORMAT_R16G16B16A16_SFLOAT;
+		break;
+
+	default:
+		throw runtime_error("unsupported image-type!");
+	}
+
+	// FreeImage uses bottom-left origin, we use top-left
+	FreeImage_FlipVertical(dib);
+	return dib;
+}
+
+static int getBpp(FIBITMAP *dib)
+{
+	switch (FreeImage_GetImageType(dib))
+	{
+	case FIT_BITMAP: return FreeImage_GetBPP(dib);
+	case FIT_RGBF: return sizeof(uint16_t) * 8 * 4; // expand to RGBA, which is always supported
+	default:
+		unreachable("unsupported type!");
+	}
+}
+
+static void copyPixels(FIBITMAP *dib, uint8_t *dst)
+{
+	auto imageType = FreeImage_GetImageType(dib);
+	auto width = FreeImage_GetWidth(dib);
+	auto height = FreeImage_GetHeight(dib);
+
+	auto bpp = getBpp(dib);
+	assert(bpp % 8 == 0);
+	auto pixelSize = bpp / 8;
+
+	auto pitch = width * pixelSize;
+
+	static const uint8_t rgbaOrder[4] = { FI_RGBA_RED, FI_RGBA_GREEN, FI_RGBA_BLUE, FI_RGBA_ALPHA };
+
+	for (auto y = 0u; y < height; ++y) {
+		auto srcRow = FreeImage_GetScanLine(dib, y);
+		auto dstRow = dst + pitch * y;
+
+		switch (imageType)
+		{
+		case FIT_BITMAP:
+			swizzleRow8(srcRow, dstRow, width, rgbaOrder);
+			break;
+		case FIT_RGBF:
+			convertRowRGB32FToRGBA16F(reinterpret_cast<const float *>(srcRow), reinterpret_cast<uint16_t *>(dstRow), width);
+			break;
+		default:
+			unreachable("unsupported type!");
+		}
+	}
+}
+
+static int getMipLevels(unsigned width, unsigned height, TextureImportFlags flags)
+{
+	if (flags & TextureImportFlags::GENERATE_MIPMAPS)
+		return 32 - clz(max(width, height));
+	return 1;
+}
+
+// picks the compressed format the flags ask for; false keeps the pixels as they are
+static bool getCompression(TextureImportFlags flags, MipPixelFormat pixelFormat, bool srgb, BlockCompression *compression, VkFormat *format)
+{
+	auto compressFlags = TextureImportFlags::COMPRESS_BC1 | TextureImportFlags::COMPRESS_BC3 |
+		TextureImportFlags::COMPRESS_BC5 | TextureImportFlags::COMPRESS_BC7;
+	if (!(flags & compressFlags))
+		return false;
+
+	if (pixelFormat == MipPixelFormat::RGBA16F) {
+		*compression = BlockCompression::BC6H;
+		*format = VK_FORMAT_BC6H_UFLOAT_BLOCK;
+	} else if (flags & TextureImportFlags::COMPRESS_BC7) {
+		*compression = BlockCompression::BC7;
+		*format = srgb ? VK_FORMAT_BC7_SRGB_BLOCK : VK_FORMAT_BC7_UNORM_BLOCK;
+	} else if (flags & TextureImportFlags::COMPRESS_BC3) {
+		*compression = BlockCompression::BC3;
+		*format = srgb ? VK_FORMAT_BC3_SRGB_BLOCK : VK_FORMAT_BC3_UNORM_BLOCK;
+	} else if (flags & TextureImportFlags::COMPRESS_BC5) {
+		*compression = BlockCompression::BC5;
+		*format = VK_FORMAT_BC5_UNORM_BLOCK;
+	} else {
+		*compression = BlockCompression::BC1;
+		*format = srgb ? VK_FORMAT_BC1_RGB_SRGB_BLOCK : VK_FORMAT_BC1_RGB_UNORM_BLOCK;
+	}
+	return true;
+}
+
+// replaces the uncompressed chain with a compressed one, level by level
+static void compressMipChain(BlockCompression compression, VkFormat format, DecodedImage *decoded)
+{
+	vector<size_t> offsets;
+	vector<uint8_t> pixels(layoutCompressedMipChain(compression, decoded->width, decoded->height, decoded->mipLevels, &offsets));
+
+	for (auto mipLevel = 0; mipLevel < decoded->mipLevels; ++mipLevel) {
+		auto width = max(int(decoded->width) >> mipLevel, 1);
+		auto height = max(int(decoded->height) >> mipLevel, 1);
+		compressLevel(compression, decoded->pixels.data() + decoded->mipOffsets[mipLevel], width, height, pixels.data() + offsets[mipLevel]);
+	}
+
+	decoded->format = format;
+	decoded->pixels.swap(pixels);
+	decoded->mipOffsets.swap(offsets);
+}
+
+// takes ownership of dib
+static void decodeMipChain(FIBITMAP *dib, VkFormat format, TextureImportFlags flags, const FormatSupport *formatSupport, DecodedImage *decoded)
+{
+	auto baseWidth = FreeImage_GetWidth(dib);
+	auto baseHeight = FreeImage_GetHeight(dib);
+	auto mipLevels = getMipLevels(baseWidth, baseHeight, flags);
+
+	MipChainOptions options = {};
+	options.format = FreeImage_GetImageType(dib) == FIT_RGBF ? MipPixelFormat::RGBA16F : MipPixelFormat::RGBA8;
+	options.filter = MipFilter::BOX;
+	if (flags & TextureImportFlags::MIPMAP_KAISER)
+		options.filter = MipFilter::KAISER;
+	else if (flags & TextureImportFlags::MIPMAP_LANCZOS)
+		options.filter = MipFilter::LANCZOS;
+	options.alphaCutoff = (flags & TextureImportFlags::PRESERVE_ALPHA_COVERAGE) ? 0.5f : 0.0f;
+
+	auto srgb = (flags & TextureImportFlags::SRGB) && format == VK_FORMAT_R8G8B8A8_UNORM;
+
+	BlockCompression compression;
+	VkFormat compressedFormat;
+	auto compress = getCompression(flags, options.format, srgb, &compression, &compressedFormat) &&
+		(formatSupport == nullptr || formatSupport->canSample == nullptr || formatSupport->canSample(compressedFormat));
+
+	// BC5 has no sRGB variant, and two-channel data is hardly ever color anyway
+	if (compress && compression == BlockCompression::BC5)
+		srgb = false;
+
+	if (srgb) {
+		format = VK_FORMAT_R8G8B8A8_SRGB;
+		options.srgb = true;
+	}
+
+	// blits can only do a plain linear filter, and can't write compressed formats
+	auto gpuMipmaps = (flags & TextureImportFlags::GPU_MIPMAPS) && mipLevels > 1 && !compress &&
+		options.filter == MipFilter::BOX && options.alphaCutoff <= 0.0f &&
+		formatSupport != nullptr && formatSupport->canGenerateMipmaps != nullptr &&
+		formatSupport->canGenerateMipmaps(format);
+
+	decoded->format = format;
+	decoded->width = baseWidth;
+	decoded->height = baseHeight;
+	decoded->mipLevels = mipLevels;
+	decoded->storedLevels = gpuMipmaps ? 1 : mipLevels;
+	decoded->gpuMipmaps = gpuMipmaps;
+
+	auto size = layoutMipChain(options.format, baseWidth, baseHeight, decoded->storedLevels, &decoded->mipOffsets);
+	decoded->pixels.resize(size);
+
+	copyPixels(dib, decoded->pixels.data());
+	FreeImage_Unload(dib);
+
+	generateMipChain(decoded->pixels.data(), decoded->mipOffsets, baseWidth, baseHeight, decoded->storedLevels, options);
+
+	if (compress)
+		compressMipChain(compression, compressedFormat, decoded);
+}
+
+/*
+ * Runs job(0) .. job(count - 1) on the default thread pool. FreeImage is
+ * fine with that as long as no two jobs touch the same bitmap. Failures are
+ * rethrown on the calling thread once every job has finished.
+ */
+static void runImportJobs(size_t count, const std::function<void(size_t)> &job)
+{
+	vector<std::exception_ptr> errors(count);
+	ThreadPool::getDefault().parallelFor(count, 1, [&](size_t begin, size_t end) {
+		for (auto i = begin; i < end; ++i) {
+			try {
+				job(i);
+			} catch (...) {
+				errors[i] = std::current_exception();
+			}
+		}
+	});
+
+	for (auto &error : errors) {
+		if (error)
+			std::rethrow_exception(error);
+	}
+}
+
+vector<DecodedImage> decodeImages(const vector<string> &filenames, TextureImportFlags flags, const FormatSupport *formatSupport)
+{
+	vector<DecodedImage> decoded(filenames.size());
+	runImportJobs(filenames.size(), [&](size_t i) {
+		VkFormat format = VK_FORMAT_UNDEFINED;
+		auto dib = loadBitmap(filenames[i], &format);
+		assert(format != VK_FORMAT_UNDEFINED);
+
+		if (flags & TextureImportFlags::PREMULTIPLY_ALPHA)
+			FreeImage_PreMultiplyWithAlpha(dib);
+
+		decodeMipChain(dib, format, flags, formatSupport, &decoded[i]);
+	});
+
+	return decoded;
+}
+
+vector<DecodedImage> decodeCubeCrosses(const vector<string> &filenames, TextureImportFlags flags, const FormatSupport *formatSupport)
+{
+	struct CrossImage {
+		FIBITMAP *dib;
+		VkFormat format;
+		unsigned baseSize;
+	};
+
+	vector<CrossImage> crosses(filenames.size(), CrossImage{ nullptr, VK_FORMAT_UNDEFINED, 0 });
+	auto unloadCrosses = [&]() {
+		for (auto &cross : crosses) {
+			if (cross.dib != nullptr)
+				FreeImage_Unload(cross.dib);
+		}
+	};
+
+	vector<DecodedImage> faces(filenames.size() * 6);
+	try {
+		runImportJobs(filenames.size(), [&](size_t i) {
+			auto &cross = crosses[i];
+			cross.dib = loadBitmap(filenames[i], &cross.format);
+			assert(cross.format != VK_FORMAT_UNDEFINED);
+
+			auto imageWidth = FreeImage_GetWidth(cross.dib);
+			auto imageHeight = FreeImage_GetHeight(cross.dib);
+			cross.baseSize = imageWidth / 3;
+
+			if (imageWidth % 3 != 0 ||
+			    imageHeight != cross.baseSize * 4)
+				throw runtime_error("unexpected image size!");
+
+			if (flags & TextureImportFlags::PREMULTIPLY_ALPHA)
+				FreeImage_PreMultiplyWithAlpha(cross.dib);
+		});
+
+		static const int offsets[6][2] = {
+			{ 2, 2 }, // -X
+			{ 0, 2 }, // +X
+			{ 1, 3 }, // +Y
+			{ 1, 1 }, // -Y
+			{ 1, 2 }, // +Z
+			{ 1, 0 }, // -Z - this one is upside down :(
+		};
+
+		// the faces only read from their cross, so they can be cut out concurrently
+		runImportJobs(faces.size(), [&](size_t i) {
+			auto &cross = crosses[i / 6];
+			auto face = i % 6;
+
+			auto left = offsets[face][0] * cross.baseSize,
+			     top  = offsets[face][1] * cross.baseSize;
+			auto faceDib = FreeImage_Copy(cross.dib, left, top, left + cross.baseSize, top + cross.baseSize);
+			if (!faceDib)
+				throw runtime_error("failed to copy cube face!");
+
+			if (face == 5) {
+				FreeImage_FlipVertical(faceDib);
+				FreeImage_FlipHorizontal(faceDib);
+			}
+
+			decodeMipChain(faceDib, cross.format, flags, formatSupport, &faces[i]);
+		});
+	} catch (...) {
+		unloadCrosses();
+		throw;
+	}
+	unloadCrosses();
+
+	return faces;
+}
+
+vector<DecodedImage> decodeArrayFolder(const string &folder, TextureImportFlags flags, const FormatSupport *formatSupport)
+{
+	vector<string> paths;
+	for (int i = 0; true; ++i) {
+		char path[256];
+		snprintf(path, sizeof(path), "%s/%04d.png", folder.c_str(), i);
+
+		struct stat st;
+		if (stat(path, &st) < 0 ||
+			(st.st_mode & _S_IFMT) != S_IFREG)
+			break;
+
+		paths.push_back(path);
+	}
+
+	if (paths.size() == 0)
+		throw runtime_error("empty texture-array!");
+
+	auto layers = decodeImages(paths, flags, formatSupport);
+
+	auto &first = layers[0];
+	for (auto &layer : layers) {
+		if (first.format != layer.format ||
+		    first.width != layer.width ||
+		    first.height != layer.height)
+			throw runtime_error("inconsistent format or size!");
+	}
+
+	return layers;
+}
@@ -0,0 +1,68 @@
+#ifndef DECODE_TEXTURE_H
+#define DECODE_TEXTURE_H
+
+#include <vulkan/vulkan.h>
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+enum TextureImportFlags {
+	NONE = 0,
+	GENERATE_MIPMAPS = 1 << 0,
+	PREMULTIPLY_ALPHA = 1 << 1,
+	SRGB = 1 << 2,                    // 8-bit color is sRGB-encoded
+	MIPMAP_KAISER = 1 << 3,           // sharper than the default box filter
+	MIPMAP_LANCZOS = 1 << 4,
+	PRESERVE_ALPHA_COVERAGE = 1 << 5, // for alpha testing at 0.5
+	GPU_MIPMAPS = 1 << 6,             // blit the chain on the device; box filter only, else falls back to the CPU
+	COMPRESS_BC1 = 1 << 7,            // block compression, see bc-encode.h; HDR images become BC6H with any of these
+	COMPRESS_BC3 = 1 << 8,
+	COMPRESS_BC5 = 1 << 9,            // red and green only, for normal maps
+	COMPRESS_BC7 = 1 << 10,
+};
+
+inline TextureImportFlags operator|(const TextureImportFlags &a, const TextureImportFlags &b)
+{
+	return static_cast<TextureImportFlags>(static_cast<int>(a) | static_cast<int>(b));
+}
+
+inline TextureImportFlags operator |= (TextureImportFlags &a, const TextureImportFlags &b)
+{
+	return static_cast<TextureImportFlags>(static_cast<int>(a) | static_cast<int>(b));
+}
+
+// every mip level of one image, converted and packed back to back
+struct DecodedImage {
+	VkFormat format;
+	unsigned width, height;
+	int mipLevels;
+	int storedLevels; // just level 0 when the GPU makes the rest
+	bool gpuMipmaps;
+	std::vector<uint8_t> pixels;
+	std::vector<size_t> mipOffsets; // see layoutMipChain()
+};
+
+/*
+ * What the device can do with a format. Without canGenerateMipmaps, mips are
+ * always made on the CPU; without canSample, compressed formats are assumed
+ * to work, which is what offline tools want.
+ */
+struct FormatSupport {
+	bool (*canGenerateMipmaps)(VkFormat format);
+	bool (*canSample)(VkFormat format);
+};
+
+/*
+ * FreeImage-based decoding, spread over the default thread pool. Failures
+ * are rethrown on the calling thread once every job has finished.
+ */
+std::vector<DecodedImage> decodeImages(const std::vector<std::string> &filenames, TextureImportFlags flags, const FormatSupport *formatSupport = nullptr);
+
+// six faces per file, from a vertical cross
+std::vector<DecodedImage> decodeCubeCrosses(const std::vector<std::string> &filenames, TextureImportFlags flags, const FormatSupport *formatSupport = nullptr);
+
+// folder/0000.png, folder/0001.png, ... until one is missing; all must match in format and size
+std::vector<DecodedImage> decodeArrayFolder(const std::string &folder, TextureImportFlags flags, const FormatSupport *formatSupport = nullptr);
+
+#endif // DECODE_TEXTURE_H
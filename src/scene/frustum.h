@@ -0,0 +1,114 @@
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include "bounding-box.h"
+
+#include <glm/glm.hpp>
+
+#include <stdint.h>
+#include <xmmintrin.h>
+
+enum class Containment {
+	OUTSIDE,
+	INTERSECTING,
+	INSIDE
+};
+
+/*
+ * The six planes of a view volume with 0..1 depth, as (normal, distance)
+ * with the normals pointing inwards and normalized. Built from a
+ * model-view-projection matrix, the planes are in that model's space.
+ */
+struct Frustum {
+	// not NEAR and FAR, windows.h defines those
+	enum {
+		LEFT_PLANE,
+		RIGHT_PLANE,
+		BOTTOM_PLANE,
+		TOP_PLANE,
+		NEAR_PLANE,
+		FAR_PLANE,
+		PLANE_COUNT
+	};
+
+	static const uint32_t allPlanes = (1 << PLANE_COUNT) - 1;
+
+	glm::vec4 planes[PLANE_COUNT];
+
+	explicit Frustum(const glm::mat4 &matrix)
+	{
+		auto row = [&](int i) {
+			return glm::vec4(matrix[0][i], matrix[1][i], matrix[2][i], matrix[3][i]);
+		};
+
+		planes[LEFT_PLANE] = row(3) + row(0);
+		planes[RIGHT_PLANE] = row(3) - row(0);
+		planes[BOTTOM_PLANE] = row(3) + row(1);
+		planes[TOP_PLANE] = row(3) - row(1);
+		planes[NEAR_PLANE] = row(2);
+		planes[FAR_PLANE] = row(3) - row(2);
+
+		for (auto &plane : planes)
+			plane /= glm::length(glm::vec3(plane.x, plane.y, plane.z));
+
+		// transposed, and padded to eight with planes that contain everything
+		for (int i = 0; i < 8; ++i) {
+			auto plane = i < PLANE_COUNT ? planes[i] : glm::vec4(0.0f, 0.0f, 0.0f, INFINITY);
+			planeX[i] = plane.x;
+			planeY[i] = plane.y;
+			planeZ[i] = plane.z;
+			planeW[i] = plane.w;
+		}
+	}
+
+	bool intersectsSphere(const glm::vec3 &center, float radius) const
+	{
+		for (auto &plane : planes) {
+			if (glm::dot(glm::vec3(plane.x, plane.y, plane.z), center) + plane.w < -radius)
+				return false;
+		}
+		return true;
+	}
+
+	/*
+	 * Tests a box against four planes at a time. Only the planes in
+	 * planeMask are considered; on return, the ones the box is entirely
+	 * inside of are cleared from it, so children of the box don't need
+	 * to test them again.
+	 */
+	Containment testBox(const BoundingBox &box, uint32_t &planeMask) const
+	{
+		auto center = box.getCenter(), extents = box.getExtents();
+		auto centerX = _mm_set1_ps(center.x), centerY = _mm_set1_ps(center.y), centerZ = _mm_set1_ps(center.z);
+		auto extentX = _mm_set1_ps(extents.x), extentY = _mm_set1_ps(extents.y), extentZ = _mm_set1_ps(extents.z);
+		auto signMask = _mm_set1_ps(-0.0f);
+
+		int outsideBits = 0, insideBits = 0;
+		for (int i = 0; i < 8; i += 4) {
+			auto x = _mm_load_ps(planeX + i), y = _mm_load_ps(planeY + i), z = _mm_load_ps(planeZ + i);
+
+			// signed distance of the center, and how far the box reaches along the normal
+			auto distance = _mm_add_ps(_mm_load_ps(planeW + i),
+				_mm_add_ps(_mm_mul_ps(x, centerX), _mm_add_ps(_mm_mul_ps(y, centerY), _mm_mul_ps(z, centerZ))));
+			auto radius = _mm_add_ps(_mm_mul_ps(_mm_andnot_ps(signMask, x), extentX),
+				_mm_add_ps(_mm_mul_ps(_mm_andnot_ps(signMask, y), extentY), _mm_mul_ps(_mm_andnot_ps(signMask, z), extentZ)));
+
+			outsideBits |= _mm_movemask_ps(_mm_cmplt_ps(distance, _mm_sub_ps(_mm_setzero_ps(), radius))) << i;
+			insideBits |= _mm_movemask_ps(_mm_cmpge_ps(distance, radius)) << i;
+		}
+
+		if (outsideBits & planeMask)
+			return Containment::OUTSIDE;
+
+		planeMask &= ~uint32_t(insideBits);
+		return planeMask == 0 ? Containment::INSIDE : Containment::INTERSECTING;
+	}
+
+private:
+	alignas(16) float planeX[8];
+	alignas(16) float planeY[8];
+	alignas(16) float planeZ[8];
+	alignas(16) float planeW[8];
+};
+
+#endif // FRUSTUM_H
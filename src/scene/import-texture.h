@@ -2,26 +2,17 @@
 #define IMPORT_TEXTURE_H
 
 #include "texture.h"
-#include <string>
-
-enum TextureImportFlags {
-	NONE = 0,
-	GENERATE_MIPMAPS = 1 << 0,
-	PREMULTIPLY_ALPHA = 1 << 1,
-};
-
-inline TextureImportFlags operator|(const TextureImportFlags &a, const TextureImportFlags &b)
-{
-	return static_cast<TextureImportFlags>(static_cast<int>(a) | static_cast<int>(b));
-}
+#include "decode-texture.h"
 
-inline TextureImportFlags operator |= (TextureImportFlags &a, const TextureImportFlags &b)
-{
-	return static_cast<TextureImportFlags>(static_cast<int>(a) | static_cast<int>(b));
-}
+#include <string>
+#include <vector>
 
 Texture2D importTexture2D(std::string filename, TextureImportFlags flags);
 TextureCube importTextureCube(std::string filename, TextureImportFlags flags);
 Texture2DArray importTexture2DArray(std::string filename, TextureImportFlags flags);
 
+// decode on the default thread pool, then upload everything in one batch
+std::vector<Texture2D> importTextures2D(const std::vector<std::string> &filenames, TextureImportFlags flags);
+std::vector<TextureCube> importTexturesCube(const std::vector<std::string> &filenames, TextureImportFlags flags);
+
 #endif // IMPORT_TEXTURE_H
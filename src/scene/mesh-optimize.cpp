@@ -0,0 +1,378 @@
+#include "mesh-optimize.h"
+
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <glm/glm.hpp>
+
+using std::vector;
+
+VertexCacheStatistics analyzeVertexCache(const uint32_t *indices, size_t indexCount, size_t vertexCount, unsigned cacheSize)
+{
+	assert(indexCount % 3 == 0);
+	assert(cacheSize > 0);
+
+	// a vertex is in the FIFO while fewer than cacheSize misses happened since it went in
+	vector<uint32_t> insertedAt(vertexCount, 0);
+	uint32_t misses = 0;
+	for (size_t i = 0; i < indexCount; ++i) {
+		auto index = indices[i];
+		assert(index < vertexCount);
+		if (insertedAt[index] == 0 || misses - insertedAt[index] >= cacheSize) {
+			misses++;
+			insertedAt[index] = misses;
+		}
+	}
+
+	VertexCacheStatistics statistics;
+	statistics.vertexShaderInvocations = misses;
+	statistics.acmr = indexCount > 0 ? float(misses) / (indexCount / 3) : 0.0f;
+	statistics.atvr = vertexCount > 0 ? float(misses) / vertexCount : 0.0f;
+	return statistics;
+}
+
+namespace
+{
+	// Forsyth, "Linear-Speed Vertex Cache Optimisation", with his suggested constants
+	const int scoringCacheSize = 32;
+	const int maxValence = 32;
+
+	struct VertexScoreTable {
+		float cache[scoringCacheSize];
+		float valence[maxValence + 1];
+
+		VertexScoreTable()
+		{
+			for (int i = 0; i < scoringCacheSize; ++i) {
+				// the last triangle's vertices get a fixed score, so it doesn't matter which one is reused
+				cache[i] = i < 3 ? 0.75f : powf(1.0f - float(i - 3) / (scoringCacheSize - 3), 1.5f);
+			}
+
+			// vertices with few triangles left get picked up before they're stranded
+			valence[0] = 0.0f;
+			for (int i = 1; i <= maxValence; ++i)
+				valence[i] = 2.0f * powf(float(i), -0.5f);
+		}
+
+		float score(int cachePosition, uint32_t liveTriangles) const
+		{
+			if (liveTriangles == 0)
+				return -1.0f;
+			auto valenceScore = valence[std::min(liveTriangles, uint32_t(maxValence))];
+			return cachePosition >= 0 ? cache[cachePosition] + valenceScore : valenceScore;
+		}
+	};
+}
+
+void optimizeVertexCache(uint32_t *dst, const uint32_t *indices, size_t indexCount, size_t vertexCount)
+{
+	assert(indexCount % 3 == 0);
+	static const VertexScoreTable scoreTable;
+
+	auto triangleCount = indexCount / 3;
+	if (triangleCount == 0)
+		return;
+
+	vector<uint32_t> input(indices, indices + indexCount);
+
+	// per-vertex lists of the triangles that still have to be emitted
+	vector<uint32_t> liveTriangles(vertexCount, 0);
+	for (auto index : input)
+		liveTriangles[index]++;
+
+	vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+	for (size_t i = 0; i < vertexCount; ++i)
+		adjacencyOffsets[i + 1] = adjacencyOffsets[i] + liveTriangles[i];
+
+	vector<uint32_t> adjacency(indexCount);
+	{
+		vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+		for (size_t i = 0; i < indexCount; ++i)
+			adjacency[fill[input[i]]++] = uint32_t(i / 3);
+	}
+
+	vector<int> cachePositions(vertexCount, -1);
+	vector<float> vertexScores(vertexCount);
+	for (size_t i = 0; i < vertexCount; ++i)
+		vertexScores[i] = scoreTable.score(-1, liveTriangles[i]);
+
+	vector<bool> emitted(triangleCount, false);
+	vector<uint32_t> cache, newCache;
+	cache.reserve(scoringCacheSize + 3);
+	newCache.reserve(scoringCacheSize + 3);
+
+	size_t bestTriangle = 0;
+	bool haveBest = true;
+	size_t nextCandidate = 0;
+
+	for (size_t output = 0; output < triangleCount; ++output) {
+		if (!haveBest) {
+			// nothing in the cache connects to what's left; take the first unemitted triangle
+			while (emitted[nextCandidate])
+				nextCandidate++;
+			bestTriangle = nextCandidate;
+		}
+
+		auto triangle = &input[bestTriangle * 3];
+		memcpy(dst + output * 3, triangle, 3 * sizeof(uint32_t));
+		emitted[bestTriangle] = true;
+
+		for (int i = 0; i < 3; ++i) {
+			auto vertex = triangle[i];
+			auto begin = adjacency.begin() + adjacencyOffsets[vertex];
+			auto end = begin + liveTriangles[vertex];
+			auto it = std::find(begin, end, uint32_t(bestTriangle));
+			assert(it != end);
+			std::iter_swap(it, end - 1);
+			liveTriangles[vertex]--;
+		}
+
+		// the triangle's vertices move to the front, everything else shifts back
+		newCache.assign(triangle, triangle + 3);
+		for (auto vertex : cache) {
+			if (vertex != triangle[0] && vertex != triangle[1] && vertex != triangle[2])
+				newCache.push_back(vertex);
+		}
+
+		for (size_t i = 0; i < newCache.size(); ++i) {
+			auto vertex = newCache[i];
+			cachePositions[vertex] = i < size_t(scoringCacheSize) ? int(i) : -1;
+			vertexScores[vertex] = scoreTable.score(cachePositions[vertex], liveTriangles[vertex]);
+		}
+
+		// only triangles around cached vertices changed score
+		haveBest = false;
+		auto bestScore = -1.0f;
+		for (auto vertex : newCache) {
+			auto begin = adjacencyOffsets[vertex];
+			for (auto j = begin; j < begin + liveTriangles[vertex]; ++j) {
+				auto candidate = adjacency[j];
+				auto corners = &input[candidate * 3];
+				auto score = vertexScores[corners[0]] + vertexScores[corners[1]] + vertexScores[corners[2]];
+				if (score > bestScore) {
+					bestScore = score;
+					bestTriangle = candidate;
+					haveBest = true;
+				}
+			}
+		}
+
+		if (newCache.size() > size_t(scoringCacheSize))
+			newCache.resize(scoringCacheSize);
+		cache.swap(newCache);
+	}
+}
+
+
+namespace
+{
+	struct Cluster {
+		size_t firstTriangle, triangleCount;
+		float sortKey;
+	};
+
+	// FIFO cache simulation one triangle at a time, for finding cluster boundaries
+	class CacheSimulation {
+	public:
+		CacheSimulation(size_t vertexCount) :
+			insertedAt(vertexCount, 0),
+			misses(0),
+			resetAt(0)
+		{
+		}
+
+		void reset() { resetAt = misses; }
+
+		unsigned addTriangle(const uint32_t *triangle, unsigned cacheSize)
+		{
+			unsigned triangleMisses = 0;
+			for (int i = 0; i < 3; ++i) {
+				auto &inserted = insertedAt[triangle[i]];
+				if (inserted <= resetAt || misses - inserted >= cacheSize) {
+					misses++;
+					inserted = misses;
+					triangleMisses++;
+				}
+			}
+			return triangleMisses;
+		}
+
+	private:
+		vector<uint32_t> insertedAt;
+		uint32_t misses, resetAt;
+	};
+}
+
+/*
+ * After Sander, Nehab and Barczak, "Fast Triangle Reordering for Vertex
+ * Locality and Reduced Overdraw": the cache-optimized order is cut where it
+ * starts over anyway (a triangle missing on all three vertices), and those
+ * runs are cut once more wherever their ACMR so far is within the threshold
+ * of the run's own. The clusters are then drawn outermost first, judged by
+ * how far their centroid lies out along their average normal.
+ */
+void optimizeOverdraw(uint32_t *dst, const uint32_t *indices, size_t indexCount,
+	const void *positions, size_t positionStride, size_t vertexCount, float threshold)
+{
+	assert(indexCount % 3 == 0);
+	assert(threshold >= 1.0f);
+	const unsigned cacheSize = 16;
+
+	auto triangleCount = indexCount / 3;
+	if (triangleCount == 0)
+		return;
+
+	vector<uint32_t> input(indices, indices + indexCount);
+
+	vector<size_t> hardBoundaries;
+	{
+		CacheSimulation cache(vertexCount);
+		for (size_t i = 0; i < triangleCount; ++i) {
+			if (cache.addTriangle(&input[i * 3], cacheSize) == 3)
+				hardBoundaries.push_back(i);
+		}
+		hardBoundaries.push_back(triangleCount);
+	}
+
+	vector<Cluster> clusters;
+	{
+		CacheSimulation cache(vertexCount);
+		for (size_t b = 0; b + 1 < hardBoundaries.size(); ++b) {
+			auto begin = hardBoundaries[b], end = hardBoundaries[b + 1];
+
+			unsigned clusterMisses = 0;
+			cache.reset();
+			for (auto i = begin; i < end; ++i)
+				clusterMisses += cache.addTriangle(&input[i * 3], cacheSize);
+			auto limit = threshold * float(clusterMisses) / float(end - begin);
+
+			auto first = begin;
+			unsigned misses = 0;
+			cache.reset();
+			for (auto i = begin; i < end; ++i) {
+				misses += cache.addTriangle(&input[i * 3], cacheSize);
+				if (i + 1 < end && float(misses) / float(i + 1 - first) <= limit) {
+					Cluster cluster = { first, i + 1 - first, 0.0f };
+					clusters.push_back(cluster);
+					first = i + 1;
+					misses = 0;
+					cache.reset();
+				}
+			}
+			Cluster cluster = { first, end - first, 0.0f };
+			clusters.push_back(cluster);
+		}
+	}
+
+	auto bytes = static_cast<const uint8_t *>(positions);
+	auto position = [&](uint32_t index) {
+		auto p = reinterpret_cast<const float *>(bytes + index * positionStride);
+		return glm::vec3(p[0], p[1], p[2]);
+	};
+
+	// area-weighted, so tiny slivers don't drag the centroid around
+	auto meshCentroid = glm::vec3(0.0f);
+	auto meshArea = 0.0f;
+	vector<glm::vec3> clusterCentroids(clusters.size()), clusterNormals(clusters.size());
+	for (size_t c = 0; c < clusters.size(); ++c) {
+		auto centroid = glm::vec3(0.0f), normal = glm::vec3(0.0f);
+		auto area = 0.0f;
+		for (auto i = clusters[c].firstTriangle; i < clusters[c].firstTriangle + clusters[c].triangleCount; ++i) {
+			auto p0 = position(input[i * 3]), p1 = position(input[i * 3 + 1]), p2 = position(input[i * 3 + 2]);
+			auto crossProduct = glm::cross(p1 - p0, p2 - p0);
+			auto triangleArea = glm::length(crossProduct);
+			centroid += (p0 + p1 + p2) * (triangleArea / 3.0f);
+			normal += crossProduct;
+			area += triangleArea;
+		}
+
+		meshCentroid += centroid;
+		meshArea += area;
+		clusterCentroids[c] = area > 0.0f ? centroid / area : position(input[clusters[c].firstTriangle * 3]);
+		auto normalLength = glm::length(normal);
+		clusterNormals[c] = normalLength > 0.0f ? normal / normalLength : glm::vec3(0.0f);
+	}
+	if (meshArea > 0.0f)
+		meshCentroid /= meshArea;
+
+	for (size_t c = 0; c < clusters.size(); ++c)
+		clusters[c].sortKey = glm::dot(clusterCentroids[c] - meshCentroid, clusterNormals[c]);
+
+	std::stable_sort(clusters.begin(), clusters.end(), [](const Cluster &a, const Cluster &b) {
+		return a.sortKey > b.sortKey;
+	});
+
+	auto out = dst;
+	for (const auto &cluster : clusters) {
+		auto count = cluster.triangleCount * 3;
+		memcpy(out, &input[cluster.firstTriangle * 3], count * sizeof(uint32_t));
+		out += count;
+	}
+}
+
+size_t optimizeVertexFetchRemap(uint32_t *remap, const uint32_t *indices, size_t indexCount, size_t vertexCount)
+{
+	std::fill(remap, remap + vertexCount, UINT32_MAX);
+
+	uint32_t nextVertex = 0;
+	for (size_t i = 0; i < indexCount; ++i) {
+		assert(indices[i] < vertexCount);
+		auto &target = remap[indices[i]];
+		if (target == UINT32_MAX)
+			target = nextVertex++;
+	}
+	return nextVertex;
+}
+
+void remapIndices(uint32_t *dst, const uint32_t *indices, size_t indexCount, const uint32_t *remap)
+{
+	for (size_t i = 0; i < indexCount; ++i) {
+		assert(remap[indices[i]] != UINT32_MAX);
+		dst[i] = remap[indices[i]];
+	}
+}
+
+void remapVertices(void *dst, const void *vertices, size_t vertexCount, size_t vertexStride, const uint32_t *remap)
+{
+	auto out = static_cast<uint8_t *>(dst);
+	auto in = static_cast<const uint8_t *>(vertices);
+	for (size_t i = 0; i < vertexCount; ++i) {
+		if (remap[i] != UINT32_MAX)
+			memcpy(out + remap[i] * vertexStride, in + i * vertexStride, vertexStride);
+	}
+}
+
+MeshOptimizeReport optimizeMesh(vector<uint8_t> &vertexData, size_t vertexStride, size_t positionOffset,
+	vector<uint32_t> &indices, const MeshOptimizeOptions &options)
+{
+	assert(vertexData.size() % vertexStride == 0);
+	assert(!options.overdraw || options.vertexCache);
+
+	auto vertexCount = vertexData.size() / vertexStride;
+
+	MeshOptimizeReport report;
+	report.before = analyzeVertexCache(indices.data(), indices.size(), vertexCount);
+
+	if (options.vertexCache)
+		optimizeVertexCache(indices.data(), indices.data(), indices.size(), vertexCount);
+
+	if (options.overdraw) {
+		optimizeOverdraw(indices.data(), indices.data(), indices.size(),
+			vertexData.data() + positionOffset, vertexStride, vertexCount, options.overdrawThreshold);
+	}
+
+	if (options.vertexFetch) {
+		vector<uint32_t> remap(vertexCount);
+		auto usedVertexCount = optimizeVertexFetchRemap(remap.data(), indices.data(), indices.size(), vertexCount);
+		remapIndices(indices.data(), indices.data(), indices.size(), remap.data());
+
+		vector<uint8_t> remapped(usedVertexCount * vertexStride);
+		remapVertices(remapped.data(), vertexData.data(), vertexCount, vertexStride, remap.data());
+		vertexData.swap(remapped);
+		vertexCount = usedVertexCount;
+	}
+
+	report.after = analyzeVertexCache(indices.data(), indices.size(), vertexCount);
+	return report;
+}
@@ -0,0 +1,71 @@
+#ifndef MESH_OPTIMIZE_H
+#define MESH_OPTIMIZE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+/*
+ * Reordering of indexed triangle lists for the GPU, offline or at load
+ * time. None of this changes what gets drawn, only the order:
+ *
+ * - optimizeVertexCache() orders triangles so vertices get reused while
+ *   they're still in the post-transform cache (Forsyth's algorithm).
+ * - optimizeOverdraw() then moves whole runs of that order around so
+ *   outward-facing parts tend to be drawn first, giving early depth
+ *   rejection more to reject.
+ * - optimizeVertexFetchRemap() renumbers vertices in the order they're first
+ *   used, so vertex fetches walk memory front to back.
+ */
+
+struct VertexCacheStatistics {
+	uint32_t vertexShaderInvocations; // with a FIFO cache of the simulated size
+	float acmr;                       // average cache miss ratio: invocations per triangle, 0.5 - 3
+	float atvr;                       // average transformed vertex ratio: invocations per vertex, 1 is ideal
+};
+
+struct MeshOptimizeOptions {
+	bool vertexCache;
+	bool overdraw; // needs vertexCache
+
+	// how much ACMR overdraw ordering may give up; 1.05 allows 5% more vertex shading
+	float overdrawThreshold;
+
+	bool vertexFetch;
+};
+
+struct MeshOptimizeReport {
+	VertexCacheStatistics before, after;
+};
+
+// simulates a FIFO post-transform cache; cacheSize 16 is a fair guess for current GPUs
+VertexCacheStatistics analyzeVertexCache(const uint32_t *indices, size_t indexCount, size_t vertexCount, unsigned cacheSize = 16);
+
+// dst may equal indices
+void optimizeVertexCache(uint32_t *dst, const uint32_t *indices, size_t indexCount, size_t vertexCount);
+
+// indices should come out of optimizeVertexCache(); positions are three floats, positionStride bytes apart
+void optimizeOverdraw(uint32_t *dst, const uint32_t *indices, size_t indexCount,
+	const void *positions, size_t positionStride, size_t vertexCount, float threshold = 1.05f);
+
+/*
+ * Fills remap with the new index of each vertex, or UINT32_MAX for vertices
+ * no triangle uses, and returns the number of vertices that are left.
+ */
+size_t optimizeVertexFetchRemap(uint32_t *remap, const uint32_t *indices, size_t indexCount, size_t vertexCount);
+
+// dst may equal indices
+void remapIndices(uint32_t *dst, const uint32_t *indices, size_t indexCount, const uint32_t *remap);
+
+// dst must not overlap vertices
+void remapVertices(void *dst, const void *vertices, size_t vertexCount, size_t vertexStride, const uint32_t *remap);
+
+/*
+ * Runs the enabled passes on one interleaved vertex buffer and its indices,
+ * which are replaced by the optimized versions. Vertices no triangle uses
+ * are dropped by the vertex fetch pass.
+ */
+MeshOptimizeReport optimizeMesh(std::vector<uint8_t> &vertexData, size_t vertexStride, size_t positionOffset,
+	std::vector<uint32_t> &indices, const MeshOptimizeOptions &options);
+
+#endif // MESH_OPTIMIZE_H
@@ -0,0 +1,64 @@
+#ifndef MESH_PACK_FORMAT_H
+#define MESH_PACK_FORMAT_H
+
+#include <stdint.h>
+
+/*
+ * Container written by the bake-mesh tool: a header, the vertex attribute
+ * table, the submesh and material tables, and then the vertex and index
+ * streams back to back, already quantized to their GPU formats. Loading is
+ * a straight copy of both streams into staging memory. All fields are
+ * little-endian.
+ */
+
+const uint32_t meshPackMagic = 0x484d4c45; // "ELMH"
+const uint32_t meshPackVersion = 1;
+
+// both streams start 16-byte aligned
+const uint64_t meshPackStreamAlignment = 16;
+
+const uint32_t meshPackMaxAttributes = 16;
+
+struct MeshPackHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t attributeCount;
+	uint32_t vertexStride;
+	uint32_t vertexCount;
+	uint32_t indexCount;
+	uint32_t indexSize; // 2 or 4 bytes
+	uint32_t submeshCount;
+	uint32_t materialCount;
+	uint32_t reserved;
+	float boundsMin[3], boundsMax[3];
+	uint64_t vertexOffset; // from the start of the file
+	uint64_t indexOffset;  // right after the vertex stream, apart from padding
+};
+
+struct MeshPackAttribute {
+	uint32_t semantic; // VertexSemantic
+	uint32_t format;   // VkFormat
+	uint32_t offset;   // within a vertex
+};
+
+// draw with vkCmdDrawIndexed(indexCount, 1, firstIndex, vertexOffset, 0)
+struct MeshPackSubmesh {
+	uint32_t firstIndex;
+	uint32_t indexCount;
+	int32_t vertexOffset;
+	uint32_t materialIndex;
+	float boundsMin[3], boundsMax[3];
+};
+
+struct MeshPackMaterial {
+	char name[64];       // zero-terminated
+	char albedoMap[128]; // relative to the pack, empty if none
+	float albedoColor[4];
+};
+
+static_assert(sizeof(MeshPackHeader) == 80, "unexpected padding");
+static_assert(sizeof(MeshPackAttribute) == 12, "unexpected padding");
+static_assert(sizeof(MeshPackSubmesh) == 40, "unexpected padding");
+static_assert(sizeof(MeshPackMaterial) == 208, "unexpected padding");
+
+#endif // MESH_PACK_FORMAT_H
@@ -0,0 +1,107 @@
+#include "mesh-pack.h"
+#include "uploadbatch.h"
+#include "../core/memorymappedfile.h"
+
+#include <string.h>
+#include <memory>
+#include <stdexcept>
+
+using std::string;
+using std::runtime_error;
+using std::unique_ptr;
+using std::vector;
+
+MeshPack::MeshPack(UploadBatch &uploadBatch, const string &filename)
+{
+	load(uploadBatch, filename);
+}
+
+MeshPack::MeshPack(const string &filename)
+{
+	UploadBatch uploadBatch;
+	load(uploadBatch, filename);
+	uploadBatch.submit();
+}
+
+template <typename T>
+static void readTable(const uint8_t *data, size_t size, size_t *offset, uint32_t count, vector<T> *table)
+{
+	if (uint64_t(count) * sizeof(T) > size - *offset)
+		throw runtime_error("truncated mesh file!");
+
+	table->resize(count);
+	if (count > 0)
+		memcpy(table->data(), data + *offset, count * sizeof(T));
+	*offset += count * sizeof(T);
+}
+
+void MeshPack::load(UploadBatch &uploadBatch, const string &filename)
+{
+	MemoryMappedFile file(filename.c_str(), MemoryMappedFile::SEQUENTIAL);
+	auto data = static_cast<const uint8_t *>(file.getData());
+	auto size = file.getSize();
+
+	if (size < sizeof(MeshPackHeader))
+		throw runtime_error("truncated mesh file!");
+
+	MeshPackHeader header;
+	memcpy(&header, data, sizeof(header));
+
+	if (header.magic != meshPackMagic)
+		throw runtime_error("not a mesh pack!");
+	if (header.version != meshPackVersion)
+		throw runtime_error("unsupported mesh pack version!");
+	if (header.indexSize != 2 && header.indexSize != 4)
+		throw runtime_error("unexpected index size!");
+	if (header.attributeCount > meshPackMaxAttributes || header.vertexStride == 0)
+		throw runtime_error("unexpected vertex layout!");
+	if (header.vertexCount == 0 || header.indexCount == 0)
+		throw runtime_error("empty mesh!");
+
+	vector<MeshPackAttribute> attributes;
+	size_t offset = sizeof(MeshPackHeader);
+	readTable(data, size, &offset, header.attributeCount, &attributes);
+	readTable(data, size, &offset, header.submeshCount, &submeshes);
+	readTable(data, size, &offset, header.materialCount, &materials);
+
+	auto vertexBytes = uint64_t(header.vertexCount) * header.vertexStride;
+	auto indexBytes = uint64_t(header.indexCount) * header.indexSize;
+	if (header.vertexOffset < offset || header.vertexOffset > size || vertexBytes > size - header.vertexOffset ||
+	    header.indexOffset < header.vertexOffset + vertexBytes || header.indexOffset > size || indexBytes > size - header.indexOffset)
+		throw runtime_error("truncated mesh file!");
+
+	vector<VertexLayout::Attribute> layoutAttributes;
+	for (auto &attribute : attributes) {
+		VertexLayout::Attribute layoutAttribute = { attribute.semantic, VkFormat(attribute.format), attribute.offset };
+		layoutAttributes.push_back(layoutAttribute);
+	}
+	VertexLayout vertexLayout(layoutAttributes, header.vertexStride);
+
+	for (auto &submesh : submeshes) {
+		if (submesh.firstIndex > header.indexCount || submesh.indexCount > header.indexCount - submesh.firstIndex ||
+		    submesh.vertexOffset < 0 || uint32_t(submesh.vertexOffset) >= header.vertexCount ||
+		    (header.materialCount > 0 && submesh.materialIndex >= header.materialCount))
+			throw runtime_error("corrupt mesh file!");
+	}
+
+	for (auto &material : materials) {
+		material.name[sizeof(material.name) - 1] = '\0';
+		material.albedoMap[sizeof(material.albedoMap) - 1] = '\0';
+	}
+
+	// owned here until the mesh takes them, as uploading can throw
+	unique_ptr<Buffer> vertexBuffer(new Buffer(vertexBytes, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT));
+	unique_ptr<Buffer> indexBuffer(new Buffer(indexBytes, VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT));
+
+	// straight out of the mapping into staging memory
+	vertexBuffer->upload(uploadBatch, 0, data + header.vertexOffset, vertexBytes);
+	indexBuffer->upload(uploadBatch, 0, data + header.indexOffset, indexBytes);
+
+	uploadBatch.finishBuffer(vertexBuffer->getBuffer(), VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT);
+	uploadBatch.finishBuffer(indexBuffer->getBuffer(), VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_INDEX_READ_BIT);
+
+	auto indexType = header.indexSize == 2 ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+	BoundingBox bounds(glm::vec3(header.boundsMin[0], header.boundsMin[1], header.boundsMin[2]),
+	                   glm::vec3(header.boundsMax[0], header.boundsMax[1], header.boundsMax[2]));
+	mesh = Mesh(vertexLayout, header.vertexCount, header.indexCount, indexType, vertexBuffer.release(), indexBuffer.release(), bounds);
+}
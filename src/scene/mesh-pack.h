@@ -0,0 +1,40 @@
+#ifndef MESH_PACK_H
+#define MESH_PACK_H
+
+#include "mesh.h"
+#include "mesh-pack-format.h"
+
+#include <string>
+#include <vector>
+
+/*
+ * Geometry loaded from a file written by the bake-mesh tool. The file is
+ * memory mapped and both streams are copied from the mapping into staging
+ * memory as they are; nothing gets parsed or converted at run-time. The
+ * resulting mesh only lives on the device.
+ */
+class MeshPack {
+public:
+	MeshPack(UploadBatch &uploadBatch, const std::string &filename);
+	explicit MeshPack(const std::string &filename);
+
+	// one vertex and index buffer for all submeshes
+	const Mesh &getMesh() const { return mesh; }
+
+	const std::vector<MeshPackSubmesh> &getSubmeshes() const { return submeshes; }
+	const std::vector<MeshPackMaterial> &getMaterials() const { return materials; }
+
+	const BoundingBox &getBounds() const { return mesh.getBounds(); }
+
+private:
+	MeshPack(const MeshPack &) = delete;
+	MeshPack &operator=(const MeshPack &) = delete;
+
+	void load(UploadBatch &uploadBatch, const std::string &filename);
+
+	Mesh mesh;
+	std::vector<MeshPackSubmesh> submeshes;
+	std::vector<MeshPackMaterial> materials;
+};
+
+#endif // MESH_PACK_H
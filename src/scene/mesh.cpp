@@ -0,0 +1,174 @@
+#include "mesh.h"
+#include "uploadbatch.h"
+
+#include <string.h>
+#include <stdexcept>
+#include <utility>
+
+using std::vector;
+
+static BoundingBox computeBounds(const VertexLayout &vertexLayout, const vector<uint8_t> &vertexData)
+{
+	BoundingBox bounds;
+	auto position = vertexLayout.findAttribute(VERTEX_POSITION);
+	if (position == nullptr || position->format != VK_FORMAT_R32G32B32_SFLOAT)
+		return bounds;
+
+	for (size_t offset = position->offset; offset < vertexData.size(); offset += vertexLayout.getStride()) {
+		glm::vec3 p;
+		memcpy(&p, vertexData.data() + offset, sizeof(p));
+		bounds.grow(p);
+	}
+	return bounds;
+}
+
+Mesh::Mesh() :
+	vertexCount(0),
+	indexCount(0),
+	vertexBuffer(nullptr),
+	indexBuffer(nullptr),
+	indexType(VK_INDEX_TYPE_UINT32)
+{
+}
+
+Mesh::Mesh(const VertexLayout &vertexLayout, const vector<Vertex> &vertices, vector<uint32_t> indices) :
+	vertexLayout(vertexLayout),
+	vertexData(vertexLayout.pack(vertices)),
+	indices(std::move(indices)),
+	vertexCount(uint32_t(vertices.size())),
+	indexCount(uint32_t(this->indices.size())),
+	vertexBuffer(nullptr),
+	indexBuffer(nullptr),
+	indexType(VK_INDEX_TYPE_UINT32)
+{
+	for (auto &vertex : vertices)
+		bounds.grow(vertex.position);
+}
+
+Mesh::Mesh(const VertexLayout &vertexLayout, vector<uint8_t> vertexData, vector<uint32_t> indices) :
+	vertexLayout(vertexLayout),
+	vertexData(std::move(vertexData)),
+	indices(std::move(indices)),
+	vertexCount(uint32_t(this->vertexData.size() / vertexLayout.getStride())),
+	indexCount(uint32_t(this->indices.size())),
+	vertexBuffer(nullptr),
+	indexBuffer(nullptr),
+	indexType(VK_INDEX_TYPE_UINT32)
+{
+	assert(this->vertexData.size() % vertexLayout.getStride() == 0);
+	bounds = computeBounds(vertexLayout, this->vertexData);
+}
+
+Mesh::Mesh(const VertexLayout &vertexLayout, uint32_t vertexCount, uint32_t indexCount, VkIndexType indexType,
+	Buffer *vertexBuffer, Buffer *indexBuffer, const BoundingBox &bounds) :
+	vertexLayout(vertexLayout),
+	vertexCount(vertexCount),
+	indexCount(indexCount),
+	bounds(bounds),
+	vertexBuffer(vertexBuffer),
+	indexBuffer(indexBuffer),
+	indexType(indexType)
+{
+	assert(vertexBuffer != nullptr && indexBuffer != nullptr);
+}
+
+Mesh::Mesh(Mesh &&other) :
+	vertexLayout(std::move(other.vertexLayout)),
+	vertexData(std::move(other.vertexData)),
+	indices(std::move(other.indices)),
+	vertexCount(other.vertexCount),
+	indexCount(other.indexCount),
+	bounds(other.bounds),
+	vertexBuffer(other.vertexBuffer),
+	indexBuffer(other.indexBuffer),
+	indexType(other.indexType)
+{
+	other.vertexCount = other.indexCount = 0;
+	other.vertexBuffer = other.indexBuffer = nullptr;
+}
+
+Mesh &Mesh::operator=(Mesh &&other)
+{
+	if (this != &other) {
+		destroyBuffers();
+
+		vertexLayout = std::move(other.vertexLayout);
+		vertexData = std::move(other.vertexData);
+		indices = std::move(other.indices);
+		vertexCount = other.vertexCount;
+		indexCount = other.indexCount;
+		bounds = other.bounds;
+		vertexBuffer = other.vertexBuffer;
+		indexBuffer = other.indexBuffer;
+		indexType = other.indexType;
+
+		other.vertexCount = other.indexCount = 0;
+		other.vertexBuffer = other.indexBuffer = nullptr;
+	}
+	return *this;
+}
+
+Mesh::~Mesh()
+{
+	destroyBuffers();
+}
+
+void Mesh::destroyBuffers()
+{
+	delete vertexBuffer;
+	delete indexBuffer;
+	vertexBuffer = indexBuffer = nullptr;
+}
+
+MeshOptimizeReport Mesh::optimize(const MeshOptimizeOptions &options)
+{
+	assert(hasHostData());
+	assert(!isUploaded());
+
+	auto position = vertexLayout.findAttribute(VERTEX_POSITION);
+	if (position == nullptr || position->format != VK_FORMAT_R32G32B32_SFLOAT)
+		throw std::runtime_error("Mesh needs float positions to be optimized!");
+
+	auto report = optimizeMesh(vertexData, vertexLayout.getStride(), position->offset, indices, options);
+	vertexCount = uint32_t(vertexData.size() / vertexLayout.getStride());
+	return report;
+}
+
+void Mesh::upload(UploadBatch &uploadBatch, bool keepHostData)
+{
+	assert(!isUploaded());
+	assert(hasHostData());
+
+	// any index below the vertex count fits when there are at most 65536 vertices
+	indexType = vertexCount <= 65536 ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+	auto indexSize = indexType == VK_INDEX_TYPE_UINT16 ? sizeof(uint16_t) : sizeof(uint32_t);
+
+	auto vertexBytes = VkDeviceSize(vertexData.size());
+	auto indexBytes = VkDeviceSize(indices.size() * indexSize);
+
+	vertexBuffer = new Buffer(vertexBytes, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	indexBuffer = new Buffer(indexBytes, VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+	vertexBuffer->upload(uploadBatch, 0, vertexData.data(), vertexBytes);
+	if (indexType == VK_INDEX_TYPE_UINT16) {
+		vector<uint16_t> indices16(indices.size());
+		for (size_t i = 0; i < indices.size(); ++i)
+			indices16[i] = uint16_t(indices[i]);
+		indexBuffer->upload(uploadBatch, 0, indices16.data(), indexBytes);
+	} else {
+		indexBuffer->upload(uploadBatch, 0, indices.data(), indexBytes);
+	}
+
+	uploadBatch.finishBuffer(vertexBuffer->getBuffer(), VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT);
+	uploadBatch.finishBuffer(indexBuffer->getBuffer(), VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_INDEX_READ_BIT);
+
+	if (!keepHostData)
+		releaseHostData();
+}
+
+void Mesh::releaseHostData()
+{
+	// swapping with empty vectors frees the memory, unlike clear()
+	vector<uint8_t>().swap(vertexData);
+	vector<uint32_t>().swap(indices);
+}
@@ -0,0 +1,91 @@
+#ifndef MESH_H
+#define MESH_H
+
+#include "bounding-box.h"
+#include "buffer.h"
+#include "mesh-optimize.h"
+#include "vertex-layout.h"
+#include "../core/arrayview.h"
+
+#include <vector>
+
+class UploadBatch;
+
+/*
+ * Indexed geometry with its vertices packed in a VertexLayout. A mesh
+ * starts out on the host; upload() creates its device-local vertex and
+ * index buffers, and by default hands the host copy back to the allocator
+ * right away, so the geometry only lives on the device from then on.
+ *
+ * Meshes own their buffers, so they can be moved but not copied.
+ */
+class Mesh {
+public:
+	Mesh();
+	Mesh(const VertexLayout &vertexLayout, const std::vector<Vertex> &vertices, std::vector<uint32_t> indices);
+	Mesh(const VertexLayout &vertexLayout, std::vector<uint8_t> vertexData, std::vector<uint32_t> indices);
+
+	// for geometry that went straight to the device; takes ownership of the buffers
+	Mesh(const VertexLayout &vertexLayout, uint32_t vertexCount, uint32_t indexCount, VkIndexType indexType,
+		Buffer *vertexBuffer, Buffer *indexBuffer, const BoundingBox &bounds);
+
+	Mesh(Mesh &&other);
+	Mesh &operator=(Mesh &&other);
+	~Mesh();
+
+	const VertexLayout &getVertexLayout() const { return vertexLayout; }
+	uint32_t getVertexCount() const { return vertexCount; }
+	uint32_t getIndexCount() const { return indexCount; }
+
+	// object space; empty if the layout has no float positions to compute it from
+	const BoundingBox &getBounds() const { return bounds; }
+
+	// empty once the host copy has been released
+	ArrayView<uint8_t> getVertexData() const { return vertexData; }
+	ArrayView<uint32_t> getIndices() const { return indices; }
+	bool hasHostData() const { return !vertexData.empty(); }
+
+	// reorders the host copy for the GPU; see mesh-optimize.h
+	MeshOptimizeReport optimize(const MeshOptimizeOptions &options);
+
+	/*
+	 * Records the copies of both streams, through a single staging
+	 * allocation. Indices go to the device as 16 bits whenever they fit.
+	 */
+	void upload(UploadBatch &uploadBatch, bool keepHostData = false);
+	bool isUploaded() const { return vertexBuffer != nullptr; }
+
+	void releaseHostData();
+
+	const Buffer &getVertexBuffer() const
+	{
+		assert(isUploaded());
+		return *vertexBuffer;
+	}
+
+	const Buffer &getIndexBuffer() const
+	{
+		assert(isUploaded());
+		return *indexBuffer;
+	}
+
+	VkIndexType getIndexType() const { return indexType; }
+
+private:
+	Mesh(const Mesh &) = delete;
+	Mesh &operator=(const Mesh &) = delete;
+
+	void destroyBuffers();
+
+	VertexLayout vertexLayout;
+	std::vector<uint8_t> vertexData;
+	std::vector<uint32_t> indices;
+	uint32_t vertexCount, indexCount;
+	BoundingBox bounds;
+
+	Buffer *vertexBuffer;
+	Buffer *indexBuffer;
+	VkIndexType indexType;
+};
+
+#endif // MESH_H
@@ -0,0 +1,146 @@
+#include "meshlet.h"
+
+#include <assert.h>
+#include <math.h>
+#include <algorithm>
+#include <glm/glm.hpp>
+
+using std::vector;
+
+namespace
+{
+	class PositionReader {
+	public:
+		PositionReader(const void *positions, size_t stride) :
+			bytes(static_cast<const uint8_t *>(positions)),
+			stride(stride)
+		{
+		}
+
+		glm::vec3 operator()(uint32_t index) const
+		{
+			auto p = reinterpret_cast<const float *>(bytes + index * stride);
+			return glm::vec3(p[0], p[1], p[2]);
+		}
+
+	private:
+		const uint8_t *bytes;
+		size_t stride;
+	};
+}
+
+static MeshletBounds computeMeshletBounds(const MeshletData &data, const Meshlet &meshlet, const PositionReader &position)
+{
+	MeshletBounds bounds;
+
+	// the box center is a fine sphere center for clusters this small
+	auto boxMin = position(data.vertices[meshlet.vertexOffset]), boxMax = boxMin;
+	for (uint32_t i = 1; i < meshlet.vertexCount; ++i) {
+		auto p = position(data.vertices[meshlet.vertexOffset + i]);
+		boxMin = glm::min(boxMin, p);
+		boxMax = glm::max(boxMax, p);
+	}
+
+	auto center = (boxMin + boxMax) * 0.5f;
+	auto radius = 0.0f;
+	for (uint32_t i = 0; i < meshlet.vertexCount; ++i)
+		radius = std::max(radius, glm::length(position(data.vertices[meshlet.vertexOffset + i]) - center));
+
+	vector<glm::vec3> normals;
+	normals.reserve(meshlet.triangleCount);
+	auto axis = glm::vec3(0.0f);
+	for (uint32_t i = 0; i < meshlet.triangleCount; ++i) {
+		auto triangle = data.triangles[meshlet.triangleOffset + i];
+		auto p0 = position(data.vertices[meshlet.vertexOffset + (triangle & 0xff)]);
+		auto p1 = position(data.vertices[meshlet.vertexOffset + ((triangle >> 8) & 0xff)]);
+		auto p2 = position(data.vertices[meshlet.vertexOffset + ((triangle >> 16) & 0xff)]);
+		auto normal = glm::cross(p1 - p0, p2 - p0);
+		auto length = glm::length(normal);
+
+		// degenerate triangles don't face anywhere, and don't get drawn
+		if (length > 0.0f) {
+			normals.push_back(normal / length);
+			axis += normals.back();
+		}
+	}
+
+	auto axisLength = glm::length(axis);
+	axis = axisLength > 0.0f ? axis / axisLength : glm::vec3(0.0f);
+
+	auto minDot = 1.0f;
+	for (auto &normal : normals)
+		minDot = std::min(minDot, glm::dot(normal, axis));
+
+	for (int i = 0; i < 3; ++i) {
+		bounds.center[i] = center[i];
+		bounds.coneAxis[i] = axis[i];
+	}
+	bounds.radius = radius;
+
+	/*
+	 * The normals are all within acos(minDot) of the axis, so the cutoff is
+	 * the sine of that angle. Past 90 degrees some triangle always faces the
+	 * camera; a little margin keeps near-flat cones from culling on rounding.
+	 */
+	bounds.coneCutoff = normals.empty() || minDot <= 0.1f ? 1.0f : sqrtf(1.0f - minDot * minDot);
+	return bounds;
+}
+
+MeshletData buildMeshlets(const uint32_t *indices, size_t indexCount,
+	const void *positions, size_t positionStride, size_t vertexCount,
+	size_t maxVertices, size_t maxTriangles)
+{
+	assert(indexCount % 3 == 0);
+	assert(maxVertices >= 3 && maxVertices <= 256);
+	assert(maxTriangles >= 1);
+
+	MeshletData data;
+
+	// which meshlet a vertex was last added to, plus one, and where
+	vector<uint32_t> vertexMeshlet(vertexCount, 0);
+	vector<uint8_t> localIndices(vertexCount);
+
+	Meshlet meshlet = {};
+	for (size_t i = 0; i < indexCount; i += 3) {
+		auto meshletId = uint32_t(data.meshlets.size() + 1);
+
+		uint32_t newVertices = 0;
+		for (int j = 0; j < 3; ++j) {
+			assert(indices[i + j] < vertexCount);
+			if (vertexMeshlet[indices[i + j]] != meshletId)
+				newVertices++;
+		}
+		// repeated vertices in a degenerate triangle count twice here, which only errs on the safe side
+
+		if (meshlet.vertexCount + newVertices > maxVertices || meshlet.triangleCount + 1 > maxTriangles) {
+			data.meshlets.push_back(meshlet);
+			meshlet.vertexOffset = uint32_t(data.vertices.size());
+			meshlet.triangleOffset = uint32_t(data.triangles.size());
+			meshlet.vertexCount = meshlet.triangleCount = 0;
+			meshletId++;
+		}
+
+		uint32_t triangle = 0;
+		for (int j = 0; j < 3; ++j) {
+			auto index = indices[i + j];
+			if (vertexMeshlet[index] != meshletId) {
+				vertexMeshlet[index] = meshletId;
+				localIndices[index] = uint8_t(meshlet.vertexCount++);
+				data.vertices.push_back(index);
+			}
+			triangle |= uint32_t(localIndices[index]) << (j * 8);
+		}
+		data.triangles.push_back(triangle);
+		meshlet.triangleCount++;
+	}
+
+	if (meshlet.triangleCount > 0)
+		data.meshlets.push_back(meshlet);
+
+	PositionReader position(positions, positionStride);
+	data.bounds.reserve(data.meshlets.size());
+	for (auto &m : data.meshlets)
+		data.bounds.push_back(computeMeshletBounds(data, m, position));
+
+	return data;
+}
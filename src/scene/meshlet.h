@@ -0,0 +1,58 @@
+#ifndef MESHLET_H
+#define MESHLET_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+/*
+ * Meshlets are small clusters of an indexed triangle list, with bounds to
+ * cull them by as a whole. Each one lists the mesh vertices it uses and
+ * describes its triangles with 8-bit indices into that list.
+ *
+ * 64 vertices and 124 triangles fill a 128-invocation work group with one
+ * triangle each, and keep the triangle count a multiple of four.
+ */
+const size_t meshletMaxVertices = 64;
+const size_t meshletMaxTriangles = 124;
+
+struct Meshlet {
+	uint32_t vertexOffset;   // into MeshletData::vertices
+	uint32_t triangleOffset; // into MeshletData::triangles
+	uint32_t vertexCount;
+	uint32_t triangleCount;
+};
+
+// in the mesh's object space
+struct MeshletBounds {
+	float center[3];
+	float radius;
+
+	/*
+	 * Average normal of the triangles; all of them face away from a camera
+	 * at p when dot(center - p, coneAxis) >= coneCutoff * distance(center, p) + radius.
+	 * coneCutoff is 1 when the normals are spread too wide for that to happen.
+	 */
+	float coneAxis[3];
+	float coneCutoff;
+};
+
+struct MeshletData {
+	std::vector<Meshlet> meshlets;
+	std::vector<MeshletBounds> bounds;
+	std::vector<uint32_t> vertices;  // mesh vertex indices
+	std::vector<uint32_t> triangles; // three local vertex indices in the low 24 bits, first one lowest
+};
+
+/*
+ * Splits the triangles into meshlets in the order they come in, starting a
+ * new meshlet whenever one of the limits would be exceeded. Cache-optimized
+ * indices (see mesh-optimize.h) make for tight meshlets, random ones don't.
+ * Positions are three floats, positionStride bytes apart; normals follow
+ * the counter-clockwise winding.
+ */
+MeshletData buildMeshlets(const uint32_t *indices, size_t indexCount,
+	const void *positions, size_t positionStride, size_t vertexCount,
+	size_t maxVertices = meshletMaxVertices, size_t maxTriangles = meshletMaxTriangles);
+
+#endif // MESHLET_H
@@ -0,0 +1,390 @@
+#include "mipmap.h"
+#include "pixel-convert.h"
+
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+#include <emmintrin.h>
+
+using std::vector;
+
+namespace
+{
+	struct FilterTap {
+		int index;
+		float weight;
+	};
+
+	// taps[begins[x]] .. taps[begins[x + 1] - 1] contribute to destination pixel x
+	struct FilterTaps {
+		vector<int> begins;
+		vector<FilterTap> taps;
+	};
+
+	struct SrgbTables {
+		float toLinear[256];
+		float thresholds[255]; // linear value halfway between two codes
+
+		SrgbTables()
+		{
+			for (int i = 0; i < 256; ++i)
+				toLinear[i] = srgbToLinear(i / 255.0f);
+			for (int i = 0; i < 255; ++i)
+				thresholds[i] = srgbToLinear((i + 0.5f) / 255.0f);
+		}
+
+		static float srgbToLinear(float value)
+		{
+			return value <= 0.04045f ? value / 12.92f : powf((value + 0.055f) / 1.055f, 2.4f);
+		}
+
+		// exact round-to-nearest in sRGB space, as the table is monotonic
+		uint8_t encode(float linear) const
+		{
+			return uint8_t(std::upper_bound(thresholds, thresholds + 255, linear) - thresholds);
+		}
+	};
+}
+
+static const SrgbTables &getSrgbTables()
+{
+	static const SrgbTables tables;
+	return tables;
+}
+
+static int mipSize(int size, int mipLevel)
+{
+	return std::max(size >> mipLevel, 1);
+}
+
+static size_t getPixelSize(MipPixelFormat format)
+{
+	return format == MipPixelFormat::RGBA8 ? 4 : 8;
+}
+
+size_t layoutMipChain(MipPixelFormat format, int width, int height, int mipLevels, vector<size_t> *offsets)
+{
+	assert(offsets != nullptr);
+	offsets->clear();
+
+	size_t offset = 0;
+	for (auto mipLevel = 0; mipLevel < mipLevels; ++mipLevel) {
+		offsets->push_back(offset);
+		auto size = size_t(mipSize(width, mipLevel)) * mipSize(height, mipLevel) * getPixelSize(format);
+		offset += (size + 15) & ~size_t(15);
+	}
+	offsets->push_back(offset);
+
+	return offset;
+}
+
+static float sinc(float x)
+{
+	if (fabsf(x) < 1e-6f)
+		return 1.0f;
+	x *= 3.14159265f;
+	return sinf(x) / x;
+}
+
+static float bessel0(float x)
+{
+	float sum = 1.0f, term = 1.0f;
+	for (int k = 1; k < 32 && term > 1e-8f * sum; ++k) {
+		term *= (x * x) / (4.0f * k * k);
+		sum += term;
+	}
+	return sum;
+}
+
+static const float filterRadius = 3.0f;
+
+static float evaluateFilter(MipFilter filter, float x)
+{
+	auto t = x / filterRadius;
+	if (fabsf(t) >= 1.0f)
+		return 0.0f;
+
+	switch (filter) {
+	case MipFilter::KAISER: {
+		const float alpha = 4.0f;
+		return sinc(x) * bessel0(alpha * sqrtf(1.0f - t * t)) / bessel0(alpha);
+	}
+
+	case MipFilter::LANCZOS:
+		return sinc(x) * sinc(t);
+
+	default:
+		assert(!"unexpected filter!");
+		return 0.0f;
+	}
+}
+
+static void buildFilterTaps(int srcSize, int dstSize, MipFilter filter, FilterTaps *filterTaps)
+{
+	filterTaps->begins.clear();
+	filterTaps->taps.clear();
+
+	auto scale = float(srcSize) / dstSize;
+	for (auto x = 0; x < dstSize; ++x) {
+		filterTaps->begins.push_back(int(filterTaps->taps.size()));
+
+		if (filter == MipFilter::BOX) {
+			// weight each source pixel by how much of it the destination pixel covers;
+			// for odd sizes this gives three taps with uneven weights
+			auto lo = x * scale, hi = (x + 1) * scale;
+			for (auto i = int(floorf(lo)); i < int(ceilf(hi)); ++i) {
+				auto coverage = std::min(hi, float(i + 1)) - std::max(lo, float(i));
+				if (coverage > 0.0f)
+					filterTaps->taps.push_back({ std::min(i, srcSize - 1), coverage / scale });
+			}
+			continue;
+		}
+
+		// the kernel is defined in destination pixels, so stretch it over the source
+		auto center = (x + 0.5f) * scale;
+		auto first = int(floorf(center - filterRadius * scale));
+		auto last = int(ceilf(center + filterRadius * scale));
+
+		auto begin = filterTaps->taps.size();
+		auto sum = 0.0f;
+		for (auto i = first; i <= last; ++i) {
+			auto weight = evaluateFilter(filter, (i + 0.5f - center) / scale);
+			if (weight == 0.0f)
+				continue;
+
+			// clamp to edge
+			filterTaps->taps.push_back({ std::min(std::max(i, 0), srcSize - 1), weight });
+			sum += weight;
+		}
+
+		for (auto i = begin; i < filterTaps->taps.size(); ++i)
+			filterTaps->taps[i].weight /= sum;
+	}
+
+	filterTaps->begins.push_back(int(filterTaps->taps.size()));
+}
+
+// separable: horizontally into temp, then vertically a row at a time
+static void resample(const vector<float> &src, int srcWidth, int srcHeight, vector<float> *dst, int dstWidth, int dstHeight, MipFilter filter, vector<float> *temp)
+{
+	FilterTaps tapsX, tapsY;
+	buildFilterTaps(srcWidth, dstWidth, filter, &tapsX);
+	buildFilterTaps(srcHeight, dstHeight, filter, &tapsY);
+
+	temp->resize(size_t(dstWidth) * srcHeight * 4);
+	for (auto y = 0; y < srcHeight; ++y) {
+		auto srcRow = src.data() + size_t(y) * srcWidth * 4;
+		auto tempRow = temp->data() + size_t(y) * dstWidth * 4;
+
+		for (auto x = 0; x < dstWidth; ++x) {
+			__m128 sum = _mm_setzero_ps();
+			for (auto i = tapsX.begins[x]; i < tapsX.begins[x + 1]; ++i) {
+				auto &tap = tapsX.taps[i];
+				sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(srcRow + tap.index * 4), _mm_set1_ps(tap.weight)));
+			}
+			_mm_storeu_ps(tempRow + x * 4, sum);
+		}
+	}
+
+	dst->assign(size_t(dstWidth) * dstHeight * 4, 0.0f);
+	for (auto y = 0; y < dstHeight; ++y) {
+		auto dstRow = dst->data() + size_t(y) * dstWidth * 4;
+
+		for (auto i = tapsY.begins[y]; i < tapsY.begins[y + 1]; ++i) {
+			auto &tap = tapsY.taps[i];
+			auto tempRow = temp->data() + size_t(tap.index) * dstWidth * 4;
+			__m128 weight = _mm_set1_ps(tap.weight);
+
+			for (auto x = 0; x < dstWidth * 4; x += 4)
+				_mm_storeu_ps(dstRow + x, _mm_add_ps(_mm_loadu_ps(dstRow + x), _mm_mul_ps(_mm_loadu_ps(tempRow + x), weight)));
+		}
+	}
+}
+
+// the common case: integer 2x2 average of plain RGBA8, two output pixels per step
+static void downsampleBox2x2RGBA8(const uint8_t *src, int srcWidth, int srcHeight, uint8_t *dst)
+{
+	assert(srcWidth % 2 == 0 && srcHeight % 2 == 0);
+	auto dstWidth = srcWidth / 2, dstHeight = srcHeight / 2;
+
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i two = _mm_set1_epi16(2);
+
+	for (auto y = 0; y < dstHeight; ++y) {
+		auto row0 = src + size_t(y) * 2 * srcWidth * 4;
+		auto row1 = row0 + size_t(srcWidth) * 4;
+		auto dstRow = dst + size_t(y) * dstWidth * 4;
+
+		auto x = 0;
+		for (; x + 2 <= dstWidth; x += 2) {
+			__m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row0 + x * 8));
+			__m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row1 + x * 8));
+
+			// sum vertically, then add neighbouring pixels
+			__m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+			__m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+			__m128i sum = _mm_add_epi16(_mm_unpacklo_epi64(lo, hi), _mm_unpackhi_epi64(lo, hi));
+
+			sum = _mm_srli_epi16(_mm_add_epi16(sum, two), 2);
+			_mm_storel_epi64(reinterpret_cast<__m128i *>(dstRow + x * 4), _mm_packus_epi16(sum, sum));
+		}
+
+		for (; x < dstWidth; ++x) {
+			for (auto c = 0; c < 4; ++c)
+				dstRow[x * 4 + c] = uint8_t((row0[x * 8 + c] + row0[x * 8 + 4 + c] + row1[x * 8 + c] + row1[x * 8 + 4 + c] + 2) >> 2);
+		}
+	}
+}
+
+static void loadLevel(const uint8_t *src, size_t pixelCount, const MipChainOptions &options, vector<float> *pixels)
+{
+	pixels->resize(pixelCount * 4);
+
+	if (options.format == MipPixelFormat::RGBA16F) {
+		convertRowRGBA16FToRGBA32F(reinterpret_cast<const uint16_t *>(src), pixels->data(), pixelCount);
+		return;
+	}
+
+	if (options.srgb) {
+		auto &tables = getSrgbTables();
+		for (size_t i = 0; i < pixelCount; ++i) {
+			auto pixel = src + i * 4;
+			auto dst = pixels->data() + i * 4;
+			dst[0] = tables.toLinear[pixel[0]];
+			dst[1] = tables.toLinear[pixel[1]];
+			dst[2] = tables.toLinear[pixel[2]];
+			dst[3] = pixel[3] / 255.0f;
+		}
+		return;
+	}
+
+	const __m128i zero = _mm_setzero_si128();
+	const __m128 scale = _mm_set1_ps(1.0f / 255.0f);
+	for (size_t i = 0; i < pixelCount; ++i) {
+		int packed;
+		memcpy(&packed, src + i * 4, sizeof(packed));
+		__m128i wide = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(packed), zero), zero);
+		_mm_storeu_ps(pixels->data() + i * 4, _mm_mul_ps(_mm_cvtepi32_ps(wide), scale));
+	}
+}
+
+static void storeLevel(const vector<float> &pixels, float alphaScale, const MipChainOptions &options, uint8_t *dst)
+{
+	auto pixelCount = pixels.size() / 4;
+	__m128 scale = _mm_setr_ps(1.0f, 1.0f, 1.0f, alphaScale);
+
+	if (options.format == MipPixelFormat::RGBA16F) {
+		// one row's worth at a time keeps the scratch buffer small
+		const size_t chunkSize = 256;
+		float scaled[chunkSize * 4];
+		for (size_t begin = 0; begin < pixelCount; begin += chunkSize) {
+			auto count = std::min(chunkSize, pixelCount - begin);
+			for (size_t i = 0; i < count; ++i)
+				_mm_storeu_ps(scaled + i * 4, _mm_mul_ps(_mm_loadu_ps(&pixels[(begin + i) * 4]), scale));
+			convertRowRGBA32FToRGBA16F(scaled, reinterpret_cast<uint16_t *>(dst) + begin * 4, count);
+		}
+		return;
+	}
+
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+
+	if (options.srgb) {
+		auto &tables = getSrgbTables();
+		for (size_t i = 0; i < pixelCount; ++i) {
+			alignas(16) float pixel[4];
+			_mm_store_ps(pixel, _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(&pixels[i * 4]), scale), zero), one));
+
+			dst[i * 4 + 0] = tables.encode(pixel[0]);
+			dst[i * 4 + 1] = tables.encode(pixel[1]);
+			dst[i * 4 + 2] = tables.encode(pixel[2]);
+			dst[i * 4 + 3] = uint8_t(pixel[3] * 255.0f + 0.5f);
+		}
+		return;
+	}
+
+	const __m128 maxValue = _mm_set1_ps(255.0f);
+	for (size_t i = 0; i < pixelCount; ++i) {
+		__m128 pixel = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(&pixels[i * 4]), scale), zero), one);
+		__m128i values = _mm_cvtps_epi32(_mm_mul_ps(pixel, maxValue));
+		values = _mm_packs_epi32(values, values);
+		values = _mm_packus_epi16(values, values);
+
+		auto packed = _mm_cvtsi128_si32(values);
+		memcpy(dst + i * 4, &packed, sizeof(packed));
+	}
+}
+
+static float computeAlphaCoverage(const vector<float> &pixels, float cutoff, float alphaScale)
+{
+	auto pixelCount = pixels.size() / 4;
+	if (pixelCount == 0)
+		return 0.0f;
+
+	size_t covered = 0;
+	for (size_t i = 0; i < pixelCount; ++i) {
+		if (pixels[i * 4 + 3] * alphaScale > cutoff)
+			covered++;
+	}
+	return float(covered) / pixelCount;
+}
+
+// bisect for the alpha scale that brings the coverage closest to the target
+static float findAlphaScale(const vector<float> &pixels, float cutoff, float targetCoverage)
+{
+	float lo = 0.0f, hi = 4.0f;
+	for (int i = 0; i < 16; ++i) {
+		auto mid = (lo + hi) * 0.5f;
+		if (computeAlphaCoverage(pixels, cutoff, mid) < targetCoverage)
+			lo = mid;
+		else
+			hi = mid;
+	}
+	return (lo + hi) * 0.5f;
+}
+
+void generateMipChain(uint8_t *data, const vector<size_t> &offsets, int width, int height, int mipLevels, const MipChainOptions &options)
+{
+	assert(offsets.size() >= size_t(mipLevels) + 1);
+	assert(!options.srgb || options.format == MipPixelFormat::RGBA8);
+
+	// the float chain is kept unquantized and without alpha scaling, so the
+	// levels don't accumulate rounding and coverage corrections
+	vector<float> current, next, temp;
+	bool haveCurrent = false;
+	float targetCoverage = 0.0f;
+
+	for (auto mipLevel = 1; mipLevel < mipLevels; ++mipLevel) {
+		auto srcWidth = mipSize(width, mipLevel - 1), srcHeight = mipSize(height, mipLevel - 1);
+		auto dstWidth = mipSize(width, mipLevel), dstHeight = mipSize(height, mipLevel);
+		auto src = data + offsets[mipLevel - 1];
+		auto dst = data + offsets[mipLevel];
+
+		if (options.format == MipPixelFormat::RGBA8 && !options.srgb &&
+		    options.filter == MipFilter::BOX && options.alphaCutoff <= 0.0f &&
+		    srcWidth % 2 == 0 && srcHeight % 2 == 0) {
+			downsampleBox2x2RGBA8(src, srcWidth, srcHeight, dst);
+			haveCurrent = false;
+			continue;
+		}
+
+		if (!haveCurrent)
+			loadLevel(src, size_t(srcWidth) * srcHeight, options, &current);
+
+		if (mipLevel == 1 && options.alphaCutoff > 0.0f)
+			targetCoverage = computeAlphaCoverage(current, options.alphaCutoff, 1.0f);
+
+		resample(current, srcWidth, srcHeight, &next, dstWidth, dstHeight, options.filter, &temp);
+
+		auto alphaScale = 1.0f;
+		if (options.alphaCutoff > 0.0f)
+			alphaScale = findAlphaScale(next, options.alphaCutoff, targetCoverage);
+
+		storeLevel(next, alphaScale, options, dst);
+
+		current.swap(next);
+		haveCurrent = true;
+	}
+}
@@ -0,0 +1,41 @@
+#ifndef MIPMAP_H
+#define MIPMAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+enum class MipPixelFormat {
+	RGBA8,
+	RGBA16F
+};
+
+enum class MipFilter {
+	BOX,     // exact area coverage, also for odd sizes
+	KAISER,  // Kaiser-windowed sinc, sharper
+	LANCZOS  // Lanczos-3, sharpest, may ring
+};
+
+struct MipChainOptions {
+	MipPixelFormat format;
+	MipFilter filter;
+
+	// RGBA8 only: the color channels are sRGB-encoded, average in linear space
+	bool srgb;
+
+	// if > 0, scale alpha per level so the share of pixels above this
+	// cutoff stays the same as in level 0; for alpha-tested textures
+	float alphaCutoff;
+};
+
+/*
+ * Lays out a full chain of tightly packed levels in one allocation. offsets
+ * gets mipLevels + 1 entries, each level starting 16-byte aligned; the last
+ * entry is the total size.
+ */
+size_t layoutMipChain(MipPixelFormat format, int width, int height, int mipLevels, std::vector<size_t> *offsets);
+
+// fills levels 1 .. mipLevels - 1 from level 0, which must already be in place
+void generateMipChain(uint8_t *data, const std::vector<size_t> &offsets, int width, int height, int mipLevels, const MipChainOptions &options);
+
+#endif // MIPMAP_H
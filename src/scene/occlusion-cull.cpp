@@ -0,0 +1,51 @@
+#include "occlusion-cull.h"
+
+using namespace vulkan;
+
+OcclusionCullState::OcclusionCullState(uint32_t objectCount) :
+	objectCount(objectCount),
+	cleared(false)
+{
+	assert(objectCount > 0);
+
+	visibilityBuffer = new Buffer(VkDeviceSize(objectCount) * sizeof(uint32_t),
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	dispatchCommandBuffer = new Buffer(VkDeviceSize(objectCount) * sizeof(VkDispatchIndirectCommand),
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+}
+
+OcclusionCullState::~OcclusionCullState()
+{
+	delete visibilityBuffer;
+	delete dispatchCommandBuffer;
+}
+
+void OcclusionCullState::beginCull(VkCommandBuffer commandBuffer)
+{
+	if (!cleared) {
+		vkCmdFillBuffer(commandBuffer, visibilityBuffer->getBuffer(), 0, VK_WHOLE_SIZE, 0);
+		bufferBarrier(commandBuffer, visibilityBuffer->getBuffer(), 0, VK_WHOLE_SIZE,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+		cleared = true;
+	}
+
+	// the previous phase, or frame, may still be dispatching from these, or reading them in a shader
+	bufferBarrier(commandBuffer, dispatchCommandBuffer->getBuffer(), 0, VK_WHOLE_SIZE,
+		VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT);
+
+	// and the late phase of the previous frame wrote the flags
+	bufferBarrier(commandBuffer, visibilityBuffer->getBuffer(), 0, VK_WHOLE_SIZE,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+}
+
+void OcclusionCullState::endCull(VkCommandBuffer commandBuffer)
+{
+	bufferBarrier(commandBuffer, dispatchCommandBuffer->getBuffer(), 0, VK_WHOLE_SIZE,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT);
+}
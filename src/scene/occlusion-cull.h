@@ -0,0 +1,94 @@
+#ifndef OCCLUSION_CULL_H
+#define OCCLUSION_CULL_H
+
+#include "buffer.h"
+#include "bounding-box.h"
+
+#include <glm/glm.hpp>
+
+// one per object, in a storage buffer; matches CullObject in occlusion-cull.comp
+struct OcclusionCullObject {
+	glm::vec3 boundsMin; // world space
+	uint32_t meshletCount;
+	glm::vec3 boundsMax;
+	uint32_t padding;
+
+	OcclusionCullObject(const BoundingBox &bounds, uint32_t meshletCount) :
+		boundsMin(bounds.min),
+		meshletCount(meshletCount),
+		boundsMax(bounds.max),
+		padding(0)
+	{
+	}
+};
+static_assert(sizeof(OcclusionCullObject) == 32, "OcclusionCullObject must match the std430 layout");
+
+// push constants of occlusion-cull.comp
+struct OcclusionCullConstants {
+	enum Phase {
+		// objects that were visible last frame, before there's any depth
+		EARLY_PHASE,
+		// everything, against the depth pyramid of what the early phase drew
+		LATE_PHASE
+	};
+
+	glm::mat4 viewProjection;
+	int32_t depthWidth, depthHeight;
+	uint32_t objectCount;
+	uint32_t phase;
+
+	OcclusionCullConstants(const glm::mat4 &viewProjection, int depthWidth, int depthHeight, uint32_t objectCount, Phase phase) :
+		viewProjection(viewProjection),
+		depthWidth(depthWidth),
+		depthHeight(depthHeight),
+		objectCount(objectCount),
+		phase(phase)
+	{
+	}
+};
+
+/*
+ * Two-phase occlusion culling of whole objects. Each object has a
+ * visibility flag that persists from frame to frame, and a
+ * VkDispatchIndirectCommand that sizes its cluster-cull.comp dispatch, so
+ * an object that's culled has no meshlets culled, and draws nothing.
+ * cluster-cull-batched.comp reads the same commands from a shader.
+ *
+ * The early phase dispatches the objects that were visible last frame;
+ * once they're drawn, the depth pyramid is built from them and the late
+ * phase tests everything against it, dispatches the objects that became
+ * visible, and updates the flags. Each phase goes between beginCull() and
+ * endCull(), which put the barriers around it.
+ */
+class OcclusionCullState {
+public:
+	explicit OcclusionCullState(uint32_t objectCount);
+	~OcclusionCullState();
+
+	uint32_t getObjectCount() const { return objectCount; }
+
+	const Buffer &getVisibilityBuffer() const { return *visibilityBuffer; }
+	const Buffer &getDispatchCommandBuffer() const { return *dispatchCommandBuffer; }
+
+	VkDeviceSize getDispatchCommandOffset(uint32_t object) const
+	{
+		assert(object < objectCount);
+		return VkDeviceSize(object) * sizeof(VkDispatchIndirectCommand);
+	}
+
+	void beginCull(VkCommandBuffer commandBuffer);
+	void endCull(VkCommandBuffer commandBuffer);
+
+private:
+	OcclusionCullState(const OcclusionCullState &) = delete;
+	OcclusionCullState &operator=(const OcclusionCullState &) = delete;
+
+	uint32_t objectCount;
+	Buffer *visibilityBuffer;
+	Buffer *dispatchCommandBuffer;
+
+	// nothing's been visible yet; the flags get cleared by the first beginCull()
+	bool cleared;
+};
+
+#endif // OCCLUSION_CULL_H
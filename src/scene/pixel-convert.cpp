@@ -0,0 +1,246 @@
+#include "pixel-convert.h"
+#include "../core/cpuinfo.h"
+
+#include <string.h>
+
+#include <emmintrin.h>
+#include <immintrin.h>
+
+uint16_t floatToHalf(float value)
+{
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+
+	uint32_t sign = (bits >> 16) & 0x8000;
+	uint32_t exponent = (bits >> 23) & 0xff;
+	uint32_t mantissa = bits & 0x7fffff;
+
+	// infinity and NaN, keeping NaNs quiet
+	if (exponent == 0xff)
+		return uint16_t(sign | 0x7c00 | (mantissa != 0 ? 0x200 | (mantissa >> 13) : 0));
+
+	int halfExponent = int(exponent) - 127 + 15;
+	if (halfExponent >= 0x1f)
+		return uint16_t(sign | 0x7c00);
+
+	if (halfExponent <= 0) {
+		// denormal or zero; shift the implicit one in, then round
+		if (halfExponent < -10)
+			return uint16_t(sign);
+
+		mantissa |= 0x800000;
+		auto shift = uint32_t(14 - halfExponent);
+		auto half = mantissa >> shift;
+		auto rest = mantissa & ((1u << shift) - 1);
+		auto halfway = 1u << (shift - 1);
+		if (rest > halfway || (rest == halfway && (half & 1)))
+			half++;
+		return uint16_t(sign | half);
+	}
+
+	// a carry out of the mantissa correctly bumps the exponent, up to infinity
+	uint32_t half = (uint32_t(halfExponent) << 10) | (mantissa >> 13);
+	auto rest = mantissa & 0x1fff;
+	if (rest > 0x1000 || (rest == 0x1000 && (half & 1)))
+		half++;
+	return uint16_t(sign | half);
+}
+
+float halfToFloat(uint16_t value)
+{
+	uint32_t sign = uint32_t(value & 0x8000) << 16;
+	uint32_t exponent = (value >> 10) & 0x1f;
+	uint32_t mantissa = value & 0x3ff;
+
+	uint32_t bits;
+	if (exponent == 0x1f)
+		bits = sign | 0x7f800000 | (mantissa != 0 ? 0x400000 | (mantissa << 13) : 0);
+	else if (exponent != 0)
+		bits = sign | ((exponent - 15 + 127) << 23) | (mantissa << 13);
+	else if (mantissa == 0)
+		bits = sign;
+	else {
+		// denormal; normalize the mantissa
+		exponent = 127 - 15 + 1;
+		while (!(mantissa & 0x400)) {
+			mantissa <<= 1;
+			exponent--;
+		}
+		bits = sign | (exponent << 23) | ((mantissa & 0x3ff) << 13);
+	}
+
+	float ret;
+	memcpy(&ret, &bits, sizeof(ret));
+	return ret;
+}
+
+// what the kernels may use; all of what the CPU has, unless restricted
+static CpuFeatures kernelFeatures = getCpuFeatures();
+
+void restrictPixelConvertFeatures(const CpuFeatures &features)
+{
+	auto &detected = getCpuFeatures();
+	kernelFeatures.sse41 = detected.sse41 && features.sse41;
+	kernelFeatures.ssse3 = detected.ssse3 && features.ssse3;
+	kernelFeatures.avx = detected.avx && features.avx;
+	kernelFeatures.avx2 = detected.avx2 && features.avx2;
+	kernelFeatures.f16c = detected.f16c && features.f16c;
+}
+
+static void swizzleRow8Scalar(const uint8_t *src, uint8_t *dst, size_t begin, size_t width, const uint8_t order[4])
+{
+	for (auto x = begin; x < width; ++x) {
+		dst[x * 4 + 0] = src[x * 4 + order[0]];
+		dst[x * 4 + 1] = src[x * 4 + order[1]];
+		dst[x * 4 + 2] = src[x * 4 + order[2]];
+		dst[x * 4 + 3] = src[x * 4 + order[3]];
+	}
+}
+
+static __m128i makeShuffleMask(const uint8_t order[4])
+{
+	alignas(16) uint8_t mask[16];
+	for (int i = 0; i < 16; ++i)
+		mask[i] = uint8_t((i & ~3) + order[i & 3]);
+	return _mm_load_si128(reinterpret_cast<const __m128i *>(mask));
+}
+
+TARGET_SSSE3 static void swizzleRow8SSSE3(const uint8_t *src, uint8_t *dst, size_t width, const uint8_t order[4])
+{
+	__m128i mask = makeShuffleMask(order);
+
+	size_t x = 0;
+	for (; x + 4 <= width; x += 4) {
+		__m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + x * 4));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(dst + x * 4), _mm_shuffle_epi8(pixels, mask));
+	}
+
+	swizzleRow8Scalar(src, dst, x, width, order);
+}
+
+// vpshufb shuffles within 128-bit lanes, which is all a per-pixel swizzle needs
+TARGET_AVX2 static void swizzleRow8AVX2(const uint8_t *src, uint8_t *dst, size_t width, const uint8_t order[4])
+{
+	__m128i mask128 = makeShuffleMask(order);
+	__m256i mask = _mm256_inserti128_si256(_mm256_castsi128_si256(mask128), mask128, 1);
+
+	size_t x = 0;
+	for (; x + 8 <= width; x += 8) {
+		__m256i pixels = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + x * 4));
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + x * 4), _mm256_shuffle_epi8(pixels, mask));
+	}
+
+	for (; x + 4 <= width; x += 4) {
+		__m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + x * 4));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(dst + x * 4), _mm_shuffle_epi8(pixels, mask128));
+	}
+
+	swizzleRow8Scalar(src, dst, x, width, order);
+}
+
+void swizzleRow8(const uint8_t *src, uint8_t *dst, size_t width, const uint8_t order[4])
+{
+	if (kernelFeatures.avx2)
+		swizzleRow8AVX2(src, dst, width, order);
+	else if (kernelFeatures.ssse3)
+		swizzleRow8SSSE3(src, dst, width, order);
+	else
+		swizzleRow8Scalar(src, dst, 0, width, order);
+}
+
+static void convertRowRGB32FToRGBA16FScalar(const float *src, uint16_t *dst, size_t begin, size_t width)
+{
+	const uint16_t one = floatToHalf(1.0f);
+	for (auto x = begin; x < width; ++x) {
+		dst[x * 4 + 0] = floatToHalf(src[x * 3 + 0]);
+		dst[x * 4 + 1] = floatToHalf(src[x * 3 + 1]);
+		dst[x * 4 + 2] = floatToHalf(src[x * 3 + 2]);
+		dst[x * 4 + 3] = one;
+	}
+}
+
+/*
+ * Four pixels per iteration: the twelve floats are read as four overlapping
+ * vectors that each start at a pixel, so nothing past the row is touched.
+ * Alpha is blended in, and each pair of pixels is converted eight wide.
+ */
+TARGET_AVX_F16C static void convertRowRGB32FToRGBA16FF16C(const float *src, uint16_t *dst, size_t width)
+{
+	const __m128 one = _mm_set1_ps(1.0f);
+
+	size_t x = 0;
+	for (; x + 4 <= width; x += 4) {
+		auto in = src + x * 3;
+		__m128 p0 = _mm_blend_ps(_mm_loadu_ps(in + 0), one, 8);
+		__m128 p1 = _mm_blend_ps(_mm_loadu_ps(in + 3), one, 8);
+		__m128 p2 = _mm_blend_ps(_mm_loadu_ps(in + 6), one, 8);
+		__m128 p3 = _mm_loadu_ps(in + 8); // b2 r3 g3 b3
+		p3 = _mm_blend_ps(_mm_shuffle_ps(p3, p3, _MM_SHUFFLE(3, 3, 2, 1)), one, 8);
+
+		__m128i h01 = _mm256_cvtps_ph(_mm256_insertf128_ps(_mm256_castps128_ps256(p0), p1, 1), 0);
+		__m128i h23 = _mm256_cvtps_ph(_mm256_insertf128_ps(_mm256_castps128_ps256(p2), p3, 1), 0);
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(dst + x * 4 + 0), h01);
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(dst + x * 4 + 8), h23);
+	}
+
+	// the rest one pixel at a time, four wide
+	for (; x < width; ++x) {
+		auto in = src + x * 3;
+		__m128 pixel = _mm_setr_ps(in[0], in[1], in[2], 1.0f);
+		_mm_storel_epi64(reinterpret_cast<__m128i *>(dst + x * 4), _mm_cvtps_ph(pixel, 0));
+	}
+}
+
+void convertRowRGB32FToRGBA16F(const float *src, uint16_t *dst, size_t width)
+{
+	if (kernelFeatures.f16c)
+		convertRowRGB32FToRGBA16FF16C(src, dst, width);
+	else
+		convertRowRGB32FToRGBA16FScalar(src, dst, 0, width);
+}
+
+TARGET_AVX_F16C static void convertRowRGBA32FToRGBA16FF16C(const float *src, uint16_t *dst, size_t width)
+{
+	size_t x = 0;
+	for (; x + 2 <= width; x += 2) {
+		__m128i half = _mm256_cvtps_ph(_mm256_loadu_ps(src + x * 4), 0);
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(dst + x * 4), half);
+	}
+
+	if (x < width)
+		_mm_storel_epi64(reinterpret_cast<__m128i *>(dst + x * 4), _mm_cvtps_ph(_mm_loadu_ps(src + x * 4), 0));
+}
+
+TARGET_AVX_F16C static void convertRowRGBA16FToRGBA32FF16C(const uint16_t *src, float *dst, size_t width)
+{
+	size_t x = 0;
+	for (; x + 2 <= width; x += 2) {
+		__m128i half = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + x * 4));
+		_mm256_storeu_ps(dst + x * 4, _mm256_cvtph_ps(half));
+	}
+
+	if (x < width)
+		_mm_storeu_ps(dst + x * 4, _mm_cvtph_ps(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(src + x * 4))));
+}
+
+void convertRowRGBA32FToRGBA16F(const float *src, uint16_t *dst, size_t width)
+{
+	if (kernelFeatures.f16c) {
+		convertRowRGBA32FToRGBA16FF16C(src, dst, width);
+		return;
+	}
+
+	for (size_t i = 0; i < width * 4; ++i)
+		dst[i] = floatToHalf(src[i]);
+}
+
+void convertRowRGBA16FToRGBA32F(const uint16_t *src, float *dst, size_t width)
+{
+	if (kernelFeatures.f16c) {
+		convertRowRGBA16FToRGBA32FF16C(src, dst, width);
+		return;
+	}
+
+	for (size_t i = 0; i < width * 4; ++i)
+		dst[i] = halfToFloat(src[i]);
+}
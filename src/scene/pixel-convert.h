@@ -0,0 +1,30 @@
+#ifndef PIXEL_CONVERT_H
+#define PIXEL_CONVERT_H
+
+#include "../core/cpuinfo.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Row conversion kernels for texture import. The fastest variant the CPU
+ * supports is picked at runtime; all variants produce identical output.
+ */
+
+// limits the kernels to a subset of the CPU's features, so each variant can be measured
+void restrictPixelConvertFeatures(const CpuFeatures &features);
+
+// dst[x * 4 + c] = src[x * 4 + order[c]], for 8-bit four-channel pixels
+void swizzleRow8(const uint8_t *src, uint8_t *dst, size_t width, const uint8_t order[4]);
+
+// RGB floats to RGBA halfs with alpha set to one, rounding to nearest even
+void convertRowRGB32FToRGBA16F(const float *src, uint16_t *dst, size_t width);
+
+// four floats per pixel to halfs and back; values are passed through as is
+void convertRowRGBA32FToRGBA16F(const float *src, uint16_t *dst, size_t width);
+void convertRowRGBA16FToRGBA32F(const uint16_t *src, float *dst, size_t width);
+
+uint16_t floatToHalf(float value);
+float halfToFloat(uint16_t value);
+
+#endif // PIXEL_CONVERT_H
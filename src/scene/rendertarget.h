@@ -5,12 +5,13 @@
 
 class RenderTargetBase {
 protected:
-	RenderTargetBase(VkFormat format, VkImageType imageType, VkImageViewType imageViewType, int width, int height, int depth, int arrayLayers, VkImageUsageFlags usage, VkImageAspectFlags aspect) :
+	RenderTargetBase(VkFormat format, VkImageType imageType, VkImageViewType imageViewType, int width, int height, int depth, int arrayLayers, int mipLevels, VkImageUsageFlags usage, VkImageAspectFlags aspect) :
 		format(format),
 		width(width),
 		height(height),
 		depth(depth),
-		arrayLayers(arrayLayers)
+		arrayLayers(arrayLayers),
+		mipLevels(mipLevels)
 	{
 		VkImageCreateInfo imageCreateInfo = {};
 		imageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
@@ -18,7 +19,7 @@ protected:
 		imageCreateInfo.imageType = imageType;
 		imageCreateInfo.format = format;
 		imageCreateInfo.extent = { (uint32_t)width, (uint32_t)height, (uint32_t)depth };
-		imageCreateInfo.mipLevels = 1;
+		imageCreateInfo.mipLevels = mipLevels;
 		imageCreateInfo.arrayLayers = arrayLayers;
 		imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
 		imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
@@ -32,23 +33,32 @@ protected:
 		VkMemoryRequirements memoryRequirements;
 		vkGetImageMemoryRequirements(device, image, &memoryRequirements);
 
-		auto memoryTypeIndex = getMemoryTypeIndex(memoryRequirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-		auto deviceMemory = allocateDeviceMemory(memoryRequirements.size, memoryTypeIndex);
+		memory = allocateDeviceMemory(memoryRequirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, false);
 
-		err = vkBindImageMemory(device, image, deviceMemory, 0);
+		err = vkBindImageMemory(device, image, memory.deviceMemory, memory.offset);
 		assert(err == VK_SUCCESS);
 
 		VkImageSubresourceRange subresourceRange;
 		subresourceRange.aspectMask = aspect;
 		subresourceRange.baseMipLevel = 0;
 		subresourceRange.baseArrayLayer = 0;
-		subresourceRange.levelCount = 1;
+		subresourceRange.levelCount = mipLevels;
 		subresourceRange.layerCount = arrayLayers;
 
 		imageView = createImageView(image, imageViewType, format, subresourceRange);
 	}
 
 public:
+	virtual ~RenderTargetBase()
+	{
+		vkDestroyImageView(device, imageView, nullptr);
+		vkDestroyImage(device, image, nullptr);
+		freeDeviceMemory(memory);
+	}
+
+	RenderTargetBase(const RenderTargetBase &) = delete;
+	RenderTargetBase &operator=(const RenderTargetBase &) = delete;
+
 	VkFormat getFormat() { return format; }
 
 	int getWidth() const { return width; }
@@ -56,6 +66,7 @@ public:
 	int getDepth() const { return depth; }
 
 	int getArrayLayers() const { return arrayLayers; }
+	int getMipLevels() const { return mipLevels; }
 
 	VkImage getImage() { return image; }
 	VkImageView getImageView() { return imageView; }
@@ -65,15 +76,17 @@ protected:
 
 	int width, height, depth;
 	int arrayLayers;
+	int mipLevels;
 
 	VkImage image;
 	VkImageView imageView;
+	DeviceMemoryAllocation memory;
 };
 
 class ColorRenderTarget : public RenderTargetBase {
 public:
 	ColorRenderTarget(VkFormat format, int width, int height, VkImageUsageFlags usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT) :
-		RenderTargetBase(format, VK_IMAGE_TYPE_2D, VK_IMAGE_VIEW_TYPE_2D, width, height, 1, 1, usage, VK_IMAGE_ASPECT_COLOR_BIT)
+		RenderTargetBase(format, VK_IMAGE_TYPE_2D, VK_IMAGE_VIEW_TYPE_2D, width, height, 1, 1, 1, usage, VK_IMAGE_ASPECT_COLOR_BIT)
 	{
 	}
 };
@@ -81,7 +94,7 @@ public:
 class DepthRenderTarget : public RenderTargetBase {
 public:
 	DepthRenderTarget(VkFormat format, int width, int height, VkImageUsageFlags usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT) :
-		RenderTargetBase(format, VK_IMAGE_TYPE_2D, VK_IMAGE_VIEW_TYPE_2D, width, height, 1, 1, usage, VK_IMAGE_ASPECT_DEPTH_BIT)
+		RenderTargetBase(format, VK_IMAGE_TYPE_2D, VK_IMAGE_VIEW_TYPE_2D, width, height, 1, 1, 1, usage, VK_IMAGE_ASPECT_DEPTH_BIT)
 	{
 	}
 };
@@ -89,7 +102,7 @@ public:
 class Texture2DArrayRenderTarget : public RenderTargetBase {
 public:
 	Texture2DArrayRenderTarget(VkFormat format, int width, int height, int arrayLayers, VkImageUsageFlags usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT) :
-		RenderTargetBase(format, VK_IMAGE_TYPE_2D, VK_IMAGE_VIEW_TYPE_2D_ARRAY, width, height, 1, arrayLayers, usage, VK_IMAGE_ASPECT_COLOR_BIT)
+		RenderTargetBase(format, VK_IMAGE_TYPE_2D, VK_IMAGE_VIEW_TYPE_2D_ARRAY, width, height, 1, arrayLayers, 1, usage, VK_IMAGE_ASPECT_COLOR_BIT)
 	{
 		arrayImageViews.reserve(arrayLayers);
 		for (int i = 0; i < arrayLayers; ++i) {
@@ -103,6 +116,12 @@ public:
 		}
 	}
 
+	~Texture2DArrayRenderTarget()
+	{
+		for (auto arrayImageView : arrayImageViews)
+			vkDestroyImageView(device, arrayImageView, nullptr);
+	}
+
 	const std::vector<VkImageView> &getArrayImageViews() const
 	{
 		return arrayImageViews;
@@ -112,4 +131,65 @@ private:
 	std::vector<VkImageView> arrayImageViews;
 };
 
+/*
+ * Hierarchical-Z for occlusion culling: the farthest depth of every 2x2
+ * block of the level below, all the way down to 1x1. Level 0 is half the
+ * size of the depth buffer it's built from, rounded up, so a texel of
+ * level n covers exactly 2^(n+1) depth pixels square. Built by
+ * depth-reduce.comp, one level at a time through getMipImageViews().
+ */
+class DepthPyramidRenderTarget : public RenderTargetBase {
+public:
+	DepthPyramidRenderTarget(int depthWidth, int depthHeight) :
+		RenderTargetBase(VK_FORMAT_R32_SFLOAT, VK_IMAGE_TYPE_2D, VK_IMAGE_VIEW_TYPE_2D,
+			halve(depthWidth, 1), halve(depthHeight, 1), 1, 1,
+			getLevelCount(depthWidth, depthHeight),
+			VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_IMAGE_ASPECT_COLOR_BIT)
+	{
+		mipImageViews.reserve(mipLevels);
+		for (int i = 0; i < mipLevels; ++i) {
+			VkImageSubresourceRange subresourceRange;
+			subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			subresourceRange.baseMipLevel = i;
+			subresourceRange.baseArrayLayer = 0;
+			subresourceRange.levelCount = 1;
+			subresourceRange.layerCount = 1;
+			mipImageViews.push_back(createImageView(image, VK_IMAGE_VIEW_TYPE_2D, format, subresourceRange));
+		}
+	}
+
+	~DepthPyramidRenderTarget()
+	{
+		for (auto mipImageView : mipImageViews)
+			vkDestroyImageView(device, mipImageView, nullptr);
+	}
+
+	int getMipWidth(int level) const { return halve(width, level); }
+	int getMipHeight(int level) const { return halve(height, level); }
+
+	const std::vector<VkImageView> &getMipImageViews() const
+	{
+		return mipImageViews;
+	}
+
+private:
+	// halved and rounded up, so odd edges are still covered
+	static int halve(int size, int times)
+	{
+		for (int i = 0; i < times; ++i)
+			size = (size + 1) / 2;
+		return std::max(size, 1);
+	}
+
+	static int getLevelCount(int depthWidth, int depthHeight)
+	{
+		int levels = 1;
+		while (halve(depthWidth, levels) > 1 || halve(depthHeight, levels) > 1)
+			levels++;
+		return levels;
+	}
+
+	std::vector<VkImageView> mipImageViews;
+};
+
 #endif // RENDERTARGET_H
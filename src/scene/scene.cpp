@@ -0,0 +1,23 @@
+#include "scene.h"
+
+void Scene::updateWorldMatrices(ThreadPool &threadPool)
+{
+	transforms.updateWorldMatrices(threadPool);
+
+	const size_t grainSize = 1024;
+	threadPool.parallelFor(objects.size(), grainSize, [&](size_t begin, size_t end) {
+		for (auto i = begin; i < end; ++i) {
+			auto &object = objects[i];
+			worldBounds[i] = object.getModel()->getBounds().transformed(transforms.getWorldMatrix(object.getTransform()));
+		}
+	});
+
+	for (size_t i = 0; i < objects.size(); ++i) {
+		if (objectLeaves[i] == BoundingVolumeHierarchy::invalidNode)
+			objectLeaves[i] = objectHierarchy.insert(uint32_t(i), worldBounds[i]);
+		else
+			objectHierarchy.update(objectLeaves[i], worldBounds[i]);
+	}
+
+	objectHierarchy.refit();
+}
@@ -2,28 +2,11 @@
 #define SCENE_H
 
 #include "texture.h"
+#include "transformstore.h"
+#include "mesh.h"
+#include "bvh.h"
 
-struct Vertex {
-	glm::vec3 position;
-	glm::vec3 normal, tangent, binormal;
-	glm::vec2 uv[8];
-};
-
-class Mesh {
-public:
-	Mesh(const std::vector<Vertex> &vertices, const std::vector<uint32_t> &indices) :
-		vertices(vertices),
-		indices(indices)
-	{
-	}
-
-	const std::vector<Vertex> getVertices() const { return vertices; }
-	const std::vector<uint32_t> getIndices() const { return indices; }
-
-private:
-	std::vector<Vertex> vertices;
-	std::vector<uint32_t> indices;
-};
+#include <stdexcept>
 
 class Material {
 	Texture2D *albedoMap;
@@ -45,6 +28,9 @@ public:
 	const Mesh *getMesh() const { return mesh; }
 	const Material *getMaterial() const { return material; }
 
+	// object space
+	const BoundingBox &getBounds() const { return mesh->getBounds(); }
+
 private:
 	const Mesh *mesh;
 	const Material *material;
@@ -52,151 +38,141 @@ private:
 
 class Transform {
 public:
-	Transform() : parent(nullptr)
+	Transform() :
+		store(nullptr),
+		handle(TransformStore::invalidHandle)
 	{
 	}
 
-	virtual ~Transform()
+	Transform(TransformStore *store, TransformHandle handle) :
+		store(store),
+		handle(handle)
 	{
+		assert(store != nullptr);
 	}
 
-	void setParent(Transform *parent)
+	// re-parenting to the top goes through Scene::getRootTransform(), not a default Transform
+	void setParent(Transform parent)
 	{
-		if (this->parent != nullptr) {
-			this->parent = nullptr;
-			unrooted();
-		}
-
-		this->parent = parent;
-
-		if (parent != nullptr)
-			rooted();
+		if (!parent.isValid())
+			throw std::runtime_error("setParent: invalid parent transform, use Scene::getRootTransform()!");
+		assert(parent.store == store);
+		store->setParent(handle, parent.handle);
 	}
 
-	virtual glm::mat4 getAbsoluteMatrix() const
+	Transform getParent() const
 	{
-		glm::mat4 absoluteMatrix = getLocalMatrix();
-
-		const Transform *curr = getParent();
-		while (nullptr != curr) {
-			absoluteMatrix = curr->getLocalMatrix() * absoluteMatrix;
-			curr = curr->getParent();
-		}
-
-		return absoluteMatrix;
+		auto parent = store->getParent(handle);
+		return parent != TransformStore::invalidHandle ? Transform(store, parent) : Transform();
 	}
 
-	const Transform *getRootTransform() const
+	void setLocalMatrix(const glm::mat4 &localMatrix)
 	{
-		const Transform *curr = this;
-		while (nullptr != curr->parent)
-			curr = curr->parent;
-
-		return curr;
+		store->setLocalMatrix(handle, localMatrix);
 	}
 
-	Transform *getParent() const { return parent; }
-	virtual glm::mat4 getLocalMatrix() const = 0;
+	const glm::mat4 &getLocalMatrix() const { return store->getLocalMatrix(handle); }
 
-protected:
-	virtual void rooted() {}
-	virtual void unrooted() {}
-
-private:
-	Transform *parent;
-};
+	// only valid after Scene::updateWorldMatrices()
+	const glm::mat4 &getWorldMatrix() const { return store->getWorldMatrix(handle); }
 
-class RootTransform : public Transform {
-public:
-	RootTransform() : Transform()
-	{
-	}
-
-	glm::mat4 getLocalMatrix() const override
-	{
-		return glm::mat4(1);
-	}
-};
-
-class MatrixTransform : public Transform {
-public:
-	MatrixTransform() : Transform()
-	{
-		localMatrix = glm::mat4(1);
-	}
-
-	glm::mat4 getLocalMatrix() const override
-	{
-		return localMatrix;
-	}
-
-	void setLocalMatrix(glm::mat4 localMatrix)
-	{
-		this->localMatrix = localMatrix;
-	}
+	bool isValid() const { return handle != TransformStore::invalidHandle; }
+	TransformHandle getHandle() const { return handle; }
 
 private:
-	glm::mat4 localMatrix;
+	TransformStore *store;
+	TransformHandle handle;
 };
 
 class Object {
 public:
-	Object(Model *model, Transform *transform) :
+	Object(const Model *model, TransformHandle transform) :
 		model(model),
 		transform(transform)
 	{
 		assert(model != nullptr);
-		assert(transform != nullptr);
+		assert(transform != TransformStore::invalidHandle);
 	}
 
 	const Model *getModel() const { return model; }
-	const Transform *getTransform() const { return transform; }
+	TransformHandle getTransform() const { return transform; }
 
 private:
-	Model *model;
-	Transform *transform;
+	const Model *model;
+	TransformHandle transform;
 };
 
+// what GPU-driven rendering keeps of an object, in a storage buffer; matches GpuObject in the shaders
+struct GpuObject {
+	glm::mat4 worldMatrix;
+	uint32_t materialIndex;
+	uint32_t padding[3];
+
+	GpuObject(const glm::mat4 &worldMatrix, uint32_t materialIndex) :
+		worldMatrix(worldMatrix),
+		materialIndex(materialIndex)
+	{
+		padding[0] = padding[1] = padding[2] = 0;
+	}
+};
+static_assert(sizeof(GpuObject) == 80, "GpuObject must match the std430 layout");
+
 class Scene {
 public:
 	Scene()
 	{
-		transforms.push_back(&rootTransform);
+		rootTransform = transforms.create();
 	}
 
-	MatrixTransform *createMatrixTransform(Transform *parent = nullptr)
-	{
-		auto trans = new MatrixTransform();
-
-		if (parent == nullptr)
-			parent = &rootTransform;
+	Scene(const Scene &) = delete;
+	Scene &operator=(const Scene &) = delete;
 
-		trans->setParent(parent);
-		transforms.push_back(trans);
-		return trans;
+	Transform createMatrixTransform(Transform parent = Transform())
+	{
+		auto handle = transforms.create(parent.isValid() ? parent.getHandle() : rootTransform);
+		return Transform(&transforms, handle);
 	}
 
-	Object *createObject(Model *model, Transform *transform = nullptr)
+	// enters the hierarchy with the next updateWorldMatrices()
+	size_t createObject(const Model *model, Transform transform = Transform())
 	{
-		if (transform == nullptr)
-			transform = &rootTransform;
+		objects.push_back(Object(model, transform.isValid() ? transform.getHandle() : rootTransform));
+		objectLeaves.push_back(BoundingVolumeHierarchy::invalidNode);
+		worldBounds.push_back(BoundingBox());
+		return objects.size() - 1;
+	}
+
+	/*
+	 * Recomputes world matrices of dirty subtrees, parents before children,
+	 * then the world bounds of every object, and refits the hierarchy.
+	 */
+	void updateWorldMatrices(ThreadPool &threadPool = ThreadPool::getDefault());
 
-		assert(transform->getRootTransform() == &rootTransform);
+	// only valid after updateWorldMatrices()
+	const BoundingBox &getWorldBounds(size_t object) const { return worldBounds[object]; }
 
-		auto obj = new Object(model, transform);
-		objects.push_back(obj);
-		return obj;
+	// appends the indices of the objects that may be visible, in no particular order
+	void findVisibleObjects(const Frustum &frustum, std::vector<uint32_t> &visibleObjects) const
+	{
+		objectHierarchy.findVisible(frustum, visibleObjects);
 	}
 
-	const Transform *getRootTransform() const { return &rootTransform; }
+	const BoundingVolumeHierarchy &getObjectHierarchy() const { return objectHierarchy; }
+
+	Transform getRootTransform() { return Transform(&transforms, rootTransform); }
 
-	const std::list<Object*> &getObjects() const { return objects; }
-	const std::list<Transform*> &getTransforms() const { return transforms; }
+	const std::vector<Object> &getObjects() const { return objects; }
+	const TransformStore &getTransforms() const { return transforms; }
 
 private:
-	std::list<Transform*> transforms;
-	std::list<Object*> objects;
-	RootTransform rootTransform;
+	TransformStore transforms;
+	std::vector<Object> objects;
+	TransformHandle rootTransform;
+
+	// per object
+	std::vector<BoundingVolumeHierarchy::NodeHandle> objectLeaves;
+	std::vector<BoundingBox> worldBounds;
+	BoundingVolumeHierarchy objectHierarchy;
 };
 
 
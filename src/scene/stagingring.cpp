@@ -0,0 +1,69 @@
+#include "stagingring.h"
+
+StagingRing::StagingRing(VkDeviceSize capacity) :
+	buffer(capacity, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT),
+	capacity(capacity),
+	head(0),
+	tail(0),
+	used(0),
+	pendingBytes(0),
+	highWaterMark(0)
+{
+	mappedMemory = static_cast<uint8_t *>(buffer.map(0, VK_WHOLE_SIZE));
+}
+
+StagingRing::~StagingRing()
+{
+	buffer.unmap();
+}
+
+bool StagingRing::tryAllocate(VkDeviceSize size, VkDeviceSize alignment, StagingSlice *slice)
+{
+	assert(slice != nullptr);
+
+	if (used == 0)
+		head = tail = 0;
+	else if (head == tail)
+		return false; // completely full
+
+	auto start = vulkan::alignSize(head, alignment);
+	if (head >= tail) {
+		// free space is [head, capacity) followed by [0, tail)
+		if (start + size > capacity) {
+			if (used != 0 && size > tail)
+				return false;
+			if (used == 0 && size > capacity)
+				return false;
+			start = 0;
+		}
+	} else if (start + size > tail)
+		return false;
+
+	// the skipped bytes stay reserved until this batch is released
+	auto consumed = start >= head ? start + size - head : (capacity - head) + start + size;
+
+	head = start + size;
+	used += consumed;
+	pendingBytes += consumed;
+	highWaterMark = std::max(highWaterMark, used);
+
+	slice->buffer = buffer.getBuffer();
+	slice->offset = start;
+	slice->data = mappedMemory + start;
+	return true;
+}
+
+StagingRing::BatchSpan StagingRing::endBatch()
+{
+	BatchSpan span = { head, pendingBytes };
+	pendingBytes = 0;
+	return span;
+}
+
+void StagingRing::release(const BatchSpan &span)
+{
+	assert(span.bytes <= used);
+	used -= span.bytes;
+	if (span.bytes > 0)
+		tail = span.end;
+}
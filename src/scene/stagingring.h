@@ -0,0 +1,49 @@
+#ifndef STAGINGRING_H
+#define STAGINGRING_H
+
+#include "buffer.h"
+
+/*
+ * One large, persistently mapped staging buffer that uploads take linear
+ * slices from. Space is handed back in submission order: endBatch() closes
+ * the slices taken since the previous call, and release() frees them again
+ * once the GPU has consumed them.
+ */
+class StagingRing {
+public:
+	struct BatchSpan {
+		VkDeviceSize end;
+		VkDeviceSize bytes;
+	};
+
+	explicit StagingRing(VkDeviceSize capacity);
+	~StagingRing();
+
+	bool tryAllocate(VkDeviceSize size, VkDeviceSize alignment, StagingSlice *slice);
+
+	BatchSpan endBatch();
+	void release(const BatchSpan &span);
+
+	VkDeviceSize getCapacity() const { return capacity; }
+	VkDeviceSize getUsed() const { return used; }
+	VkDeviceSize getPendingBytes() const { return pendingBytes; }
+
+	// statistics
+	VkDeviceSize getHighWaterMark() const { return highWaterMark; }
+
+private:
+	StagingRing(const StagingRing &) = delete;
+	StagingRing &operator=(const StagingRing &) = delete;
+
+	Buffer buffer;
+	uint8_t *mappedMemory;
+	VkDeviceSize capacity;
+
+	VkDeviceSize head, tail;
+	VkDeviceSize used;         // including alignment padding and wrap-around waste
+	VkDeviceSize pendingBytes; // taken since the last endBatch()
+
+	VkDeviceSize highWaterMark;
+};
+
+#endif // STAGINGRING_H
@@ -1,8 +1,12 @@
 #include "texture.h"
+#include "uploadbatch.h"
+
+#include <stdexcept>
 
 using namespace vulkan;
 
 TextureBase::TextureBase(VkFormat format, VkImageType imageType, VkImageViewType imageViewType, int width, int height, int depth, int mipLevels, int arrayLayers, bool useStaging) :
+	format(format),
 	baseWidth(width),
 	baseHeight(height),
 	baseDepth(depth),
@@ -37,16 +41,20 @@ TextureBase::TextureBase(VkFormat format, VkImageType imageType, VkImageViewType
 	if (useStaging)
 		imageCreateInfo.usage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
 
+	// generateMipmaps() blits from the image itself
+	if (useStaging && mipLevels > 1 && canGenerateMipmaps(format))
+		imageCreateInfo.usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+
 	VkResult err = vkCreateImage(device, &imageCreateInfo, nullptr, &image);
 	assert(err == VK_SUCCESS);
 
 	VkMemoryRequirements memoryRequirements;
 	vkGetImageMemoryRequirements(device, image, &memoryRequirements);
 
-	auto memoryTypeIndex = getMemoryTypeIndex(memoryRequirements, useStaging ? VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT : VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
-	deviceMemory = allocateDeviceMemory(memoryRequirements.size, memoryTypeIndex);
+	auto memoryPropertyFlags = useStaging ? VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT : VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+	memory = allocateDeviceMemory(memoryRequirements, memoryPropertyFlags, !useStaging);
 
-	err = vkBindImageMemory(device, image, deviceMemory, 0);
+	err = vkBindImageMemory(device, image, memory.deviceMemory, memory.offset);
 	assert(err == VK_SUCCESS);
 
 	VkImageSubresourceRange subresourceRange;
@@ -59,18 +67,19 @@ TextureBase::TextureBase(VkFormat format, VkImageType imageType, VkImageViewType
 	imageView = createImageView(image, imageViewType, format, subresourceRange);
 }
 
-void TextureBase::uploadFromStagingBuffer(StagingBuffer *stagingBuffer, int mipLevel, int arrayLayer)
+void TextureBase::uploadFromStagingBuffer(UploadBatch &uploadBatch, const StagingSlice &stagingSlice, int mipLevel, int arrayLayer)
 {
-	assert(stagingBuffer != nullptr);
-
-	auto commandBuffer = allocateCommandBuffers(setupCommandPool, 1)[0];
+	uploadRowsFromStagingBuffer(uploadBatch, stagingSlice, mipLevel, arrayLayer, 0, mipSize(baseHeight, mipLevel));
+}
 
-	VkCommandBufferBeginInfo commandBufferBeginInfo = {};
-	commandBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-	commandBufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+void TextureBase::uploadRowsFromStagingBuffer(UploadBatch &uploadBatch, const StagingSlice &stagingSlice, int mipLevel, int arrayLayer, int firstRow, int rowCount)
+{
+	// copies of compressed data have to start on a block
+	assert(getBlockSize(format) == 0 || stagingSlice.offset % getBlockSize(format) == 0);
+	assert(getBlockSize(format) == 0 || firstRow % 4 == 0);
+	assert(firstRow >= 0 && rowCount > 0 && firstRow + rowCount <= mipSize(baseHeight, mipLevel));
 
-	VkResult err = vkBeginCommandBuffer(commandBuffer, &commandBufferBeginInfo);
-	assert(err == VK_SUCCESS);
+	auto commandBuffer = uploadBatch.getCommandBuffer();
 
 	VkImageSubresourceRange subresourceRange = {
 		VK_IMAGE_ASPECT_COLOR_BIT,
@@ -78,36 +87,191 @@ void TextureBase::uploadFromStagingBuffer(StagingBuffer *stagingBuffer, int mipL
 		uint32_t(arrayLayer), 1
 	};
 
-	imageBarrier(commandBuffer,
-		image, subresourceRange,
-		VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
-		0, VK_ACCESS_TRANSFER_WRITE_BIT,
-		VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+	// the rest of the level is already in TRANSFER_DST_OPTIMAL, and the pieces don't overlap
+	if (firstRow == 0) {
+		imageBarrier(commandBuffer,
+			image, subresourceRange,
+			VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+			0, VK_ACCESS_TRANSFER_WRITE_BIT,
+			VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+	}
 
 	VkBufferImageCopy copyRegion = {};
-	copyRegion.bufferOffset = 0;
+	copyRegion.bufferOffset = stagingSlice.offset;
 	copyRegion.bufferRowLength = 0;
 	copyRegion.bufferImageHeight = 0;
 	copyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
 	copyRegion.imageSubresource.baseArrayLayer = arrayLayer;
 	copyRegion.imageSubresource.mipLevel = mipLevel;
 	copyRegion.imageSubresource.layerCount = 1;
-	copyRegion.imageOffset = { 0, 0, 0 };
+	copyRegion.imageOffset = { 0, firstRow, 0 };
+
+	// the real level size, also for compressed levels that end in a partial block
 	copyRegion.imageExtent.width = mipSize(baseWidth, mipLevel);
-	copyRegion.imageExtent.height = mipSize(baseHeight, mipLevel);
+	copyRegion.imageExtent.height = rowCount;
 	copyRegion.imageExtent.depth = mipSize(baseDepth, mipLevel);
 
-	vkCmdCopyBufferToImage(commandBuffer, stagingBuffer->getBuffer(), image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copyRegion);
+	vkCmdCopyBufferToImage(commandBuffer, stagingSlice.buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copyRegion);
+}
 
-	err = vkEndCommandBuffer(commandBuffer);
-	assert(err == VK_SUCCESS);
+void TextureBase::upload(UploadBatch &uploadBatch, const void *data, int mipLevel, int arrayLayer)
+{
+	assert(getTexelSize(format) != 0);
+	assert(mipSize(baseDepth, mipLevel) == 1);
 
-	VkSubmitInfo submitInfo = {};
-	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	submitInfo.commandBufferCount = 1;
-	submitInfo.pCommandBuffers = &commandBuffer;
+	// rows of blocks when compressed
+	auto rowHeight = getBlockSize(format) != 0 ? 4 : 1;
+	auto width = mipSize(baseWidth, mipLevel);
+	auto height = mipSize(baseHeight, mipLevel);
+	auto rowBytes = VkDeviceSize((width + rowHeight - 1) / rowHeight) * getTexelSize(format);
+	auto rows = (height + rowHeight - 1) / rowHeight;
 
-	// Submit draw command buffer
-	err = vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
-	assert(err == VK_SUCCESS);
+	auto maxRows = int(std::min(UploadBatch::getMaxStagingSize() / rowBytes, VkDeviceSize(rows)));
+	if (maxRows == 0)
+		throw std::runtime_error("texture row larger than the staging ring!");
+
+	auto bytes = static_cast<const uint8_t *>(data);
+	for (auto row = 0; row < rows; row += maxRows) {
+		auto rowCount = std::min(rows - row, maxRows);
+		auto stagingSlice = uploadBatch.allocateStaging(rowCount * rowBytes);
+		memcpy(stagingSlice.data, bytes + row * rowBytes, size_t(rowCount * rowBytes));
+
+		auto firstRow = row * rowHeight;
+		uploadRowsFromStagingBuffer(uploadBatch, stagingSlice, mipLevel, arrayLayer, firstRow, std::min(rowCount * rowHeight, height - firstRow));
+	}
+}
+
+void TextureBase::finishUpload(UploadBatch &uploadBatch)
+{
+	VkImageSubresourceRange subresourceRange = {
+		VK_IMAGE_ASPECT_COLOR_BIT,
+		0, uint32_t(mipLevels),
+		0, uint32_t(arrayLayers)
+	};
+
+	uploadBatch.finishImage(image, subresourceRange,
+		VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+		VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		VK_ACCESS_SHADER_READ_BIT);
+}
+
+bool TextureBase::canGenerateMipmaps(VkFormat format)
+{
+	VkFormatProperties formatProperties;
+	vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &formatProperties);
+
+	auto requiredFeatures = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+	return (formatProperties.optimalTilingFeatures & requiredFeatures) == requiredFeatures;
+}
+
+bool TextureBase::canSample(VkFormat format)
+{
+	// the format properties don't depend on whether the feature was enabled
+	if (getBlockSize(format) != 0 && !enabledFeatures.textureCompressionBC)
+		return false;
+
+	VkFormatProperties formatProperties;
+	vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &formatProperties);
+	return (formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT) != 0;
+}
+
+int TextureBase::getBlockSize(VkFormat format)
+{
+	switch (format) {
+	case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+	case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+	case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+	case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+	case VK_FORMAT_BC4_UNORM_BLOCK:
+	case VK_FORMAT_BC4_SNORM_BLOCK:
+		return 8;
+
+	case VK_FORMAT_BC2_UNORM_BLOCK:
+	case VK_FORMAT_BC2_SRGB_BLOCK:
+	case VK_FORMAT_BC3_UNORM_BLOCK:
+	case VK_FORMAT_BC3_SRGB_BLOCK:
+	case VK_FORMAT_BC5_UNORM_BLOCK:
+	case VK_FORMAT_BC5_SNORM_BLOCK:
+	case VK_FORMAT_BC6H_UFLOAT_BLOCK:
+	case VK_FORMAT_BC6H_SFLOAT_BLOCK:
+	case VK_FORMAT_BC7_UNORM_BLOCK:
+	case VK_FORMAT_BC7_SRGB_BLOCK:
+		return 16;
+
+	default:
+		return 0;
+	}
+}
+
+int TextureBase::getTexelSize(VkFormat format)
+{
+	switch (format) {
+	case VK_FORMAT_R8G8B8A8_UNORM:
+	case VK_FORMAT_R8G8B8A8_SRGB:
+		return 4;
+
+	case VK_FORMAT_R16G16B16A16_SFLOAT:
+		return 8;
+
+	default:
+		return getBlockSize(format);
+	}
+}
+
+void TextureBase::generateMipmaps(UploadBatch &uploadBatch)
+{
+	assert(canGenerateMipmaps(format));
+
+	VkImageSubresourceRange subresourceRange = {
+		VK_IMAGE_ASPECT_COLOR_BIT,
+		0, 1,
+		0, uint32_t(arrayLayers)
+	};
+
+	// level 0 comes from the transfer queue; the rest is never written there
+	uploadBatch.finishImage(image, subresourceRange,
+		VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+		VK_PIPELINE_STAGE_TRANSFER_BIT,
+		VK_ACCESS_TRANSFER_READ_BIT);
+
+	auto commandBuffer = uploadBatch.getGraphicsCommandBuffer();
+
+	for (auto mipLevel = 1; mipLevel < mipLevels; ++mipLevel) {
+		subresourceRange.baseMipLevel = mipLevel;
+
+		imageBarrier(commandBuffer,
+			image, subresourceRange,
+			VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+			0, VK_ACCESS_TRANSFER_WRITE_BIT,
+			VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+
+		VkImageBlit imageBlit = {};
+		imageBlit.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, uint32_t(mipLevel - 1), 0, uint32_t(arrayLayers) };
+		imageBlit.srcOffsets[1].x = mipSize(baseWidth, mipLevel - 1);
+		imageBlit.srcOffsets[1].y = mipSize(baseHeight, mipLevel - 1);
+		imageBlit.srcOffsets[1].z = mipSize(baseDepth, mipLevel - 1);
+
+		imageBlit.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, uint32_t(mipLevel), 0, uint32_t(arrayLayers) };
+		imageBlit.dstOffsets[1].x = mipSize(baseWidth, mipLevel);
+		imageBlit.dstOffsets[1].y = mipSize(baseHeight, mipLevel);
+		imageBlit.dstOffsets[1].z = mipSize(baseDepth, mipLevel);
+
+		blitImage(commandBuffer, image, image, { imageBlit }, VK_FILTER_LINEAR);
+
+		// the next blit reads from this level
+		imageBarrier(commandBuffer,
+			image, subresourceRange,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+			VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT,
+			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+	}
+
+	subresourceRange.baseMipLevel = 0;
+	subresourceRange.levelCount = uint32_t(mipLevels);
+
+	imageBarrier(commandBuffer,
+		image, subresourceRange,
+		VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT,
+		VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
 }
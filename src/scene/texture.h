@@ -23,7 +23,39 @@ public:
 	int getMipLevels() const { return mipLevels; }
 	int getArrayLayers() const { return arrayLayers; }
 
-	void uploadFromStagingBuffer(StagingBuffer *stagingBuffer, int mipLevel = 0, int arrayLayer = 0);
+	void uploadFromStagingBuffer(UploadBatch &uploadBatch, const StagingSlice &stagingSlice, int mipLevel = 0, int arrayLayer = 0);
+
+	/*
+	 * Copies texel rows [firstRow, firstRow + rowCount) of a level, tightly
+	 * packed in the slice; firstRow is a multiple of 4 for block compressed
+	 * formats. The pieces of a level have to go in order, from row 0.
+	 */
+	void uploadRowsFromStagingBuffer(UploadBatch &uploadBatch, const StagingSlice &stagingSlice, int mipLevel, int arrayLayer, int firstRow, int rowCount);
+
+	// stages a tightly packed level through the batch, in as many pieces as the staging ring needs
+	void upload(UploadBatch &uploadBatch, const void *data, int mipLevel = 0, int arrayLayer = 0);
+
+	// transitions every subresource for sampling, on the graphics queue
+	void finishUpload(UploadBatch &uploadBatch);
+
+	/*
+	 * Alternative to finishUpload() when only mip level 0 has been uploaded:
+	 * blits each level down from the previous one on the graphics queue,
+	 * then transitions everything for sampling.
+	 */
+	void generateMipmaps(UploadBatch &uploadBatch);
+
+	// whether generateMipmaps() works for textures of this format
+	static bool canGenerateMipmaps(VkFormat format);
+
+	// whether textures of this format can be sampled; block compressed ones also need the device feature
+	static bool canSample(VkFormat format);
+
+	// bytes per 4x4 block for the BC formats, 0 for uncompressed ones
+	static int getBlockSize(VkFormat format);
+
+	// bytes per texel, or per 4x4 block when compressed; 0 for formats that are never uploaded
+	static int getTexelSize(VkFormat format);
 
 	VkImageView getImageView()
 	{
@@ -45,7 +77,7 @@ public:
 	VkDescriptorImageInfo getDescriptorImageInfo(VkSampler textureSampler)
 	{
 		VkDescriptorImageInfo descriptorImageInfo;
-		descriptorImageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL; // TODO: make *sure* of this!
+		descriptorImageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL; // see finishUpload()
 		descriptorImageInfo.imageView = imageView;
 		descriptorImageInfo.sampler = textureSampler;
 		return descriptorImageInfo;
@@ -53,24 +85,24 @@ public:
 
 	void *map(VkDeviceSize offset, VkDeviceSize size)
 	{
-		void *ret;
-		VkResult err = vkMapMemory(vulkan::device, deviceMemory, offset, size, 0, &ret);
-		assert(err == VK_SUCCESS);
-		return ret;
+		assert(memory.mappedData != nullptr);
+		assert(size == VK_WHOLE_SIZE || offset + size <= memory.size);
+		return static_cast<uint8_t *>(memory.mappedData) + offset;
 	}
 
 	void unmap()
 	{
-		vkUnmapMemory(vulkan::device, deviceMemory);
+		vulkan::flushDeviceMemory(memory);
 	}
 
 protected:
+	VkFormat format;
 	int baseWidth, baseHeight, baseDepth;
 	int mipLevels, arrayLayers;
 
 	VkImage image;
 	VkImageView imageView;
-	VkDeviceMemory deviceMemory;
+	vulkan::DeviceMemoryAllocation memory;
 };
 
 class Texture2D : public TextureBase {
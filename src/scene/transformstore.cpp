@@ -0,0 +1,184 @@
+#include "transformstore.h"
+#include "../core/simd.h"
+
+#include <algorithm>
+#include <numeric>
+
+using std::vector;
+
+const TransformHandle TransformStore::invalidHandle;
+const uint32_t TransformStore::invalidIndex;
+
+TransformHandle TransformStore::create(TransformHandle parent)
+{
+	auto handle = TransformHandle(indices.size());
+	auto index = uint32_t(handles.size());
+
+	auto parentIndex = invalidIndex;
+	auto depth = 0u;
+	if (parent != invalidHandle) {
+		parentIndex = getIndex(parent);
+		depth = depths[parentIndex] + 1;
+	}
+
+	// appending keeps parents before children, but not necessarily sorted by depth
+	if (index > 0 && depths[index - 1] > depth)
+		needsSort = true;
+
+	localMatrices.push_back(glm::mat4(1));
+	worldMatrices.push_back(glm::mat4(1));
+	parentIndices.push_back(parentIndex);
+	depths.push_back(depth);
+	dirtyFlags.push_back(1);
+
+	handles.push_back(handle);
+	indices.push_back(index);
+	levelsChanged = true;
+
+	return handle;
+}
+
+void TransformStore::setParent(TransformHandle handle, TransformHandle parent)
+{
+	auto index = getIndex(handle);
+	auto parentIndex = invalidIndex;
+
+	if (parent != invalidHandle) {
+		parentIndex = getIndex(parent);
+
+		// no cycles, please
+		for (auto curr = parentIndex; curr != invalidIndex; curr = parentIndices[curr])
+			assert(curr != index);
+	}
+
+	parentIndices[index] = parentIndex;
+	dirtyFlags[index] = 1;
+	needsSort = true;
+	levelsChanged = true;
+}
+
+void TransformStore::sortByDepth()
+{
+	auto count = uint32_t(handles.size());
+
+	// re-parenting can move whole subtrees, so recompute all depths
+	vector<uint32_t> newDepths(count, invalidIndex);
+	vector<uint32_t> stack;
+	for (auto i = 0u; i < count; ++i) {
+		auto curr = i;
+		while (newDepths[curr] == invalidIndex) {
+			auto parentIndex = parentIndices[curr];
+			if (parentIndex == invalidIndex) {
+				newDepths[curr] = 0;
+				break;
+			}
+			stack.push_back(curr);
+			curr = parentIndex;
+		}
+
+		while (!stack.empty()) {
+			auto child = stack.back();
+			stack.pop_back();
+			newDepths[child] = newDepths[parentIndices[child]] + 1;
+		}
+	}
+
+	vector<uint32_t> order(count);
+	std::iota(order.begin(), order.end(), 0u);
+	std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+		return newDepths[a] < newDepths[b];
+	});
+
+	vector<uint32_t> newIndices(count);
+	for (auto i = 0u; i < count; ++i)
+		newIndices[order[i]] = i;
+
+	vector<glm::mat4> newLocalMatrices(count), newWorldMatrices(count);
+	vector<uint32_t> newParentIndices(count);
+	vector<uint8_t> newDirtyFlags(count);
+	vector<TransformHandle> newHandles(count);
+
+	for (auto i = 0u; i < count; ++i) {
+		auto src = order[i];
+		newLocalMatrices[i] = localMatrices[src];
+		newWorldMatrices[i] = worldMatrices[src];
+		newParentIndices[i] = parentIndices[src] != invalidIndex ? newIndices[parentIndices[src]] : invalidIndex;
+		newDirtyFlags[i] = dirtyFlags[src];
+		newHandles[i] = handles[src];
+		depths[i] = newDepths[src];
+		indices[handles[src]] = i;
+	}
+
+	localMatrices.swap(newLocalMatrices);
+	worldMatrices.swap(newWorldMatrices);
+	parentIndices.swap(newParentIndices);
+	dirtyFlags.swap(newDirtyFlags);
+	handles.swap(newHandles);
+
+	needsSort = false;
+}
+
+void TransformStore::updateLevelOffsets()
+{
+	levelOffsets.clear();
+	for (size_t i = 0; i < depths.size(); ++i) {
+		while (levelOffsets.size() <= depths[i])
+			levelOffsets.push_back(i);
+	}
+	levelOffsets.push_back(depths.size());
+
+	levelsChanged = false;
+}
+
+template <void (*multiplyMatrix4)(const float *, const float *, float *)>
+static void updateRange(size_t begin, size_t end, const uint32_t *parentIndices, uint8_t *dirtyFlags, const glm::mat4 *localMatrices, glm::mat4 *worldMatrices)
+{
+	for (auto i = begin; i < end; ++i) {
+		auto parentIndex = parentIndices[i];
+
+		// parents live in an earlier level, so their dirty flag is already final
+		if (parentIndex == TransformStore::invalidIndex) {
+			if (dirtyFlags[i])
+				worldMatrices[i] = localMatrices[i];
+			continue;
+		}
+
+		if (dirtyFlags[parentIndex])
+			dirtyFlags[i] = 1;
+
+		if (dirtyFlags[i])
+			multiplyMatrix4(&worldMatrices[parentIndex][0][0], &localMatrices[i][0][0], &worldMatrices[i][0][0]);
+	}
+}
+
+void TransformStore::updateWorldMatricesRange(size_t begin, size_t end)
+{
+	static const bool useAVX = getCpuFeatures().avx;
+	if (useAVX)
+		updateRange<multiplyMatrix4AVX>(begin, end, parentIndices.data(), dirtyFlags.data(), localMatrices.data(), worldMatrices.data());
+	else
+		updateRange<multiplyMatrix4SSE>(begin, end, parentIndices.data(), dirtyFlags.data(), localMatrices.data(), worldMatrices.data());
+}
+
+void TransformStore::updateWorldMatrices(ThreadPool &threadPool)
+{
+	if (needsSort)
+		sortByDepth();
+
+	if (levelsChanged)
+		updateLevelOffsets();
+
+	// small levels aren't worth waking up the workers for
+	const size_t grainSize = 1024;
+
+	for (size_t level = 0; level + 1 < levelOffsets.size(); ++level) {
+		auto levelBegin = levelOffsets[level];
+		auto levelEnd = levelOffsets[level + 1];
+
+		threadPool.parallelFor(levelEnd - levelBegin, grainSize, [&](size_t begin, size_t end) {
+			updateWorldMatricesRange(levelBegin + begin, levelBegin + end);
+		});
+	}
+
+	std::fill(dirtyFlags.begin(), dirtyFlags.end(), uint8_t(0));
+}
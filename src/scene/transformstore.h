@@ -0,0 +1,103 @@
+#ifndef TRANSFORMSTORE_H
+#define TRANSFORMSTORE_H
+
+#include <glm/glm.hpp>
+
+#include "../core/threadpool.h"
+
+#include <vector>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+
+typedef uint32_t TransformHandle;
+
+/*
+ * Packed storage for the transform hierarchy. All per-transform data lives
+ * in parallel arrays sorted by hierarchy depth, so every parent is stored
+ * before its children and a world matrix update is a single linear pass.
+ * Handles stay valid when the arrays are re-sorted. They are handed out
+ * densely from zero and never reused, so they double as slot indices for
+ * per-transform GPU data.
+ */
+class TransformStore {
+public:
+	static const TransformHandle invalidHandle = UINT32_MAX;
+	static const uint32_t invalidIndex = UINT32_MAX;
+
+	TransformStore() :
+		needsSort(false),
+		levelsChanged(false)
+	{
+	}
+
+	TransformHandle create(TransformHandle parent = invalidHandle);
+
+	void setParent(TransformHandle handle, TransformHandle parent);
+
+	TransformHandle getParent(TransformHandle handle) const
+	{
+		auto parentIndex = parentIndices[getIndex(handle)];
+		return parentIndex != invalidIndex ? handles[parentIndex] : invalidHandle;
+	}
+
+	void setLocalMatrix(TransformHandle handle, const glm::mat4 &localMatrix)
+	{
+		auto index = getIndex(handle);
+		localMatrices[index] = localMatrix;
+		dirtyFlags[index] = 1;
+	}
+
+	const glm::mat4 &getLocalMatrix(TransformHandle handle) const
+	{
+		return localMatrices[getIndex(handle)];
+	}
+
+	// only valid after updateWorldMatrices()
+	const glm::mat4 &getWorldMatrix(TransformHandle handle) const
+	{
+		auto index = getIndex(handle);
+		assert(!dirtyFlags[index]);
+		return worldMatrices[index];
+	}
+
+	/*
+	 * Recomputes dirty world matrices one depth level at a time. Siblings
+	 * within a level are independent, so large levels are split across the
+	 * pool.
+	 */
+	void updateWorldMatrices(ThreadPool &threadPool = ThreadPool::getDefault());
+
+	size_t size() const { return handles.size(); }
+
+	uint32_t getIndex(TransformHandle handle) const
+	{
+		assert(handle < indices.size());
+		return indices[handle];
+	}
+
+	// dense, depth-sorted arrays; indexed by getIndex()
+	const glm::mat4 *getWorldMatrices() const { return worldMatrices.data(); }
+	const TransformHandle *getHandles() const { return handles.data(); }
+
+private:
+	void sortByDepth();
+	void updateLevelOffsets();
+	void updateWorldMatricesRange(size_t begin, size_t end);
+
+	std::vector<glm::mat4> localMatrices;
+	std::vector<glm::mat4> worldMatrices;
+	std::vector<uint32_t> parentIndices;
+	std::vector<uint32_t> depths;
+	std::vector<uint8_t> dirtyFlags;
+
+	std::vector<TransformHandle> handles; // index -> handle
+	std::vector<uint32_t> indices;        // handle -> index
+
+	std::vector<size_t> levelOffsets;     // first index of each depth, plus end
+
+	bool needsSort;
+	bool levelsChanged;
+};
+
+#endif // TRANSFORMSTORE_H
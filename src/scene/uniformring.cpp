@@ -0,0 +1,61 @@
+#include "uniformring.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+using namespace vulkan;
+
+// the offset alignment every descriptor type the ring is used for can live with
+static VkDeviceSize getRingAlignment(VkBufferUsageFlags usage)
+{
+	auto alignment = deviceProperties.limits.minUniformBufferOffsetAlignment;
+	if (usage & VK_BUFFER_USAGE_STORAGE_BUFFER_BIT)
+		alignment = std::max(alignment, deviceProperties.limits.minStorageBufferOffsetAlignment);
+	return alignment;
+}
+
+UniformRing::UniformRing(VkDeviceSize frameSize, int framesInFlight, VkBufferUsageFlags usage) :
+	buffer(alignSize(frameSize, getRingAlignment(usage)) * framesInFlight,
+	       usage,
+	       VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT),
+	alignment(getRingAlignment(usage)),
+	frameSize(alignSize(frameSize, getRingAlignment(usage))),
+	framesInFlight(framesInFlight),
+	currentFrame(0),
+	frameUsage(0),
+	highWaterMark(0),
+	allocationCount(0)
+{
+	assert(framesInFlight > 0);
+
+	// mapped once, for the lifetime of the ring
+	mappedMemory = static_cast<uint8_t *>(buffer.map(0, VK_WHOLE_SIZE));
+}
+
+UniformRing::~UniformRing()
+{
+	buffer.unmap();
+}
+
+void UniformRing::beginFrame(int frameIndex)
+{
+	assert(frameIndex >= 0 && frameIndex < framesInFlight);
+	currentFrame = frameIndex;
+	frameUsage = 0;
+}
+
+void *UniformRing::allocate(VkDeviceSize size, VkDeviceSize *offset)
+{
+	assert(offset != nullptr);
+
+	auto blockOffset = alignSize(frameUsage, alignment);
+	if (blockOffset + size > frameSize)
+		throw std::runtime_error("uniform ring overflow");
+
+	frameUsage = blockOffset + size;
+	highWaterMark = std::max(highWaterMark, frameUsage);
+	allocationCount++;
+
+	*offset = currentFrame * frameSize + blockOffset;
+	return mappedMemory + *offset;
+}
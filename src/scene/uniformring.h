@@ -0,0 +1,55 @@
+#ifndef UNIFORMRING_H
+#define UNIFORMRING_H
+
+#include "buffer.h"
+
+/*
+ * Persistently mapped uniform memory, split into one region per frame in
+ * flight. A region may only be reused once the fence of the frame that last
+ * used it has signaled; beginFrame() assumes the caller already waited for it.
+ * With storage usage, blocks are aligned for storage buffer descriptors too.
+ */
+class UniformRing {
+public:
+	UniformRing(VkDeviceSize frameSize, int framesInFlight, VkBufferUsageFlags usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
+	~UniformRing();
+
+	void beginFrame(int frameIndex);
+
+	// returns a pointer to the block, and its offset into getBuffer()
+	void *allocate(VkDeviceSize size, VkDeviceSize *offset);
+
+	VkBuffer getBuffer() const
+	{
+		return buffer.getBuffer();
+	}
+
+	VkDescriptorBufferInfo getDescriptorBufferInfo(VkDeviceSize range)
+	{
+		return buffer.getDescriptorBufferInfo(0, range);
+	}
+
+	VkDeviceSize getAlignment() const { return alignment; }
+	VkDeviceSize getFrameSize() const { return frameSize; }
+
+	// statistics
+	VkDeviceSize getFrameUsage() const { return frameUsage; }
+	VkDeviceSize getHighWaterMark() const { return highWaterMark; }
+	uint64_t getAllocationCount() const { return allocationCount; }
+
+private:
+	Buffer buffer;
+	uint8_t *mappedMemory;
+
+	VkDeviceSize alignment;
+	VkDeviceSize frameSize;
+	int framesInFlight;
+
+	int currentFrame;
+	VkDeviceSize frameUsage;
+
+	VkDeviceSize highWaterMark;
+	uint64_t allocationCount;
+};
+
+#endif // UNIFORMRING_H
@@ -0,0 +1,357 @@
+#include "uploadbatch.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+using namespace vulkan;
+
+using std::vector;
+
+namespace
+{
+	struct PendingBatch {
+		VkCommandBuffer commandBuffer;
+		VkCommandBuffer acquireCommandBuffer;
+		VkSemaphore transferSemaphore;
+		VkFence fence;
+		StagingRing::BatchSpan stagingSpan;
+	};
+
+	std::mutex batchMutex;
+	vector<PendingBatch> pendingBatches; // in submission order
+	vector<VkCommandBuffer> freeCommandBuffers;
+	vector<VkCommandBuffer> freeAcquireCommandBuffers;
+	vector<VkSemaphore> freeSemaphores;
+	vector<VkFence> freeFences; // signaled; reset when reused
+
+	// fences that threads wait on without holding the lock, which mustn't be reset under them
+	vector<VkFence> waitedFences;
+
+	StagingRing *stagingRing = nullptr;
+	const VkDeviceSize stagingRingSize = 64 * 1024 * 1024;
+
+	// the batch holding unsubmitted ring slices, if any
+	const UploadBatch *stagingRingOwner = nullptr;
+	std::thread::id stagingRingOwnerThread;
+	std::condition_variable stagingRingReleased;
+}
+
+static StagingRing &getStagingRing()
+{
+	if (stagingRing == nullptr)
+		stagingRing = new StagingRing(stagingRingSize);
+	return *stagingRing;
+}
+
+static VkCommandBuffer getCommandBuffer(vector<VkCommandBuffer> &freeList, VkCommandPool commandPool)
+{
+	if (freeList.empty()) {
+		auto commandBuffers = allocateCommandBuffers(commandPool, 1);
+		auto ret = commandBuffers[0];
+		delete[] commandBuffers;
+		return ret;
+	}
+
+	auto ret = freeList.back();
+	freeList.pop_back();
+	return ret;
+}
+
+// for a fence added to waitedFences under the lock; blocks without the lock, so other threads can keep submitting and retiring
+static void waitForFence(VkFence fence)
+{
+	VkResult err = vkWaitForFences(device, 1, &fence, VK_TRUE, UINT64_MAX);
+	assert(err == VK_SUCCESS);
+
+	std::lock_guard<std::mutex> lock(batchMutex);
+	waitedFences.erase(std::find(waitedFences.begin(), waitedFences.end(), fence));
+}
+
+static void beginCommandBuffer(VkCommandBuffer commandBuffer)
+{
+	VkCommandBufferBeginInfo commandBufferBeginInfo = {};
+	commandBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	commandBufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+	VkResult err = vkBeginCommandBuffer(commandBuffer, &commandBufferBeginInfo);
+	assert(err == VK_SUCCESS);
+}
+
+UploadBatch::UploadBatch() :
+	stagingRingBytes(0),
+	submitted(false)
+{
+	collectGarbage();
+	begin();
+}
+
+UploadBatch::~UploadBatch()
+{
+	if (!submitted)
+		submit();
+}
+
+void UploadBatch::begin()
+{
+	acquireCommandBuffer = VK_NULL_HANDLE;
+	transferSemaphore = VK_NULL_HANDLE;
+
+	{
+		std::lock_guard<std::mutex> lock(batchMutex);
+
+		commandBuffer = ::getCommandBuffer(freeCommandBuffers, transferCommandPool);
+
+		if (needsOwnershipTransfer()) {
+			acquireCommandBuffer = ::getCommandBuffer(freeAcquireCommandBuffers, setupCommandPool);
+
+			if (freeSemaphores.empty())
+				transferSemaphore = createSemaphore();
+			else {
+				transferSemaphore = freeSemaphores.back();
+				freeSemaphores.pop_back();
+			}
+		}
+
+		auto reusable = std::find_if(freeFences.begin(), freeFences.end(), [](VkFence freeFence) {
+			return std::find(waitedFences.begin(), waitedFences.end(), freeFence) == waitedFences.end();
+		});
+		if (reusable == freeFences.end())
+			fence = createFence(0);
+		else {
+			fence = *reusable;
+			freeFences.erase(reusable);
+
+			VkResult err = vkResetFences(device, 1, &fence);
+			assert(err == VK_SUCCESS);
+		}
+	}
+
+	beginCommandBuffer(commandBuffer);
+	if (acquireCommandBuffer != VK_NULL_HANDLE)
+		beginCommandBuffer(acquireCommandBuffer);
+}
+
+StagingSlice UploadBatch::allocateStaging(VkDeviceSize size, VkDeviceSize alignment)
+{
+	assert(!submitted);
+
+	if (size > stagingRingSize)
+		throw std::runtime_error("staging allocation larger than the staging ring!");
+
+	alignment = std::max(alignment, deviceProperties.limits.optimalBufferCopyOffsetAlignment);
+
+	for (;;) {
+		VkFence oldestFence = VK_NULL_HANDLE;
+		{
+			std::unique_lock<std::mutex> lock(batchMutex);
+
+			// slices are handed back per batch, in submission order, so they can't interleave
+			if (stagingRingOwner != nullptr && stagingRingOwner != this) {
+				if (stagingRingOwnerThread == std::this_thread::get_id())
+					throw std::runtime_error("another upload batch on this thread holds the staging ring, submit it first!");
+
+				stagingRingReleased.wait(lock, [] { return stagingRingOwner == nullptr; });
+			}
+
+			auto &ring = getStagingRing();
+			assert(ring.getPendingBytes() == stagingRingBytes);
+
+			StagingSlice slice;
+			auto usedBefore = ring.getUsed();
+			if (ring.tryAllocate(size, alignment, &slice)) {
+				stagingRingBytes += ring.getUsed() - usedBefore;
+				stagingRingOwner = this;
+				stagingRingOwnerThread = std::this_thread::get_id();
+				return slice;
+			}
+
+			// the ring is full; wait for the oldest batch to hand its space back
+			if (!pendingBatches.empty()) {
+				oldestFence = pendingBatches.front().fence;
+				waitedFences.push_back(oldestFence);
+			}
+		}
+
+		if (oldestFence != VK_NULL_HANDLE) {
+			waitForFence(oldestFence);
+			collectGarbage();
+			continue;
+		}
+
+		// nothing in flight, so we're the ones filling the ring: send off what we have
+		assert(stagingRingBytes > 0);
+		submit();
+		submitted = false;
+		begin();
+	}
+}
+
+VkDeviceSize UploadBatch::getMaxStagingSize()
+{
+	return stagingRingSize;
+}
+
+void UploadBatch::finishImage(VkImage image, const VkImageSubresourceRange &subresourceRange,
+	VkImageLayout newLayout, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess)
+{
+	assert(!submitted);
+
+	if (!needsOwnershipTransfer()) {
+		imageBarrier(commandBuffer, image, subresourceRange,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, dstStage,
+			VK_ACCESS_TRANSFER_WRITE_BIT, dstAccess,
+			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, newLayout);
+		return;
+	}
+
+	// release; the layout transition happens once, as part of the transfer
+	imageBarrier(commandBuffer, image, subresourceRange,
+		VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+		VK_ACCESS_TRANSFER_WRITE_BIT, 0,
+		VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, newLayout,
+		transferQueueIndex, graphicsQueueIndex);
+
+	// acquire
+	imageBarrier(acquireCommandBuffer, image, subresourceRange,
+		VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, dstStage,
+		0, dstAccess,
+		VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, newLayout,
+		transferQueueIndex, graphicsQueueIndex);
+}
+
+void UploadBatch::finishBuffer(VkBuffer buffer, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess)
+{
+	assert(!submitted);
+
+	if (!needsOwnershipTransfer()) {
+		bufferBarrier(commandBuffer, buffer, 0, VK_WHOLE_SIZE,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, dstStage,
+			VK_ACCESS_TRANSFER_WRITE_BIT, dstAccess);
+		return;
+	}
+
+	bufferBarrier(commandBuffer, buffer, 0, VK_WHOLE_SIZE,
+		VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+		VK_ACCESS_TRANSFER_WRITE_BIT, 0,
+		transferQueueIndex, graphicsQueueIndex);
+
+	bufferBarrier(acquireCommandBuffer, buffer, 0, VK_WHOLE_SIZE,
+		VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, dstStage,
+		0, dstAccess,
+		transferQueueIndex, graphicsQueueIndex);
+}
+
+void UploadBatch::submit()
+{
+	assert(!submitted);
+
+	VkResult err = vkEndCommandBuffer(commandBuffer);
+	assert(err == VK_SUCCESS);
+
+	VkSubmitInfo submitInfo = {};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &commandBuffer;
+
+	if (!needsOwnershipTransfer()) {
+		err = vkQueueSubmit(transferQueue, 1, &submitInfo, fence);
+		assert(err == VK_SUCCESS);
+	} else {
+		submitInfo.signalSemaphoreCount = 1;
+		submitInfo.pSignalSemaphores = &transferSemaphore;
+
+		err = vkQueueSubmit(transferQueue, 1, &submitInfo, VK_NULL_HANDLE);
+		assert(err == VK_SUCCESS);
+
+		err = vkEndCommandBuffer(acquireCommandBuffer);
+		assert(err == VK_SUCCESS);
+
+		// must match the source stage of the acquire barriers
+		VkPipelineStageFlags waitDstStageMask = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+
+		VkSubmitInfo acquireSubmitInfo = {};
+		acquireSubmitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		acquireSubmitInfo.waitSemaphoreCount = 1;
+		acquireSubmitInfo.pWaitSemaphores = &transferSemaphore;
+		acquireSubmitInfo.pWaitDstStageMask = &waitDstStageMask;
+		acquireSubmitInfo.commandBufferCount = 1;
+		acquireSubmitInfo.pCommandBuffers = &acquireCommandBuffer;
+
+		// the fence covers both submits, as the acquire waits for the transfer
+		err = vkQueueSubmit(graphicsQueue, 1, &acquireSubmitInfo, fence);
+		assert(err == VK_SUCCESS);
+	}
+
+	std::lock_guard<std::mutex> lock(batchMutex);
+
+	StagingRing::BatchSpan stagingSpan = {};
+	if (stagingRingBytes > 0) {
+		stagingSpan = getStagingRing().endBatch();
+		assert(stagingSpan.bytes == stagingRingBytes);
+		stagingRingBytes = 0;
+	}
+
+	if (stagingRingOwner == this) {
+		stagingRingOwner = nullptr;
+		stagingRingReleased.notify_all();
+	}
+
+	pendingBatches.push_back({ commandBuffer, acquireCommandBuffer, transferSemaphore, fence, stagingSpan });
+	submitted = true;
+}
+
+void UploadBatch::wait()
+{
+	if (!submitted)
+		submit();
+
+	{
+		// if collectGarbage() already recycled our fence, we're done
+		std::lock_guard<std::mutex> lock(batchMutex);
+		auto pending = std::find_if(pendingBatches.begin(), pendingBatches.end(), [&](const PendingBatch &batch) {
+			return batch.commandBuffer == commandBuffer;
+		});
+		if (pending == pendingBatches.end())
+			return;
+
+		waitedFences.push_back(fence);
+	}
+
+	waitForFence(fence);
+	collectGarbage();
+}
+
+void UploadBatch::collectGarbage()
+{
+	std::lock_guard<std::mutex> lock(batchMutex);
+
+	// retire in submission order, so ring space is handed back in order too
+	auto it = pendingBatches.begin();
+	for (; it != pendingBatches.end(); ++it) {
+		if (vkGetFenceStatus(device, it->fence) != VK_SUCCESS)
+			break;
+
+		if (it->stagingSpan.bytes > 0)
+			getStagingRing().release(it->stagingSpan);
+
+		// left signaled for anyone still waiting on it; begin() resets it on reuse
+		VkResult err = vkResetCommandBuffer(it->commandBuffer, 0);
+		assert(err == VK_SUCCESS);
+
+		freeFences.push_back(it->fence);
+		freeCommandBuffers.push_back(it->commandBuffer);
+
+		if (it->acquireCommandBuffer != VK_NULL_HANDLE) {
+			err = vkResetCommandBuffer(it->acquireCommandBuffer, 0);
+			assert(err == VK_SUCCESS);
+
+			freeAcquireCommandBuffers.push_back(it->acquireCommandBuffer);
+			freeSemaphores.push_back(it->transferSemaphore);
+		}
+	}
+
+	pendingBatches.erase(pendingBatches.begin(), it);
+}
@@ -0,0 +1,90 @@
+#ifndef UPLOADBATCH_H
+#define UPLOADBATCH_H
+
+#include "buffer.h"
+#include "stagingring.h"
+
+/*
+ * Records any number of transfer commands into a single command buffer and
+ * submits them with one vkQueueSubmit on the transfer queue. Once the
+ * batch's fence has signaled, its command buffers, semaphore and fence are
+ * recycled and its staging ring space is handed back.
+ *
+ * When the transfer queue lives in its own family, resources have to be
+ * handed over to the graphics queue before use: finishImage() and
+ * finishBuffer() record the release barriers here and the matching acquire
+ * barriers into a small command buffer on the graphics queue, which waits
+ * for the transfer submit.
+ *
+ * Staging memory comes from a shared ring buffer, see allocateStaging().
+ * The ring hands space back in submission order, so only one batch at a
+ * time may hold unsubmitted slices of it: the first one to allocate owns
+ * the ring until it submits, and any other batch that allocates meanwhile
+ * waits for that.
+ */
+class UploadBatch {
+public:
+	UploadBatch();
+	~UploadBatch();
+
+	VkCommandBuffer getCommandBuffer() const
+	{
+		assert(!submitted);
+		return commandBuffer;
+	}
+
+	/*
+	 * Returns mapped staging memory that stays valid until the batch has
+	 * completed. When the ring is full, this waits for older batches, or
+	 * submits what has been recorded so far and continues in a new command
+	 * buffer. While another batch owns the ring, this waits for it to be
+	 * submitted; throws when that batch belongs to the calling thread, as
+	 * it never would be. Larger uploads than getMaxStagingSize() have to be
+	 * split up, see Buffer::upload() and TextureBase::upload().
+	 */
+	StagingSlice allocateStaging(VkDeviceSize size, VkDeviceSize alignment = 16);
+
+	static VkDeviceSize getMaxStagingSize();
+
+	// for commands that need a graphics queue, after the resources they touch have been handed over
+	VkCommandBuffer getGraphicsCommandBuffer() const
+	{
+		assert(!submitted);
+		return needsOwnershipTransfer() ? acquireCommandBuffer : commandBuffer;
+	}
+
+	// hand an image in TRANSFER_DST_OPTIMAL over to the graphics queue
+	void finishImage(VkImage image, const VkImageSubresourceRange &subresourceRange,
+		VkImageLayout newLayout, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess);
+
+	// hand a buffer written by transfers over to the graphics queue
+	void finishBuffer(VkBuffer buffer, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess);
+
+	void submit();
+
+	// blocks until the batch has completed on the GPU
+	void wait();
+
+	// recycles the resources of every batch whose fence has signaled
+	static void collectGarbage();
+
+private:
+	UploadBatch(const UploadBatch &) = delete;
+	UploadBatch &operator=(const UploadBatch &) = delete;
+
+	void begin();
+
+	bool needsOwnershipTransfer() const
+	{
+		return vulkan::transferQueueIndex != vulkan::graphicsQueueIndex;
+	}
+
+	VkCommandBuffer commandBuffer;
+	VkCommandBuffer acquireCommandBuffer;
+	VkSemaphore transferSemaphore;
+	VkFence fence;
+	VkDeviceSize stagingRingBytes;
+	bool submitted;
+};
+
+#endif // UPLOADBATCH_H
@@ -0,0 +1,220 @@
+#include "vertex-layout.h"
+#include "pixel-convert.h"
+
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+#include <stdexcept>
+
+using std::vector;
+
+// bytes per vertex, or zero when pack() can't produce this attribute
+static uint32_t getPackedSize(uint32_t location, VkFormat format)
+{
+	switch (location) {
+	case VERTEX_POSITION:
+		return format == VK_FORMAT_R32G32B32_SFLOAT ? 12 : 0;
+
+	case VERTEX_NORMAL:
+		return format == VK_FORMAT_R32G32B32_SFLOAT ? 12 :
+		       format == VK_FORMAT_R16G16_SNORM || format == VK_FORMAT_A2B10G10R10_SNORM_PACK32 ? 4 : 0;
+
+	case VERTEX_TANGENT:
+		return format == VK_FORMAT_R32G32B32A32_SFLOAT ? 16 :
+		       format == VK_FORMAT_R8G8B8A8_SNORM || format == VK_FORMAT_A2B10G10R10_SNORM_PACK32 ? 4 : 0;
+
+	default:
+		if (location >= VERTEX_TEXCOORD0 + 8)
+			return 0;
+		return format == VK_FORMAT_R32G32_SFLOAT ? 8 : format == VK_FORMAT_R16G16_SFLOAT ? 4 : 0;
+	}
+}
+
+VertexLayout::VertexLayout(NormalEncoding normalEncoding, bool tangents, int texCoordSets, TexCoordEncoding texCoordEncoding) :
+	stride(0)
+{
+	assert(texCoordSets >= 0 && texCoordSets <= 8);
+	assert(!tangents || normalEncoding != NormalEncoding::NONE);
+
+	addAttribute(VERTEX_POSITION, VK_FORMAT_R32G32B32_SFLOAT);
+
+	switch (normalEncoding) {
+	case NormalEncoding::NONE:
+		break;
+
+	case NormalEncoding::FLOAT:
+		addAttribute(VERTEX_NORMAL, VK_FORMAT_R32G32B32_SFLOAT);
+		if (tangents)
+			addAttribute(VERTEX_TANGENT, VK_FORMAT_R32G32B32A32_SFLOAT);
+		break;
+
+	case NormalEncoding::OCTAHEDRAL:
+		addAttribute(VERTEX_NORMAL, VK_FORMAT_R16G16_SNORM);
+		if (tangents)
+			addAttribute(VERTEX_TANGENT, VK_FORMAT_R8G8B8A8_SNORM);
+		break;
+
+	case NormalEncoding::PACKED_10_10_10_2:
+		addAttribute(VERTEX_NORMAL, VK_FORMAT_A2B10G10R10_SNORM_PACK32);
+		if (tangents)
+			addAttribute(VERTEX_TANGENT, VK_FORMAT_A2B10G10R10_SNORM_PACK32);
+		break;
+	}
+
+	for (int i = 0; i < texCoordSets; ++i) {
+		if (texCoordEncoding == TexCoordEncoding::HALF)
+			addAttribute(VERTEX_TEXCOORD0 + i, VK_FORMAT_R16G16_SFLOAT);
+		else
+			addAttribute(VERTEX_TEXCOORD0 + i, VK_FORMAT_R32G32_SFLOAT);
+	}
+}
+
+VertexLayout::VertexLayout(const vector<Attribute> &attributes, uint32_t stride) :
+	attributes(attributes),
+	stride(stride)
+{
+	for (auto &attribute : attributes) {
+		auto size = getPackedSize(attribute.location, attribute.format);
+		if (size == 0)
+			throw std::runtime_error("unsupported vertex attribute format!");
+		if (attribute.offset + size > stride)
+			throw std::runtime_error("vertex attribute outside of the vertex!");
+	}
+}
+
+void VertexLayout::addAttribute(uint32_t location, VkFormat format)
+{
+	Attribute attribute = { location, format, stride };
+	attributes.push_back(attribute);
+	stride += getPackedSize(location, format);
+}
+
+const VertexLayout::Attribute *VertexLayout::findAttribute(uint32_t location) const
+{
+	for (auto &attribute : attributes) {
+		if (attribute.location == location)
+			return &attribute;
+	}
+	return nullptr;
+}
+
+VkVertexInputBindingDescription VertexLayout::getBindingDescription(uint32_t binding) const
+{
+	VkVertexInputBindingDescription bindingDescription;
+	bindingDescription.binding = binding;
+	bindingDescription.stride = stride;
+	bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+	return bindingDescription;
+}
+
+vector<VkVertexInputAttributeDescription> VertexLayout::getAttributeDescriptions(uint32_t binding) const
+{
+	vector<VkVertexInputAttributeDescription> attributeDescriptions;
+	for (auto &attribute : attributes) {
+		VkVertexInputAttributeDescription attributeDescription;
+		attributeDescription.location = attribute.location;
+		attributeDescription.binding = binding;
+		attributeDescription.format = attribute.format;
+		attributeDescription.offset = attribute.offset;
+		attributeDescriptions.push_back(attributeDescription);
+	}
+	return attributeDescriptions;
+}
+
+static float quantizeSnorm(float value, float scale)
+{
+	value = value < -1.0f ? -1.0f : value > 1.0f ? 1.0f : value;
+	return roundf(value * scale);
+}
+
+// the unit vector projected onto an octahedron, with the lower half folded over the diagonals
+static glm::vec2 encodeOctahedral(const glm::vec3 &v)
+{
+	auto length = fabsf(v.x) + fabsf(v.y) + fabsf(v.z);
+	if (length == 0.0f)
+		return glm::vec2(0.0f, 0.0f);
+
+	auto p = glm::vec2(v.x / length, v.y / length);
+	if (v.z < 0.0f) {
+		auto folded = glm::vec2(1.0f - fabsf(p.y), 1.0f - fabsf(p.x));
+		p.x = p.x >= 0.0f ? folded.x : -folded.x;
+		p.y = p.y >= 0.0f ? folded.y : -folded.y;
+	}
+	return p;
+}
+
+static uint32_t pack1010102(const glm::vec3 &v, float w)
+{
+	auto x = uint32_t(int32_t(quantizeSnorm(v.x, 511.0f))) & 0x3ff;
+	auto y = uint32_t(int32_t(quantizeSnorm(v.y, 511.0f))) & 0x3ff;
+	auto z = uint32_t(int32_t(quantizeSnorm(v.z, 511.0f))) & 0x3ff;
+	auto a = uint32_t(int32_t(quantizeSnorm(w, 1.0f))) & 0x3;
+	return x | y << 10 | z << 20 | a << 30;
+}
+
+static void packAttribute(const Vertex &vertex, const VertexLayout::Attribute &attribute, uint8_t *dst)
+{
+	switch (attribute.location) {
+	case VERTEX_POSITION:
+		memcpy(dst, &vertex.position, 12);
+		break;
+
+	case VERTEX_NORMAL:
+		if (attribute.format == VK_FORMAT_R32G32B32_SFLOAT) {
+			memcpy(dst, &vertex.normal, 12);
+		} else if (attribute.format == VK_FORMAT_R16G16_SNORM) {
+			auto p = encodeOctahedral(vertex.normal);
+			int16_t packed[2] = { int16_t(quantizeSnorm(p.x, 32767.0f)), int16_t(quantizeSnorm(p.y, 32767.0f)) };
+			memcpy(dst, packed, 4);
+		} else {
+			auto packed = pack1010102(vertex.normal, 0.0f);
+			memcpy(dst, &packed, 4);
+		}
+		break;
+
+	case VERTEX_TANGENT:
+		if (attribute.format == VK_FORMAT_R32G32B32A32_SFLOAT) {
+			memcpy(dst, &vertex.tangent, 16);
+		} else if (attribute.format == VK_FORMAT_R8G8B8A8_SNORM) {
+			auto p = encodeOctahedral(glm::vec3(vertex.tangent.x, vertex.tangent.y, vertex.tangent.z));
+			int8_t packed[4] = {
+				int8_t(quantizeSnorm(p.x, 127.0f)),
+				int8_t(quantizeSnorm(p.y, 127.0f)),
+				0,
+				int8_t(vertex.tangent.w < 0.0f ? -127 : 127)
+			};
+			memcpy(dst, packed, 4);
+		} else {
+			auto packed = pack1010102(glm::vec3(vertex.tangent.x, vertex.tangent.y, vertex.tangent.z), vertex.tangent.w < 0.0f ? -1.0f : 1.0f);
+			memcpy(dst, &packed, 4);
+		}
+		break;
+
+	default:
+		auto &uv = vertex.uv[attribute.location - VERTEX_TEXCOORD0];
+		if (attribute.format == VK_FORMAT_R32G32_SFLOAT) {
+			memcpy(dst, &uv, 8);
+		} else {
+			uint16_t packed[2] = { floatToHalf(uv.x), floatToHalf(uv.y) };
+			memcpy(dst, packed, 4);
+		}
+		break;
+	}
+}
+
+void VertexLayout::pack(const Vertex *vertices, size_t count, void *dst) const
+{
+	auto bytes = static_cast<uint8_t *>(dst);
+	for (size_t i = 0; i < count; ++i) {
+		for (auto &attribute : attributes)
+			packAttribute(vertices[i], attribute, bytes + attribute.offset);
+		bytes += stride;
+	}
+}
+
+vector<uint8_t> VertexLayout::pack(const vector<Vertex> &vertices) const
+{
+	vector<uint8_t> packed(vertices.size() * stride);
+	pack(vertices.data(), vertices.size(), packed.data());
+	return packed;
+}
@@ -0,0 +1,83 @@
+#ifndef VERTEX_LAYOUT_H
+#define VERTEX_LAYOUT_H
+
+#include <vulkan/vulkan.h>
+#include <glm/glm.hpp>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// full-precision vertex that meshes are built from; VertexLayout packs it for the GPU
+struct Vertex {
+	glm::vec3 position;
+	glm::vec3 normal;
+	glm::vec4 tangent; // w is the handedness: bitangent = cross(normal, tangent.xyz) * tangent.w
+	glm::vec2 uv[8];
+};
+
+// doubles as the shader input location
+enum VertexSemantic {
+	VERTEX_POSITION = 0,
+	VERTEX_NORMAL = 1,
+	VERTEX_TANGENT = 2,
+	VERTEX_TEXCOORD0 = 3, // up to VERTEX_TEXCOORD0 + 7
+};
+
+enum class NormalEncoding {
+	NONE,
+	FLOAT,             // R32G32B32_SFLOAT; tangents R32G32B32A32_SFLOAT
+	OCTAHEDRAL,        // R16G16_SNORM; tangents R8G8B8A8_SNORM, octahedral in xy and handedness in w
+	PACKED_10_10_10_2, // A2B10G10R10_SNORM_PACK32 for both, handedness in w
+};
+
+enum class TexCoordEncoding {
+	FLOAT, // R32G32_SFLOAT
+	HALF,  // R16G16_SFLOAT
+};
+
+/*
+ * Describes how vertices are stored in a vertex buffer: which attributes
+ * there are, in what format and at which offset. All attributes are
+ * interleaved in a single binding, in semantic order. Positions are always
+ * full floats; everything else can be quantized, and only the texture
+ * coordinate sets that are asked for are stored.
+ *
+ * Octahedral normals are decoded in the shader; the SNORM formats already
+ * deliver the other encodings as floats.
+ */
+class VertexLayout {
+public:
+	struct Attribute {
+		uint32_t location; // VertexSemantic
+		VkFormat format;
+		uint32_t offset;
+	};
+
+	explicit VertexLayout(NormalEncoding normalEncoding = NormalEncoding::OCTAHEDRAL, bool tangents = false,
+		int texCoordSets = 1, TexCoordEncoding texCoordEncoding = TexCoordEncoding::HALF);
+
+	// for vertices packed elsewhere; throws if an attribute can't be packed by pack()
+	VertexLayout(const std::vector<Attribute> &attributes, uint32_t stride);
+
+	uint32_t getStride() const { return stride; }
+	const std::vector<Attribute> &getAttributes() const { return attributes; }
+	bool hasAttribute(uint32_t location) const { return findAttribute(location) != nullptr; }
+	const Attribute *findAttribute(uint32_t location) const; // nullptr if there's none
+
+	// vertex input state for a pipeline that reads this layout from the given binding
+	VkVertexInputBindingDescription getBindingDescription(uint32_t binding = 0) const;
+	std::vector<VkVertexInputAttributeDescription> getAttributeDescriptions(uint32_t binding = 0) const;
+
+	// writes getStride() bytes per vertex to dst
+	void pack(const Vertex *vertices, size_t count, void *dst) const;
+	std::vector<uint8_t> pack(const std::vector<Vertex> &vertices) const;
+
+private:
+	void addAttribute(uint32_t location, VkFormat format);
+
+	std::vector<Attribute> attributes;
+	uint32_t stride;
+};
+
+#endif // VERTEX_LAYOUT_H
@@ -4,7 +4,7 @@
 VkShaderModule loadShaderModule(const char *path)
 {
 	MemoryMappedFile shaderCode(path);
-	assert(shaderCode.getSize() > 0);
+	assert(shaderCode.getSize() > 0 && shaderCode.getSize() % 4 == 0);
 
 	VkShaderModuleCreateInfo moduleCreateInfo = {};
 	moduleCreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
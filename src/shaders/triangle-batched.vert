@@ -0,0 +1,28 @@
+#version 450
+
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_ARB_shading_language_420pack : enable
+
+layout (location = 0) in vec3 inPos;
+
+// GpuObject; each draw of ClusterCullBatchTarget is one instance, of the object it culled
+struct GpuObject {
+	mat4 worldMatrix;
+	uint materialIndex;
+};
+
+layout (std430, binding = 0) readonly buffer Objects {
+	GpuObject objects[];
+};
+
+layout (push_constant) uniform PushConstants {
+	mat4 viewProjectionMatrix;
+};
+
+layout (location = 0) out vec2 outTexCoord;
+
+void main()
+{
+	outTexCoord = 0.5 + 0.5 * inPos.xy;
+	gl_Position = viewProjectionMatrix * objects[gl_InstanceIndex].worldMatrix * vec4(inPos.xyz, 1.0);
+}
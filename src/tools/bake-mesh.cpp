@@ -0,0 +1,545 @@
+#include "../scene/mesh-optimize.h"
+#include "../scene/mesh-pack-format.h"
+#include "../scene/vertex-layout.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using std::string;
+using std::vector;
+using std::runtime_error;
+
+namespace
+{
+	struct ObjMaterial {
+		string name;
+		string albedoMap;
+		glm::vec4 albedoColor;
+	};
+
+	// one OBJ vertex reference; zero-based, -1 when missing
+	struct ObjCorner {
+		int position, uv, normal;
+
+		bool operator==(const ObjCorner &other) const
+		{
+			return position == other.position && uv == other.uv && normal == other.normal;
+		}
+	};
+
+	struct ObjCornerHash {
+		size_t operator()(const ObjCorner &corner) const
+		{
+			auto hash = size_t(corner.position) * 73856093u;
+			hash ^= size_t(corner.uv) * 19349663u;
+			hash ^= size_t(corner.normal) * 83492791u;
+			return hash;
+		}
+	};
+
+	struct ObjMesh {
+		vector<glm::vec3> positions;
+		vector<glm::vec2> uvs;
+		vector<glm::vec3> normals;
+		vector<ObjMaterial> materials;
+		vector<vector<ObjCorner>> triangles; // three corners each, per material
+	};
+}
+
+static string readTextFile(const string &path)
+{
+	auto fp = fopen(path.c_str(), "rb");
+	if (!fp)
+		throw runtime_error("failed to open " + path);
+
+	string text;
+	char buffer[64 * 1024];
+	size_t bytesRead;
+	while ((bytesRead = fread(buffer, 1, sizeof(buffer), fp)) > 0)
+		text.append(buffer, bytesRead);
+
+	fclose(fp);
+	return text;
+}
+
+static string getDirectory(const string &path)
+{
+	auto slash = path.find_last_of("/\\");
+	return slash != string::npos ? path.substr(0, slash + 1) : string();
+}
+
+// splits text into lines and hands each one, without the keyword, to the callback
+template <typename Callback>
+static void forEachLine(const string &text, Callback callback)
+{
+	size_t start = 0;
+	while (start < text.size()) {
+		auto end = text.find('\n', start);
+		if (end == string::npos)
+			end = text.size();
+
+		string line = text.substr(start, end - start);
+		start = end + 1;
+
+		if (!line.empty() && line.back() == '\r')
+			line.pop_back();
+
+		auto keywordStart = line.find_first_not_of(" \t");
+		if (keywordStart == string::npos || line[keywordStart] == '#')
+			continue;
+
+		auto keywordEnd = line.find_first_of(" \t", keywordStart);
+		auto keyword = line.substr(keywordStart, keywordEnd - keywordStart);
+		auto argumentStart = keywordEnd != string::npos ? line.find_first_not_of(" \t", keywordEnd) : string::npos;
+		callback(keyword, argumentStart != string::npos ? line.substr(argumentStart) : string());
+	}
+}
+
+static void readFloats(const string &text, float *values, int count)
+{
+	auto ptr = text.c_str();
+	for (int i = 0; i < count; ++i) {
+		char *end;
+		values[i] = strtof(ptr, &end);
+		if (end == ptr)
+			throw runtime_error("malformed line: " + text);
+		ptr = end;
+	}
+}
+
+static void loadMtl(const string &path, ObjMesh *mesh)
+{
+	ObjMaterial *material = nullptr;
+
+	forEachLine(readTextFile(path), [&](const string &keyword, const string &arguments) {
+		if (keyword == "newmtl") {
+			ObjMaterial newMaterial;
+			newMaterial.name = arguments;
+			newMaterial.albedoColor = glm::vec4(1.0f);
+			mesh->materials.push_back(newMaterial);
+			material = &mesh->materials.back();
+		} else if (material == nullptr) {
+			return;
+		} else if (keyword == "Kd") {
+			readFloats(arguments, &material->albedoColor.x, 3);
+		} else if (keyword == "d") {
+			readFloats(arguments, &material->albedoColor.w, 1);
+		} else if (keyword == "Tr") {
+			float transparency;
+			readFloats(arguments, &transparency, 1);
+			material->albedoColor.w = 1.0f - transparency;
+		} else if (keyword == "map_Kd") {
+			// options in front of the file name are skipped; the name is the last argument
+			auto nameStart = arguments.find_last_of(" \t");
+			material->albedoMap = nameStart != string::npos ? arguments.substr(nameStart + 1) : arguments;
+		}
+	});
+}
+
+// OBJ indices are one-based, or relative to the end when negative
+static int resolveIndex(long index, size_t count)
+{
+	if (index > 0 && size_t(index) <= count)
+		return int(index - 1);
+	if (index < 0 && size_t(-index) <= count)
+		return int(count + index);
+	throw runtime_error("index out of range");
+}
+
+static ObjCorner parseCorner(const char *&ptr, const ObjMesh &mesh)
+{
+	ObjCorner corner = { -1, -1, -1 };
+
+	char *end;
+	corner.position = resolveIndex(strtol(ptr, &end, 10), mesh.positions.size());
+	ptr = end;
+
+	if (*ptr == '/') {
+		ptr++;
+		if (*ptr != '/') {
+			corner.uv = resolveIndex(strtol(ptr, &end, 10), mesh.uvs.size());
+			ptr = end;
+		}
+		if (*ptr == '/') {
+			ptr++;
+			corner.normal = resolveIndex(strtol(ptr, &end, 10), mesh.normals.size());
+			ptr = end;
+		}
+	}
+	return corner;
+}
+
+static ObjMesh loadObj(const string &path)
+{
+	ObjMesh mesh;
+	auto directory = getDirectory(path);
+	int currentMaterial = -1, defaultMaterial = -1;
+
+	forEachLine(readTextFile(path), [&](const string &keyword, const string &arguments) {
+		if (keyword == "v") {
+			glm::vec3 position;
+			readFloats(arguments, &position.x, 3);
+			mesh.positions.push_back(position);
+		} else if (keyword == "vt") {
+			glm::vec2 uv;
+			readFloats(arguments, &uv.x, 2);
+			mesh.uvs.push_back(uv);
+		} else if (keyword == "vn") {
+			glm::vec3 normal;
+			readFloats(arguments, &normal.x, 3);
+			mesh.normals.push_back(normal);
+		} else if (keyword == "f") {
+			vector<ObjCorner> polygon;
+			auto ptr = arguments.c_str();
+			while (*ptr != '\0') {
+				polygon.push_back(parseCorner(ptr, mesh));
+				while (*ptr == ' ' || *ptr == '\t')
+					ptr++;
+			}
+			if (polygon.size() < 3)
+				throw runtime_error("degenerate face: " + arguments);
+
+			// faces without a known material share a plain white one
+			if (currentMaterial < 0) {
+				if (defaultMaterial < 0) {
+					ObjMaterial material;
+					material.name = "default";
+					material.albedoColor = glm::vec4(1.0f);
+					mesh.materials.push_back(material);
+					defaultMaterial = int(mesh.materials.size() - 1);
+				}
+				currentMaterial = defaultMaterial;
+			}
+			if (mesh.triangles.size() < mesh.materials.size())
+				mesh.triangles.resize(mesh.materials.size());
+
+			// fan triangulation; fine for the convex polygons exporters write
+			auto &triangles = mesh.triangles[currentMaterial];
+			for (size_t i = 2; i < polygon.size(); ++i) {
+				triangles.push_back(polygon[0]);
+				triangles.push_back(polygon[i - 1]);
+				triangles.push_back(polygon[i]);
+			}
+		} else if (keyword == "mtllib") {
+			loadMtl(directory + arguments, &mesh);
+		} else if (keyword == "usemtl") {
+			currentMaterial = -1;
+			for (size_t i = 0; i < mesh.materials.size(); ++i) {
+				if (mesh.materials[i].name == arguments)
+					currentMaterial = int(i);
+			}
+			if (currentMaterial < 0)
+				fprintf(stderr, "warning: unknown material %s\n", arguments.c_str());
+		}
+	});
+
+	mesh.triangles.resize(mesh.materials.size());
+	return mesh;
+}
+
+// area-weighted normals per position, for corners that come without one
+static vector<glm::vec3> generateNormals(const ObjMesh &mesh)
+{
+	vector<glm::vec3> normals(mesh.positions.size(), glm::vec3(0.0f));
+	for (auto &triangles : mesh.triangles) {
+		for (size_t i = 0; i < triangles.size(); i += 3) {
+			auto &p0 = mesh.positions[triangles[i].position];
+			auto &p1 = mesh.positions[triangles[i + 1].position];
+			auto &p2 = mesh.positions[triangles[i + 2].position];
+			auto faceNormal = glm::cross(p1 - p0, p2 - p0);
+			for (int j = 0; j < 3; ++j)
+				normals[triangles[i + j].position] += faceNormal;
+		}
+	}
+	return normals;
+}
+
+static glm::vec3 safeNormalize(const glm::vec3 &v)
+{
+	auto length = glm::length(v);
+	return length > 0.0f ? v / length : glm::vec3(0.0f, 0.0f, 1.0f);
+}
+
+// per-vertex tangents from the texture coordinates, orthogonalized against the normals
+static void generateTangents(vector<Vertex> &vertices, const vector<uint32_t> &indices)
+{
+	vector<glm::vec3> tangents(vertices.size(), glm::vec3(0.0f));
+	vector<glm::vec3> bitangents(vertices.size(), glm::vec3(0.0f));
+
+	for (size_t i = 0; i < indices.size(); i += 3) {
+		auto &v0 = vertices[indices[i]];
+		auto &v1 = vertices[indices[i + 1]];
+		auto &v2 = vertices[indices[i + 2]];
+
+		auto edge1 = v1.position - v0.position, edge2 = v2.position - v0.position;
+		auto deltaUV1 = v1.uv[0] - v0.uv[0], deltaUV2 = v2.uv[0] - v0.uv[0];
+		auto determinant = deltaUV1.x * deltaUV2.y - deltaUV2.x * deltaUV1.y;
+		if (determinant == 0.0f)
+			continue;
+
+		// the area weighting of the edges carries over, so only the sign of the determinant matters
+		auto scale = determinant > 0.0f ? 1.0f : -1.0f;
+		auto tangent = (edge1 * deltaUV2.y - edge2 * deltaUV1.y) * scale;
+		auto bitangent = (edge2 * deltaUV1.x - edge1 * deltaUV2.x) * scale;
+		for (int j = 0; j < 3; ++j) {
+			tangents[indices[i + j]] += tangent;
+			bitangents[indices[i + j]] += bitangent;
+		}
+	}
+
+	for (size_t i = 0; i < vertices.size(); ++i) {
+		auto &normal = vertices[i].normal;
+		auto tangent = tangents[i] - normal * glm::dot(normal, tangents[i]);
+		if (glm::dot(tangent, tangent) == 0.0f)
+			tangent = fabsf(normal.x) < 0.9f ? glm::cross(normal, glm::vec3(1.0f, 0.0f, 0.0f)) : glm::cross(normal, glm::vec3(0.0f, 1.0f, 0.0f));
+
+		auto handedness = glm::dot(glm::cross(normal, tangent), bitangents[i]) < 0.0f ? -1.0f : 1.0f;
+		vertices[i].tangent = glm::vec4(safeNormalize(tangent), handedness);
+	}
+}
+
+static void growBounds(const glm::vec3 &position, float boundsMin[3], float boundsMax[3])
+{
+	for (int i = 0; i < 3; ++i) {
+		boundsMin[i] = std::min(boundsMin[i], position[i]);
+		boundsMax[i] = std::max(boundsMax[i], position[i]);
+	}
+}
+
+static void copyString(char *dst, size_t size, const string &src)
+{
+	if (src.size() >= size)
+		throw runtime_error("too long name: " + src);
+	strncpy(dst, src.c_str(), size);
+}
+
+// per submesh, so the submesh ranges stay put; the vertex fetch remap covers the whole stream
+static void optimizeMeshPack(vector<Vertex> &vertices, vector<uint32_t> &indices, const vector<MeshPackSubmesh> &submeshes,
+	const MeshOptimizeOptions &options)
+{
+	auto before = analyzeVertexCache(indices.data(), indices.size(), vertices.size());
+
+	for (auto &submesh : submeshes) {
+		auto range = indices.data() + submesh.firstIndex;
+		if (options.vertexCache)
+			optimizeVertexCache(range, range, submesh.indexCount, vertices.size());
+		if (options.overdraw) {
+			optimizeOverdraw(range, range, submesh.indexCount, &vertices[0].position, sizeof(Vertex),
+				vertices.size(), options.overdrawThreshold);
+		}
+	}
+
+	if (options.vertexFetch) {
+		vector<uint32_t> remap(vertices.size());
+		auto vertexCount = optimizeVertexFetchRemap(remap.data(), indices.data(), indices.size(), vertices.size());
+		remapIndices(indices.data(), indices.data(), indices.size(), remap.data());
+
+		vector<Vertex> remapped(vertexCount);
+		remapVertices(remapped.data(), vertices.data(), vertices.size(), sizeof(Vertex), remap.data());
+		vertices.swap(remapped);
+	}
+
+	auto after = analyzeVertexCache(indices.data(), indices.size(), vertices.size());
+	printf("ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n", before.acmr, after.acmr, before.atvr, after.atvr);
+}
+
+static void writeMeshPack(const string &path, const ObjMesh &mesh, const VertexLayout &vertexLayout, bool flipV,
+	const MeshOptimizeOptions &optimizeOptions)
+{
+	auto generatedNormals = generateNormals(mesh);
+
+	MeshPackHeader header = {};
+	header.magic = meshPackMagic;
+	header.version = meshPackVersion;
+	header.vertexStride = vertexLayout.getStride();
+
+	vector<MeshPackAttribute> attributes;
+	for (auto &layoutAttribute : vertexLayout.getAttributes()) {
+		MeshPackAttribute attribute = { layoutAttribute.location, uint32_t(layoutAttribute.format), layoutAttribute.offset };
+		attributes.push_back(attribute);
+	}
+	header.attributeCount = uint32_t(attributes.size());
+
+	for (int i = 0; i < 3; ++i) {
+		header.boundsMin[i] = INFINITY;
+		header.boundsMax[i] = -INFINITY;
+	}
+
+	// one shared vertex stream, with a submesh per used material
+	vector<Vertex> vertices;
+	vector<uint32_t> indices;
+	vector<MeshPackSubmesh> submeshes;
+	vector<MeshPackMaterial> materials;
+	std::unordered_map<ObjCorner, uint32_t, ObjCornerHash> vertexMap;
+
+	for (size_t materialIndex = 0; materialIndex < mesh.materials.size(); ++materialIndex) {
+		auto &triangles = mesh.triangles[materialIndex];
+		if (triangles.empty())
+			continue;
+
+		MeshPackSubmesh submesh = {};
+		submesh.firstIndex = uint32_t(indices.size());
+		submesh.indexCount = uint32_t(triangles.size());
+		submesh.materialIndex = uint32_t(materials.size());
+		for (int i = 0; i < 3; ++i) {
+			submesh.boundsMin[i] = INFINITY;
+			submesh.boundsMax[i] = -INFINITY;
+		}
+
+		for (auto &corner : triangles) {
+			auto inserted = vertexMap.insert(std::make_pair(corner, uint32_t(vertices.size())));
+			if (inserted.second) {
+				Vertex vertex = {};
+				vertex.position = mesh.positions[corner.position];
+				vertex.normal = safeNormalize(corner.normal >= 0 ? mesh.normals[corner.normal] : generatedNormals[corner.position]);
+				vertex.uv[0] = corner.uv >= 0 ? mesh.uvs[corner.uv] : glm::vec2(0.0f);
+				if (flipV)
+					vertex.uv[0].y = 1.0f - vertex.uv[0].y;
+				vertices.push_back(vertex);
+			}
+			indices.push_back(inserted.first->second);
+			growBounds(mesh.positions[corner.position], submesh.boundsMin, submesh.boundsMax);
+		}
+
+		growBounds(glm::vec3(submesh.boundsMin[0], submesh.boundsMin[1], submesh.boundsMin[2]), header.boundsMin, header.boundsMax);
+		growBounds(glm::vec3(submesh.boundsMax[0], submesh.boundsMax[1], submesh.boundsMax[2]), header.boundsMin, header.boundsMax);
+		submeshes.push_back(submesh);
+
+		auto &objMaterial = mesh.materials[materialIndex];
+		MeshPackMaterial material = {};
+		copyString(material.name, sizeof(material.name), objMaterial.name);
+		copyString(material.albedoMap, sizeof(material.albedoMap), objMaterial.albedoMap);
+		for (int i = 0; i < 4; ++i)
+			material.albedoColor[i] = objMaterial.albedoColor[i];
+		materials.push_back(material);
+	}
+
+	if (vertices.empty())
+		throw runtime_error("no faces!");
+
+	if (optimizeOptions.vertexCache || optimizeOptions.vertexFetch)
+		optimizeMeshPack(vertices, indices, submeshes, optimizeOptions);
+
+	header.vertexCount = uint32_t(vertices.size());
+	header.indexCount = uint32_t(indices.size());
+	header.indexSize = vertices.size() <= 0x10000 ? 2 : 4;
+	header.submeshCount = uint32_t(submeshes.size());
+	header.materialCount = uint32_t(materials.size());
+
+	if (vertexLayout.hasAttribute(VERTEX_TANGENT))
+		generateTangents(vertices, indices);
+
+	auto vertexStream = vertexLayout.pack(vertices);
+
+	vector<uint8_t> indexStream(indices.size() * header.indexSize);
+	for (size_t i = 0; i < indices.size(); ++i) {
+		if (header.indexSize == 2) {
+			auto index = uint16_t(indices[i]);
+			memcpy(indexStream.data() + i * 2, &index, 2);
+		} else
+			memcpy(indexStream.data() + i * 4, &indices[i], 4);
+	}
+
+	auto alignStream = [](uint64_t offset) {
+		return (offset + meshPackStreamAlignment - 1) & ~(meshPackStreamAlignment - 1);
+	};
+	auto tableEnd = sizeof(MeshPackHeader) +
+	                attributes.size() * sizeof(MeshPackAttribute) +
+	                submeshes.size() * sizeof(MeshPackSubmesh) +
+	                materials.size() * sizeof(MeshPackMaterial);
+	header.vertexOffset = alignStream(tableEnd);
+	header.indexOffset = alignStream(header.vertexOffset + vertexStream.size());
+
+	auto fp = fopen(path.c_str(), "wb");
+	if (!fp)
+		throw runtime_error("failed to open " + path + " for writing");
+
+	static const uint8_t zeros[meshPackStreamAlignment] = {};
+	auto vertexPadding = size_t(header.vertexOffset - tableEnd);
+	auto indexPadding = size_t(header.indexOffset - header.vertexOffset - vertexStream.size());
+	bool ok = fwrite(&header, sizeof(header), 1, fp) == 1 &&
+	          fwrite(attributes.data(), sizeof(MeshPackAttribute), attributes.size(), fp) == attributes.size() &&
+	          fwrite(submeshes.data(), sizeof(MeshPackSubmesh), submeshes.size(), fp) == submeshes.size() &&
+	          fwrite(materials.data(), sizeof(MeshPackMaterial), materials.size(), fp) == materials.size() &&
+	          fwrite(zeros, 1, vertexPadding, fp) == vertexPadding &&
+	          fwrite(vertexStream.data(), 1, vertexStream.size(), fp) == vertexStream.size() &&
+	          fwrite(zeros, 1, indexPadding, fp) == indexPadding &&
+	          fwrite(indexStream.data(), 1, indexStream.size(), fp) == indexStream.size();
+
+	if (fclose(fp) != 0 || !ok)
+		throw runtime_error("failed to write " + path);
+}
+
+static void usage(const char *argv0)
+{
+	fprintf(stderr,
+		"usage: %s [options] <input.obj> <output>\n"
+		"\n"
+		"  --flip-v          flip texture coordinates vertically\n"
+		"  --float-normals   store normals as floats instead of octahedral\n"
+		"  --packed-normals  store normals as 10:10:10:2 instead of octahedral\n"
+		"  --tangents        generate tangents from the texture coordinates\n"
+		"  --float-uvs       store texture coordinates as floats instead of halfs\n"
+		"  --optimize        reorder triangles and vertices for the vertex cache and fetch\n"
+		"  --overdraw        also reorder triangles to reduce overdraw; implies --optimize\n",
+		argv0);
+}
+
+int main(int argc, char *argv[])
+{
+	bool flipV = false, tangents = false;
+	auto normalEncoding = NormalEncoding::OCTAHEDRAL;
+	auto texCoordEncoding = TexCoordEncoding::HALF;
+	MeshOptimizeOptions optimizeOptions = { false, false, 1.05f, false };
+
+	int arg = 1;
+	for (; arg < argc && argv[arg][0] == '-'; ++arg) {
+		if (!strcmp(argv[arg], "--flip-v"))
+			flipV = true;
+		else if (!strcmp(argv[arg], "--float-normals"))
+			normalEncoding = NormalEncoding::FLOAT;
+		else if (!strcmp(argv[arg], "--packed-normals"))
+			normalEncoding = NormalEncoding::PACKED_10_10_10_2;
+		else if (!strcmp(argv[arg], "--tangents"))
+			tangents = true;
+		else if (!strcmp(argv[arg], "--float-uvs"))
+			texCoordEncoding = TexCoordEncoding::FLOAT;
+		else if (!strcmp(argv[arg], "--optimize"))
+			optimizeOptions.vertexCache = optimizeOptions.vertexFetch = true;
+		else if (!strcmp(argv[arg], "--overdraw"))
+			optimizeOptions.vertexCache = optimizeOptions.vertexFetch = optimizeOptions.overdraw = true;
+		else {
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (argc - arg != 2) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	string input = argv[arg], output = argv[arg + 1];
+
+	try {
+		auto mesh = loadObj(input);
+
+		// texture coordinates (and tangents, which derive from them) only when the file has any
+		bool hasUVs = !mesh.uvs.empty();
+		VertexLayout vertexLayout(normalEncoding, tangents && hasUVs, hasUVs ? 1 : 0, texCoordEncoding);
+		writeMeshPack(output, mesh, vertexLayout, flipV, optimizeOptions);
+	} catch (const std::exception &e) {
+		fprintf(stderr, "%s: %s\n", input.c_str(), e.what());
+		return 1;
+	}
+
+	return 0;
+}
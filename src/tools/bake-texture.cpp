@@ -0,0 +1,150 @@
+#include "../scene/decode-texture.h"
+#include "../scene/baked-texture-format.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using std::string;
+using std::vector;
+using std::runtime_error;
+
+static void writeBakedTexture(const string &path, BakedTextureType type, const vector<DecodedImage> &layers)
+{
+	assert(!layers.empty());
+	auto &first = layers[0];
+
+	BakedTextureHeader header = {};
+	header.magic = bakedTextureMagic;
+	header.version = bakedTextureVersion;
+	header.type = type;
+	header.format = first.format;
+	header.width = first.width;
+	header.height = first.height;
+	header.mipLevels = first.mipLevels;
+	header.arrayLayers = uint32_t(layers.size());
+
+	auto tableSize = sizeof(BakedTextureHeader) + sizeof(BakedTextureLevel) * header.mipLevels * header.arrayLayers;
+	header.payloadOffset = (tableSize + bakedTexturePayloadAlignment - 1) & ~(bakedTexturePayloadAlignment - 1);
+
+	// the decoded chains are 16-byte aligned per level already, so they're stored back to back
+	vector<BakedTextureLevel> levels;
+	for (auto &layer : layers) {
+		assert(layer.storedLevels == layer.mipLevels);
+		if (layer.format != first.format || layer.width != first.width || layer.height != first.height || layer.mipLevels != first.mipLevels)
+			throw runtime_error("inconsistent layers!");
+
+		for (auto mipLevel = 0; mipLevel < layer.mipLevels; ++mipLevel) {
+			BakedTextureLevel level;
+			level.offset = header.payloadSize + layer.mipOffsets[mipLevel];
+			level.size = layer.mipOffsets[mipLevel + 1] - layer.mipOffsets[mipLevel];
+			levels.push_back(level);
+		}
+		header.payloadSize += layer.pixels.size();
+	}
+
+	auto fp = fopen(path.c_str(), "wb");
+	if (!fp)
+		throw runtime_error("failed to open " + path + " for writing");
+
+	static const uint8_t zeros[bakedTexturePayloadAlignment] = {};
+	bool ok = fwrite(&header, sizeof(header), 1, fp) == 1 &&
+	          fwrite(levels.data(), sizeof(BakedTextureLevel), levels.size(), fp) == levels.size() &&
+	          fwrite(zeros, 1, size_t(header.payloadOffset - tableSize), fp) == header.payloadOffset - tableSize;
+
+	for (auto &layer : layers)
+		ok = ok && fwrite(layer.pixels.data(), 1, layer.pixels.size(), fp) == layer.pixels.size();
+
+	if (fclose(fp) != 0 || !ok)
+		throw runtime_error("failed to write " + path);
+}
+
+static void usage(const char *argv0)
+{
+	fprintf(stderr,
+		"usage: %s [options] <input> <output>\n"
+		"\n"
+		"  --array           input is a folder of 0000.png, 0001.png, ...\n"
+		"  --cube            input is a vertical cube cross\n"
+		"  --mipmaps         generate the full mip chain\n"
+		"  --srgb            8-bit color is sRGB-encoded\n"
+		"  --premultiply     premultiply color with alpha\n"
+		"  --kaiser          Kaiser mip filter instead of box\n"
+		"  --lanczos         Lanczos mip filter instead of box\n"
+		"  --alpha-coverage  preserve alpha-test coverage in the mips\n"
+		"  --bc1, --bc3, --bc5, --bc7\n"
+		"                    block compress; HDR images become BC6H\n",
+		argv0);
+}
+
+int main(int argc, char *argv[])
+{
+	auto type = BAKED_TEXTURE_2D;
+	auto flags = TextureImportFlags::NONE;
+
+	int arg = 1;
+	for (; arg < argc && argv[arg][0] == '-'; ++arg) {
+		if (!strcmp(argv[arg], "--array"))
+			type = BAKED_TEXTURE_2D_ARRAY;
+		else if (!strcmp(argv[arg], "--cube"))
+			type = BAKED_TEXTURE_CUBE;
+		else if (!strcmp(argv[arg], "--mipmaps"))
+			flags = flags | TextureImportFlags::GENERATE_MIPMAPS;
+		else if (!strcmp(argv[arg], "--srgb"))
+			flags = flags | TextureImportFlags::SRGB;
+		else if (!strcmp(argv[arg], "--premultiply"))
+			flags = flags | TextureImportFlags::PREMULTIPLY_ALPHA;
+		else if (!strcmp(argv[arg], "--kaiser"))
+			flags = flags | TextureImportFlags::MIPMAP_KAISER;
+		else if (!strcmp(argv[arg], "--lanczos"))
+			flags = flags | TextureImportFlags::MIPMAP_LANCZOS;
+		else if (!strcmp(argv[arg], "--alpha-coverage"))
+			flags = flags | TextureImportFlags::PRESERVE_ALPHA_COVERAGE;
+		else if (!strcmp(argv[arg], "--bc1"))
+			flags = flags | TextureImportFlags::COMPRESS_BC1;
+		else if (!strcmp(argv[arg], "--bc3"))
+			flags = flags | TextureImportFlags::COMPRESS_BC3;
+		else if (!strcmp(argv[arg], "--bc5"))
+			flags = flags | TextureImportFlags::COMPRESS_BC5;
+		else if (!strcmp(argv[arg], "--bc7"))
+			flags = flags | TextureImportFlags::COMPRESS_BC7;
+		else {
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (argc - arg != 2) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	string input = argv[arg], output = argv[arg + 1];
+
+	try {
+		vector<DecodedImage> layers;
+		switch (type) {
+		case BAKED_TEXTURE_2D:
+			layers = decodeImages(vector<string>(1, input), flags);
+			break;
+
+		case BAKED_TEXTURE_2D_ARRAY:
+			layers = decodeArrayFolder(input, flags);
+			break;
+
+		case BAKED_TEXTURE_CUBE:
+			layers = decodeCubeCrosses(vector<string>(1, input), flags);
+			break;
+		}
+
+		writeBakedTexture(output, type, layers);
+	} catch (const std::exception &e) {
+		fprintf(stderr, "%s: %s\n", input.c_str(), e.what());
+		return 1;
+	}
+
+	return 0;
+}
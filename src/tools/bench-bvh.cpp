@@ -0,0 +1,103 @@
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+
+#include "bench.h"
+
+#include "../scene/bvh.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <stdio.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+using std::vector;
+
+typedef std::chrono::steady_clock Clock;
+
+static double elapsedMilliseconds(Clock::time_point start, Clock::time_point end)
+{
+	return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+/*
+ * Boxes scattered through a 1000 unit cube around a camera at the origin,
+ * with a 60 degree field of view reaching 1000 units. Every frame some of
+ * them move, the tree is brought up to date and queried, and the result is
+ * checked against testing every box on its own.
+ */
+static void benchObjectCount(uint32_t objectCount, uint32_t movingEvery)
+{
+	Random random(objectCount);
+	vector<BoundingBox> boxes(objectCount);
+	vector<glm::vec3> velocities(objectCount);
+	for (auto i = 0u; i < objectCount; ++i) {
+		glm::vec3 center(random.nextFloat(-500, 500), random.nextFloat(-500, 500), random.nextFloat(-500, 500));
+		auto extent = glm::vec3(random.nextFloat(0.5f, 3.0f));
+		boxes[i] = BoundingBox(center - extent, center + extent);
+		velocities[i] = glm::vec3(random.nextFloat(-1, 1), random.nextFloat(-1, 1), random.nextFloat(-1, 1));
+	}
+
+	auto buildStart = Clock::now();
+	BoundingVolumeHierarchy bvh;
+	vector<BoundingVolumeHierarchy::NodeHandle> leaves(objectCount);
+	for (auto i = 0u; i < objectCount; ++i)
+		leaves[i] = bvh.insert(i, boxes[i]);
+	bvh.refit();
+	auto buildTime = elapsedMilliseconds(buildStart, Clock::now());
+
+	Frustum frustum(glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 1000.0f));
+
+	const int frameCount = 100;
+	double updateTime = 0.0, queryTime = 0.0, bruteForceTime = 0.0;
+	size_t visibleCount = 0;
+	int mismatches = 0;
+	vector<uint32_t> visible, bruteForceVisible;
+
+	for (int frame = 0; frame < frameCount; ++frame) {
+		auto updateStart = Clock::now();
+		for (auto i = 0u; i < objectCount; i += movingEvery) {
+			boxes[i].min += velocities[i];
+			boxes[i].max += velocities[i];
+			bvh.update(leaves[i], boxes[i]);
+		}
+		bvh.refit();
+
+		auto queryStart = Clock::now();
+		visible.clear();
+		bvh.findVisible(frustum, visible);
+
+		auto bruteForceStart = Clock::now();
+		bruteForceVisible.clear();
+		for (auto i = 0u; i < objectCount; ++i) {
+			auto planeMask = Frustum::allPlanes;
+			if (frustum.testBox(boxes[i], planeMask) != Containment::OUTSIDE)
+				bruteForceVisible.push_back(i);
+		}
+		auto bruteForceEnd = Clock::now();
+
+		updateTime += elapsedMilliseconds(updateStart, queryStart);
+		queryTime += elapsedMilliseconds(queryStart, bruteForceStart);
+		bruteForceTime += elapsedMilliseconds(bruteForceStart, bruteForceEnd);
+
+		std::sort(visible.begin(), visible.end());
+		if (visible != bruteForceVisible)
+			mismatches++;
+		visibleCount = visible.size();
+	}
+
+	printf("  %6u objects, 1/%-2u moving: build %7.2f ms, update and refit %6.3f ms, cull %6.3f ms, brute force %6.3f ms, %.1f%% culled\n",
+		objectCount, movingEvery, buildTime, updateTime / frameCount, queryTime / frameCount, bruteForceTime / frameCount,
+		100.0 * (objectCount - visibleCount) / objectCount);
+
+	if (mismatches > 0)
+		printf("  %d frames disagree with the brute force test!\n", mismatches);
+}
+
+void benchBoundingVolumeHierarchy()
+{
+	for (auto count : { 10000u, 100000u }) {
+		benchObjectCount(count, 4);
+		benchObjectCount(count, 50);
+	}
+}
@@ -0,0 +1,552 @@
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+
+#include "bench.h"
+
+#include "../vulkan.h"
+#include "../shader.h"
+#include "../scene/clustered-mesh.h"
+#include "../scene/occlusion-cull.h"
+#include "../scene/rendertarget.h"
+#include "../scene/scene.h"
+#include "../scene/uploadbatch.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <stdio.h>
+#include <stdexcept>
+#include <vector>
+
+using namespace vulkan;
+
+using std::vector;
+using std::runtime_error;
+
+namespace
+{
+	// depth only, as nothing gets drawn; the state that's left matches main.cpp
+	VkPipeline createDepthPipeline(VkPipelineLayout layout, VkRenderPass renderPass, const VkPipelineVertexInputStateCreateInfo &pipelineVertexInputStateCreateInfo, const char *vertexShaderPath)
+	{
+		VkPipelineInputAssemblyStateCreateInfo pipelineInputAssemblyStateCreateInfo = {};
+		pipelineInputAssemblyStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+		pipelineInputAssemblyStateCreateInfo.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+
+		VkPipelineRasterizationStateCreateInfo pipelineRasterizationStateCreateInfo = {};
+		pipelineRasterizationStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+		pipelineRasterizationStateCreateInfo.polygonMode = VK_POLYGON_MODE_FILL;
+		pipelineRasterizationStateCreateInfo.cullMode = VK_CULL_MODE_BACK_BIT;
+		pipelineRasterizationStateCreateInfo.frontFace = VK_FRONT_FACE_CLOCKWISE;
+		pipelineRasterizationStateCreateInfo.lineWidth = 1.0f;
+
+		VkPipelineColorBlendStateCreateInfo pipelineColorBlendStateCreateInfo = {};
+		pipelineColorBlendStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+
+		VkPipelineMultisampleStateCreateInfo pipelineMultisampleStateCreateInfo = {};
+		pipelineMultisampleStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+		pipelineMultisampleStateCreateInfo.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+		VkPipelineViewportStateCreateInfo pipelineViewportStateCreateInfo = {};
+		pipelineViewportStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+		pipelineViewportStateCreateInfo.viewportCount = 1;
+		pipelineViewportStateCreateInfo.scissorCount = 1;
+
+		VkPipelineDepthStencilStateCreateInfo pipelineDepthStencilStateCreateInfo = {};
+		pipelineDepthStencilStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+		pipelineDepthStencilStateCreateInfo.depthTestEnable = VK_TRUE;
+		pipelineDepthStencilStateCreateInfo.depthWriteEnable = VK_TRUE;
+		pipelineDepthStencilStateCreateInfo.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+
+		VkDynamicState dynamicStateEnables[] = {
+			VK_DYNAMIC_STATE_VIEWPORT,
+			VK_DYNAMIC_STATE_SCISSOR
+		};
+
+		VkPipelineDynamicStateCreateInfo pipelineDynamicStateCreateInfo = {};
+		pipelineDynamicStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+		pipelineDynamicStateCreateInfo.pDynamicStates = dynamicStateEnables;
+		pipelineDynamicStateCreateInfo.dynamicStateCount = ARRAY_SIZE(dynamicStateEnables);
+
+		VkPipelineShaderStageCreateInfo shaderStage = {};
+		shaderStage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		shaderStage.stage = VK_SHADER_STAGE_VERTEX_BIT;
+		shaderStage.module = loadShaderModule(vertexShaderPath);
+		shaderStage.pName = "main";
+
+		VkGraphicsPipelineCreateInfo pipelineCreateInfo = {};
+		pipelineCreateInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+		pipelineCreateInfo.layout = layout;
+		pipelineCreateInfo.renderPass = renderPass;
+		pipelineCreateInfo.pVertexInputState = &pipelineVertexInputStateCreateInfo;
+		pipelineCreateInfo.pInputAssemblyState = &pipelineInputAssemblyStateCreateInfo;
+		pipelineCreateInfo.pRasterizationState = &pipelineRasterizationStateCreateInfo;
+		pipelineCreateInfo.pColorBlendState = &pipelineColorBlendStateCreateInfo;
+		pipelineCreateInfo.pMultisampleState = &pipelineMultisampleStateCreateInfo;
+		pipelineCreateInfo.pViewportState = &pipelineViewportStateCreateInfo;
+		pipelineCreateInfo.pDepthStencilState = &pipelineDepthStencilStateCreateInfo;
+		pipelineCreateInfo.pDynamicState = &pipelineDynamicStateCreateInfo;
+		pipelineCreateInfo.stageCount = 1;
+		pipelineCreateInfo.pStages = &shaderStage;
+
+		VkPipeline pipeline;
+		auto err = vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineCreateInfo, nullptr, &pipeline);
+		assert(err == VK_SUCCESS);
+		return pipeline;
+	}
+
+	// a grid of quads, so the clustered mesh has a few meshlets
+	ClusteredMesh *createGridMesh(const VertexLayout &vertexLayout, int size)
+	{
+		vector<Vertex> vertices;
+		for (int y = 0; y <= size; ++y) {
+			for (int x = 0; x <= size; ++x) {
+				Vertex v = {};
+				v.position = glm::vec3(float(x) / size * 2 - 1, float(y) / size * 2 - 1, 0.0f);
+				vertices.push_back(v);
+			}
+		}
+
+		vector<uint32_t> indices;
+		for (int y = 0; y < size; ++y) {
+			for (int x = 0; x < size; ++x) {
+				uint32_t corner = y * (size + 1) + x;
+				uint32_t quad[] = { corner, corner + 1, corner + size + 1, corner + size + 1, corner + 1, corner + size + 2 };
+				indices.insert(indices.end(), quad, quad + ARRAY_SIZE(quad));
+			}
+		}
+
+		return new ClusteredMesh(vertexLayout, vertexLayout.pack(vertices), indices);
+	}
+
+	const int renderSize = 64;
+
+	// what both paths share, made on first use
+	struct RecordingSetup {
+		VertexLayout vertexLayout;
+		ClusteredMesh *clusteredMesh;
+
+		VkRenderPass renderPass;
+		DepthRenderTarget *depthRenderTarget;
+		VkFramebuffer framebuffer;
+
+		// per object, as in main.cpp
+		VkDescriptorSetLayout cullDescriptorSetLayout;
+		VkPipelineLayout cullPipelineLayout;
+		VkPipeline cullPipeline;
+		VkDescriptorSetLayout descriptorSetLayout;
+		VkPipelineLayout pipelineLayout;
+		VkPipeline pipeline;
+
+		// GPU-driven
+		VkDescriptorSetLayout cullAllocateDescriptorSetLayout;
+		VkPipelineLayout cullAllocatePipelineLayout;
+		VkPipeline cullAllocatePipeline;
+		VkDescriptorSetLayout batchCullDescriptorSetLayout;
+		VkPipelineLayout batchCullPipelineLayout;
+		VkPipeline batchCullPipeline;
+		VkDescriptorSetLayout drawCompactDescriptorSetLayout;
+		VkPipelineLayout drawCompactPipelineLayout;
+		VkPipeline drawCompactPipeline;
+		VkDescriptorSetLayout batchedDescriptorSetLayout;
+		VkPipelineLayout batchedPipelineLayout;
+		VkPipeline batchedPipeline;
+
+		VkCommandPool commandPool;
+		VkCommandBuffer commandBuffer;
+
+		RecordingSetup();
+	};
+
+	RecordingSetup::RecordingSetup() :
+		vertexLayout(NormalEncoding::NONE, false, 0)
+	{
+		vector<const char *> enabledExtensions = {
+			VK_KHR_SURFACE_EXTENSION_NAME,
+		};
+#ifndef NDEBUG
+		enabledExtensions.push_back(VK_EXT_DEBUG_REPORT_EXTENSION_NAME);
+#endif
+		instanceInit("bench", enabledExtensions);
+
+		uint32_t physicalDeviceCount = 0;
+		auto err = vkEnumeratePhysicalDevices(instance, &physicalDeviceCount, nullptr);
+		assert(err == VK_SUCCESS);
+		if (physicalDeviceCount == 0)
+			throw runtime_error("no vulkan device!");
+
+		vector<VkPhysicalDevice> physicalDevices(physicalDeviceCount);
+		err = vkEnumeratePhysicalDevices(instance, &physicalDeviceCount, physicalDevices.data());
+		assert(err == VK_SUCCESS);
+
+		// nothing's presented, so any graphics queue will do
+		deviceInit(physicalDevices[0], [](VkInstance, VkPhysicalDevice, uint32_t) {
+			return true;
+		});
+		if (enabledFeatures.drawIndirectFirstInstance != VK_TRUE)
+			throw runtime_error("GPU-driven rendering needs drawIndirectFirstInstance!");
+
+		// small, as every object of the per-object path has an index buffer of its own
+		clusteredMesh = createGridMesh(vertexLayout, 8);
+		UploadBatch uploadBatch;
+		clusteredMesh->upload(uploadBatch);
+		uploadBatch.submit();
+
+		auto depthFormat = findBestFormat({ VK_FORMAT_D32_SFLOAT, VK_FORMAT_X8_D24_UNORM_PACK32, VK_FORMAT_D16_UNORM },
+			VK_IMAGE_TILING_OPTIMAL, VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT);
+
+		VkAttachmentDescription attachment = {};
+		attachment.format = depthFormat;
+		attachment.samples = VK_SAMPLE_COUNT_1_BIT;
+		attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+		attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+		attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+		attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		attachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+		VkAttachmentReference depthStencilReference = {};
+		depthStencilReference.attachment = 0;
+		depthStencilReference.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+		VkSubpassDescription subpass = {};
+		subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+		subpass.pDepthStencilAttachment = &depthStencilReference;
+
+		VkRenderPassCreateInfo renderpassCreateInfo = {};
+		renderpassCreateInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+		renderpassCreateInfo.attachmentCount = 1;
+		renderpassCreateInfo.pAttachments = &attachment;
+		renderpassCreateInfo.subpassCount = 1;
+		renderpassCreateInfo.pSubpasses = &subpass;
+
+		err = vkCreateRenderPass(device, &renderpassCreateInfo, nullptr, &renderPass);
+		assert(err == VK_SUCCESS);
+
+		depthRenderTarget = new DepthRenderTarget(depthFormat, renderSize, renderSize);
+		framebuffer = createFramebuffer(renderSize, renderSize, 1, { depthRenderTarget->getImageView() }, renderPass);
+
+		auto vertexInputBindingDesc = vertexLayout.getBindingDescription(0);
+		auto vertexInputAttributeDescriptions = vertexLayout.getAttributeDescriptions(0);
+
+		VkPipelineVertexInputStateCreateInfo pipelineVertexInputStateCreateInfo = {};
+		pipelineVertexInputStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+		pipelineVertexInputStateCreateInfo.vertexBindingDescriptionCount = 1;
+		pipelineVertexInputStateCreateInfo.pVertexBindingDescriptions = &vertexInputBindingDesc;
+		pipelineVertexInputStateCreateInfo.vertexAttributeDescriptionCount = uint32_t(vertexInputAttributeDescriptions.size());
+		pipelineVertexInputStateCreateInfo.pVertexAttributeDescriptions = vertexInputAttributeDescriptions.data();
+
+		cullDescriptorSetLayout = createDescriptorSetLayout({
+			{ 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT },
+			{ 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT },
+			{ 2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT },
+			{ 3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT },
+			{ 4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT },
+		});
+		cullPipelineLayout = createPipelineLayout({ cullDescriptorSetLayout }, {
+			{ VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ClusterCullConstants) },
+		});
+		cullPipeline = createComputePipeline(cullPipelineLayout, loadShaderModule("data/shaders/cluster-cull.comp.spv"));
+
+		descriptorSetLayout = createDescriptorSetLayout({
+			{ 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1, VK_SHADER_STAGE_VERTEX_BIT },
+			{ 1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT },
+		});
+		pipelineLayout = createPipelineLayout({ descriptorSetLayout }, {});
+		pipeline = createDepthPipeline(pipelineLayout, renderPass, pipelineVertexInputStateCreateInfo, "data/shaders/triangle.vert.spv");
+
+		cullAllocateDescriptorSetLayout = createDescriptorSetLayout({
+			{ 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT },
+			{ 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT },
+			{ 2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT },
+		});
+		cullAllocatePipelineLayout = createPipelineLayout({ cullAllocateDescriptorSetLayout }, {
+			{ VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ClusterCullBatchConstants) },
+		});
+		cullAllocatePipeline = createComputePipeline(cullAllocatePipelineLayout, loadShaderModule("data/shaders/cluster-cull-allocate.comp.spv"));
+
+		batchCullDescriptorSetLayout = createDescriptorSetLayout({
+			{ 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT },
+			{ 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT },
+			{ 2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT },
+			{ 3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT },
+			{ 4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT },
+			{ 5, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 1, VK_SHADER_STAGE_COMPUTE_BIT },
+			{ 6, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT },
+			{ 7, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT },
+		});
+		batchCullPipelineLayout = createPipelineLayout({ batchCullDescriptorSetLayout }, {
+			{ VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ClusterCullConstants) },
+		});
+		batchCullPipeline = createComputePipeline(batchCullPipelineLayout, loadShaderModule("data/shaders/cluster-cull-batched.comp.spv"));
+
+		drawCompactDescriptorSetLayout = createDescriptorSetLayout({
+			{ 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT },
+			{ 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT },
+			{ 2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT },
+			{ 3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT },
+		});
+		drawCompactPipelineLayout = createPipelineLayout({ drawCompactDescriptorSetLayout }, {
+			{ VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ClusterCullBatchConstants) },
+		});
+		drawCompactPipeline = createComputePipeline(drawCompactPipelineLayout, loadShaderModule("data/shaders/draw-compact.comp.spv"));
+
+		batchedDescriptorSetLayout = createDescriptorSetLayout({
+			{ 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 1, VK_SHADER_STAGE_VERTEX_BIT },
+			{ 1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT },
+		});
+		batchedPipelineLayout = createPipelineLayout({ batchedDescriptorSetLayout }, {
+			{ VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(glm::mat4) },
+		});
+		batchedPipeline = createDepthPipeline(batchedPipelineLayout, renderPass, pipelineVertexInputStateCreateInfo, "data/shaders/triangle-batched.vert.spv");
+
+		commandPool = createCommandPool(graphicsQueueIndex);
+		commandBuffer = allocateCommandBuffers(commandPool, 1)[0];
+	}
+
+	RecordingSetup &getRecordingSetup()
+	{
+		static RecordingSetup setup;
+		return setup;
+	}
+
+	void writeBufferDescriptors(VkDescriptorSet descriptorSet, uint32_t binding, VkDescriptorType descriptorType, const vector<VkDescriptorBufferInfo> &bufferInfos)
+	{
+		VkWriteDescriptorSet writeDescriptorSet = {};
+		writeDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writeDescriptorSet.dstSet = descriptorSet;
+		writeDescriptorSet.dstBinding = binding;
+		writeDescriptorSet.descriptorCount = uint32_t(bufferInfos.size());
+		writeDescriptorSet.descriptorType = descriptorType;
+		writeDescriptorSet.pBufferInfo = bufferInfos.data();
+		vkUpdateDescriptorSets(device, 1, &writeDescriptorSet, 0, nullptr);
+	}
+
+	void beginRecording(VkCommandBuffer commandBuffer)
+	{
+		auto err = vkResetCommandBuffer(commandBuffer, 0);
+		assert(err == VK_SUCCESS);
+
+		VkCommandBufferBeginInfo commandBufferBeginInfo = {};
+		commandBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		commandBufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		err = vkBeginCommandBuffer(commandBuffer, &commandBufferBeginInfo);
+		assert(err == VK_SUCCESS);
+	}
+
+	void beginRenderPass(const RecordingSetup &setup)
+	{
+		VkClearValue clearValue = {};
+		clearValue.depthStencil.depth = 1.0f;
+
+		VkRenderPassBeginInfo renderPassBeginInfo = {};
+		renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+		renderPassBeginInfo.renderPass = setup.renderPass;
+		renderPassBeginInfo.renderArea.extent.width = renderSize;
+		renderPassBeginInfo.renderArea.extent.height = renderSize;
+		renderPassBeginInfo.clearValueCount = 1;
+		renderPassBeginInfo.pClearValues = &clearValue;
+		renderPassBeginInfo.framebuffer = setup.framebuffer;
+		vkCmdBeginRenderPass(setup.commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+		setViewport(setup.commandBuffer, 0, 0, float(renderSize), float(renderSize));
+		setScissor(setup.commandBuffer, 0, 0, renderSize, renderSize);
+
+		VkDeviceSize vertexBufferOffsets[1] = { 0 };
+		VkBuffer vertexBuffers[1] = { setup.clusteredMesh->getMesh().getVertexBuffer().getBuffer() };
+		vkCmdBindVertexBuffers(setup.commandBuffer, 0, 1, vertexBuffers, vertexBufferOffsets);
+	}
+}
+
+/*
+ * Records one culling phase of each path of main.cpp, for every object
+ * visible, and times only the CPU side; nothing is submitted. The occlusion
+ * cull dispatch before it, and the depth pyramid after, are the same for
+ * both and left out.
+ */
+static void benchObjectCount(RecordingSetup &setup, uint32_t objectCount)
+{
+	auto &clusteredMesh = *setup.clusteredMesh;
+	auto commandBuffer = setup.commandBuffer;
+
+	Random random(objectCount);
+	vector<glm::mat4> worldMatrices(objectCount);
+	for (auto &worldMatrix : worldMatrices)
+		worldMatrix = glm::translate(glm::mat4(1.0f), glm::vec3(random.nextFloat(-500, 500), random.nextFloat(-500, 500), random.nextFloat(-500, 500)));
+
+	auto viewProjectionMatrix = glm::perspective(glm::radians(60.0f), 1.0f, 0.1f, 1000.0f);
+	auto viewPosition = glm::vec3(0.0f);
+
+	OcclusionCullState occlusionCullState(objectCount);
+
+	// the per-object uniforms and the GPU objects, at the offsets main.cpp would use
+	auto uniformBufferSpacing = uint32_t(alignSize(sizeof(glm::mat4), deviceProperties.limits.minUniformBufferOffsetAlignment));
+	Buffer uniformBuffer(VkDeviceSize(uniformBufferSpacing) * objectCount, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	auto gpuObjectsSize = VkDeviceSize(sizeof(GpuObject)) * objectCount;
+	Buffer gpuObjectBuffer(gpuObjectsSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+	auto descriptorPool = createDescriptorPool({
+		{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 5 * objectCount + 14 },
+		{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 2 },
+		{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1 },
+	}, int(objectCount + 5));
+
+	vector<ClusterCullTarget *> cullTargets;
+	vector<VkDescriptorSet> cullDescriptorSets;
+	for (auto i = 0u; i < objectCount; ++i) {
+		auto cullTarget = new ClusterCullTarget(clusteredMesh);
+		auto cullDescriptorSet = allocateDescriptorSet(descriptorPool, setup.cullDescriptorSetLayout);
+		writeBufferDescriptors(cullDescriptorSet, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, {
+			clusteredMesh.getMeshletBuffer().getDescriptorBufferInfo(),
+			clusteredMesh.getMeshletVertexBuffer().getDescriptorBufferInfo(),
+			clusteredMesh.getMeshletTriangleBuffer().getDescriptorBufferInfo(),
+			cullTarget->getIndexBuffer().getDescriptorBufferInfo(),
+			cullTarget->getDrawCommandBuffer().getDescriptorBufferInfo(),
+		});
+		cullTargets.push_back(cullTarget);
+		cullDescriptorSets.push_back(cullDescriptorSet);
+	}
+
+	auto descriptorSet = allocateDescriptorSet(descriptorPool, setup.descriptorSetLayout);
+	writeBufferDescriptors(descriptorSet, 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, {
+		uniformBuffer.getDescriptorBufferInfo(0, sizeof(glm::mat4)),
+	});
+
+	const VkDeviceSize cullIndexBudget = 64 * 1024 * 1024;
+	ClusterCullBatchTarget cullBatchTarget(clusteredMesh, objectCount, cullIndexBudget);
+	auto useDrawCount = deviceFuncs.vkCmdDrawIndexedIndirectCountKHR != nullptr && objectCount <= deviceProperties.limits.maxDrawIndirectCount;
+
+	auto cullAllocateDescriptorSet = allocateDescriptorSet(descriptorPool, setup.cullAllocateDescriptorSetLayout);
+	writeBufferDescriptors(cullAllocateDescriptorSet, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, {
+		occlusionCullState.getDispatchCommandBuffer().getDescriptorBufferInfo(),
+		cullBatchTarget.getRegionOffsetBuffer().getDescriptorBufferInfo(),
+		cullBatchTarget.getIndexCursorBuffer().getDescriptorBufferInfo(),
+	});
+
+	auto batchCullDescriptorSet = allocateDescriptorSet(descriptorPool, setup.batchCullDescriptorSetLayout);
+	writeBufferDescriptors(batchCullDescriptorSet, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, {
+		clusteredMesh.getMeshletBuffer().getDescriptorBufferInfo(),
+		clusteredMesh.getMeshletVertexBuffer().getDescriptorBufferInfo(),
+		clusteredMesh.getMeshletTriangleBuffer().getDescriptorBufferInfo(),
+		cullBatchTarget.getIndexBuffer().getDescriptorBufferInfo(),
+		cullBatchTarget.getIndexCountBuffer().getDescriptorBufferInfo(),
+	});
+	writeBufferDescriptors(batchCullDescriptorSet, 5, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, {
+		gpuObjectBuffer.getDescriptorBufferInfo(0, gpuObjectsSize),
+	});
+	writeBufferDescriptors(batchCullDescriptorSet, 6, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, {
+		occlusionCullState.getDispatchCommandBuffer().getDescriptorBufferInfo(),
+		cullBatchTarget.getRegionOffsetBuffer().getDescriptorBufferInfo(),
+	});
+
+	auto drawCompactDescriptorSet = allocateDescriptorSet(descriptorPool, setup.drawCompactDescriptorSetLayout);
+	writeBufferDescriptors(drawCompactDescriptorSet, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, {
+		cullBatchTarget.getIndexCountBuffer().getDescriptorBufferInfo(),
+		cullBatchTarget.getDrawCommandBuffer().getDescriptorBufferInfo(),
+		cullBatchTarget.getDrawCountBuffer().getDescriptorBufferInfo(),
+		cullBatchTarget.getRegionOffsetBuffer().getDescriptorBufferInfo(),
+	});
+
+	auto batchedDescriptorSet = allocateDescriptorSet(descriptorPool, setup.batchedDescriptorSetLayout);
+	writeBufferDescriptors(batchedDescriptorSet, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, {
+		gpuObjectBuffer.getDescriptorBufferInfo(0, gpuObjectsSize),
+	});
+
+	const int runs = 10;
+
+	// a few commands per object, and the constants they push, as main.cpp does them every frame
+	auto perObjectTime = timeBest(runs, [&]() {
+		beginRecording(commandBuffer);
+
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, setup.cullPipeline);
+		for (auto i = 0u; i < objectCount; ++i) {
+			auto &worldMatrix = worldMatrices[i];
+			auto objectSpaceCamera = glm::vec3(glm::inverse(worldMatrix) * glm::vec4(viewPosition, 1.0f));
+			ClusterCullConstants cullConstants(viewProjectionMatrix * worldMatrix, objectSpaceCamera);
+
+			cullTargets[i]->beginCull(commandBuffer);
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, setup.cullPipelineLayout, 0, 1, &cullDescriptorSets[i], 0, nullptr);
+			vkCmdPushConstants(commandBuffer, setup.cullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(cullConstants), &cullConstants);
+			vkCmdDispatchIndirect(commandBuffer, occlusionCullState.getDispatchCommandBuffer().getBuffer(), occlusionCullState.getDispatchCommandOffset(i));
+			cullTargets[i]->endCull(commandBuffer);
+		}
+
+		beginRenderPass(setup);
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, setup.pipeline);
+		for (auto i = 0u; i < objectCount; ++i) {
+			uint32_t dynamicOffsets[] = { i * uniformBufferSpacing };
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, setup.pipelineLayout, 0, 1, &descriptorSet, 1, dynamicOffsets);
+			vkCmdBindIndexBuffer(commandBuffer, cullTargets[i]->getIndexBuffer().getBuffer(), 0, VK_INDEX_TYPE_UINT32);
+			vkCmdDrawIndexedIndirect(commandBuffer, cullTargets[i]->getDrawCommandBuffer().getBuffer(), 0, 1, sizeof(VkDrawIndexedIndirectCommand));
+		}
+		vkCmdEndRenderPass(commandBuffer);
+
+		auto err = vkEndCommandBuffer(commandBuffer);
+		assert(err == VK_SUCCESS);
+	});
+
+	auto gpuDrivenTime = timeBest(runs, [&]() {
+		beginRecording(commandBuffer);
+
+		auto groupCountY = std::min(objectCount, deviceProperties.limits.maxComputeWorkGroupCount[1]);
+		auto groupCountZ = (objectCount + groupCountY - 1) / groupCountY;
+		ClusterCullConstants cullConstants(viewProjectionMatrix, viewPosition);
+		ClusterCullBatchConstants batchConstants(cullBatchTarget, useDrawCount);
+		uint32_t gpuObjectsOffsets[] = { 0 };
+
+		cullBatchTarget.beginCull(commandBuffer);
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, setup.cullAllocatePipeline);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, setup.cullAllocatePipelineLayout, 0, 1, &cullAllocateDescriptorSet, 0, nullptr);
+		vkCmdPushConstants(commandBuffer, setup.cullAllocatePipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(batchConstants), &batchConstants);
+		vkCmdDispatch(commandBuffer, (objectCount + 63) / 64, 1, 1);
+		cullBatchTarget.endAllocate(commandBuffer);
+
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, setup.batchCullPipeline);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, setup.batchCullPipelineLayout, 0, 1, &batchCullDescriptorSet, 1, gpuObjectsOffsets);
+		vkCmdPushConstants(commandBuffer, setup.batchCullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(cullConstants), &cullConstants);
+		vkCmdDispatch(commandBuffer, clusteredMesh.getMeshletCount(), groupCountY, groupCountZ);
+		cullBatchTarget.endCull(commandBuffer);
+
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, setup.drawCompactPipeline);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, setup.drawCompactPipelineLayout, 0, 1, &drawCompactDescriptorSet, 0, nullptr);
+		vkCmdPushConstants(commandBuffer, setup.drawCompactPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(batchConstants), &batchConstants);
+		vkCmdDispatch(commandBuffer, (objectCount + 63) / 64, 1, 1);
+		cullBatchTarget.endCompact(commandBuffer);
+
+		beginRenderPass(setup);
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, setup.batchedPipeline);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, setup.batchedPipelineLayout, 0, 1, &batchedDescriptorSet, 1, gpuObjectsOffsets);
+		vkCmdPushConstants(commandBuffer, setup.batchedPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(viewProjectionMatrix), &viewProjectionMatrix);
+		vkCmdBindIndexBuffer(commandBuffer, cullBatchTarget.getIndexBuffer().getBuffer(), 0, VK_INDEX_TYPE_UINT32);
+
+		auto drawCommandBuffer = cullBatchTarget.getDrawCommandBuffer().getBuffer();
+		auto stride = uint32_t(sizeof(VkDrawIndexedIndirectCommand));
+		if (useDrawCount) {
+			deviceFuncs.vkCmdDrawIndexedIndirectCountKHR(commandBuffer, drawCommandBuffer, 0,
+				cullBatchTarget.getDrawCountBuffer().getBuffer(), 0, objectCount, stride);
+		} else {
+			auto maxDrawCount = enabledFeatures.multiDrawIndirect ? deviceProperties.limits.maxDrawIndirectCount : 1;
+			for (uint32_t first = 0; first < objectCount; first += maxDrawCount)
+				vkCmdDrawIndexedIndirect(commandBuffer, drawCommandBuffer, first * stride, std::min(maxDrawCount, objectCount - first), stride);
+		}
+		vkCmdEndRenderPass(commandBuffer);
+
+		auto err = vkEndCommandBuffer(commandBuffer);
+		assert(err == VK_SUCCESS);
+	});
+
+	printf("  %6u objects: per object %8.3f ms, GPU-driven %6.3f ms (%.0fx)\n",
+		objectCount, perObjectTime, gpuDrivenTime, perObjectTime / gpuDrivenTime);
+
+	// nothing was submitted, so all of it can go right away
+	vkResetCommandBuffer(commandBuffer, 0);
+	vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+	for (auto cullTarget : cullTargets)
+		delete cullTarget;
+}
+
+void benchCommandRecording()
+{
+	auto &setup = getRecordingSetup();
+
+	uint32_t objectCounts[] = { 1000, 10000, 100000 };
+	for (auto objectCount : objectCounts)
+		benchObjectCount(setup, objectCount);
+}
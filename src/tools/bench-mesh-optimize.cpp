@@ -0,0 +1,127 @@
+#include "bench.h"
+
+#include "../scene/mesh-optimize.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <vector>
+
+using std::vector;
+
+namespace
+{
+	struct TestMesh {
+		vector<float> positions; // three per vertex
+		vector<uint32_t> indices;
+	};
+
+	const int runs = 5;
+}
+
+// a grid of quads in the xy plane, triangles row by row, the way a generator writes them
+static TestMesh makeGrid(int size)
+{
+	TestMesh mesh;
+	for (auto y = 0; y <= size; ++y) {
+		for (auto x = 0; x <= size; ++x) {
+			mesh.positions.push_back(float(x));
+			mesh.positions.push_back(float(y));
+			mesh.positions.push_back(0.0f);
+		}
+	}
+
+	for (auto y = 0; y < size; ++y) {
+		for (auto x = 0; x < size; ++x) {
+			auto i = uint32_t(y * (size + 1) + x);
+			uint32_t quad[] = { i, i + 1, i + size + 1, i + 1, i + size + 2, i + size + 1 };
+			mesh.indices.insert(mesh.indices.end(), quad, quad + 6);
+		}
+	}
+	return mesh;
+}
+
+// a UV sphere, ring by ring, so overdraw ordering has sides to sort
+static TestMesh makeSphere(int rings, int segments)
+{
+	TestMesh mesh;
+	for (auto ring = 0; ring <= rings; ++ring) {
+		auto theta = 3.14159265f * ring / rings;
+		for (auto segment = 0; segment <= segments; ++segment) {
+			auto phi = 2.0f * 3.14159265f * segment / segments;
+			mesh.positions.push_back(sinf(theta) * cosf(phi));
+			mesh.positions.push_back(cosf(theta));
+			mesh.positions.push_back(sinf(theta) * sinf(phi));
+		}
+	}
+
+	for (auto ring = 0; ring < rings; ++ring) {
+		for (auto segment = 0; segment < segments; ++segment) {
+			auto i = uint32_t(ring * (segments + 1) + segment);
+			auto below = i + segments + 1;
+			uint32_t quad[] = { i, below, i + 1, i + 1, below, below + 1 };
+			mesh.indices.insert(mesh.indices.end(), quad, quad + 6);
+		}
+	}
+	return mesh;
+}
+
+// what merging and welding leave behind: no order at all
+static TestMesh shuffleTriangles(TestMesh mesh)
+{
+	Random random(uint32_t(mesh.indices.size()));
+	auto triangleCount = mesh.indices.size() / 3;
+	for (auto i = triangleCount - 1; i > 0; --i) {
+		auto j = size_t(random.next()) % (i + 1);
+		for (auto k = 0; k < 3; ++k)
+			std::swap(mesh.indices[i * 3 + k], mesh.indices[j * 3 + k]);
+	}
+	return mesh;
+}
+
+/*
+ * The passes one after another, as Mesh::optimize() and bake-mesh run
+ * them, each timed on its own input so repeated runs start from the same
+ * order. ACMR and ATVR are for the default simulated cache size.
+ */
+static void benchMesh(const char *name, const TestMesh &mesh)
+{
+	auto indexCount = mesh.indices.size();
+	auto vertexCount = mesh.positions.size() / 3;
+	auto positionStride = 3 * sizeof(float);
+
+	vector<uint32_t> cacheOrder(indexCount), overdrawOrder(indexCount), remap(vertexCount);
+
+	auto vertexCacheTime = timeBest(runs, [&]() {
+		optimizeVertexCache(cacheOrder.data(), mesh.indices.data(), indexCount, vertexCount);
+	});
+	auto overdrawTime = timeBest(runs, [&]() {
+		optimizeOverdraw(overdrawOrder.data(), cacheOrder.data(), indexCount, mesh.positions.data(), positionStride, vertexCount);
+	});
+	auto vertexFetchTime = timeBest(runs, [&]() {
+		optimizeVertexFetchRemap(remap.data(), overdrawOrder.data(), indexCount, vertexCount);
+	});
+
+	auto before = analyzeVertexCache(mesh.indices.data(), indexCount, vertexCount);
+	auto afterCache = analyzeVertexCache(cacheOrder.data(), indexCount, vertexCount);
+	auto afterOverdraw = analyzeVertexCache(overdrawOrder.data(), indexCount, vertexCount);
+
+	printf("  %-16s %7u triangles: ACMR %.3f -> %.3f -> %.3f, ATVR %.3f -> %.3f -> %.3f\n",
+		name, unsigned(indexCount / 3),
+		before.acmr, afterCache.acmr, afterOverdraw.acmr,
+		before.atvr, afterCache.atvr, afterOverdraw.atvr);
+	printf("  %36s vertex cache %7.2f ms, overdraw %7.2f ms, vertex fetch %6.2f ms\n",
+		"", vertexCacheTime, overdrawTime, vertexFetchTime);
+}
+
+void benchMeshOptimize()
+{
+	printf("  ACMR and ATVR as given, after vertex cache and after overdraw ordering\n");
+
+	auto grid = makeGrid(512);
+	benchMesh("grid", grid);
+	benchMesh("grid shuffled", shuffleTriangles(grid));
+
+	auto sphere = makeSphere(256, 512);
+	benchMesh("sphere", sphere);
+	benchMesh("sphere shuffled", shuffleTriangles(sphere));
+}
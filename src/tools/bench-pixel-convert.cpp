@@ -0,0 +1,121 @@
+#include "bench.h"
+
+#include "../core/core.h"
+#include "../scene/pixel-convert.h"
+
+#include <stdio.h>
+#include <vector>
+
+using std::vector;
+
+namespace
+{
+	struct KernelPath {
+		const char *name;
+		CpuFeatures features;
+		bool (*isSupported)(const CpuFeatures &detected);
+	};
+
+	struct ImageSize {
+		const char *name;
+		size_t width, height;
+	};
+
+	const ImageSize imageSizes[] = {
+		{ "4K", 3840, 2160 },
+		{ "8K", 7680, 4320 },
+	};
+
+	const int runs = 5;
+}
+
+static CpuFeatures makeFeatures(bool ssse3, bool avx, bool avx2, bool f16c)
+{
+	CpuFeatures features = {};
+	features.sse41 = ssse3;
+	features.ssse3 = ssse3;
+	features.avx = avx;
+	features.avx2 = avx2;
+	features.f16c = f16c;
+	return features;
+}
+
+template <typename ConvertImage>
+static void benchPaths(const char *kernelName, const KernelPath *paths, size_t pathCount, size_t bytesPerPixel, ConvertImage convertImage)
+{
+	auto &detected = getCpuFeatures();
+
+	for (auto &size : imageSizes) {
+		auto pixels = size.width * size.height;
+		double scalarTime = 0.0;
+
+		for (size_t i = 0; i < pathCount; ++i) {
+			auto &path = paths[i];
+			if (!path.isSupported(detected)) {
+				printf("  %-26s %s %-7s unsupported\n", kernelName, size.name, path.name);
+				continue;
+			}
+
+			restrictPixelConvertFeatures(path.features);
+			auto time = timeBest(runs, [&]() { convertImage(size.width, size.height); });
+			if (i == 0)
+				scalarTime = time;
+
+			printf("  %-26s %s %-7s %8.2f ms, %6.2f GB/s read, %.1fx\n",
+				kernelName, size.name, path.name, time,
+				pixels * bytesPerPixel / (time * 1e6), scalarTime / time);
+		}
+	}
+
+	restrictPixelConvertFeatures(detected);
+}
+
+static void benchSwizzle()
+{
+	static const KernelPath paths[] = {
+		{ "scalar", makeFeatures(false, false, false, false), [](const CpuFeatures &) { return true; } },
+		{ "SSSE3", makeFeatures(true, false, false, false), [](const CpuFeatures &cpu) { return cpu.ssse3; } },
+		{ "AVX2", makeFeatures(true, true, true, false), [](const CpuFeatures &cpu) { return cpu.avx2; } },
+	};
+
+	// large enough for the biggest image, which the smaller ones use the start of
+	auto &largest = imageSizes[ARRAY_SIZE(imageSizes) - 1];
+	vector<uint8_t> src(largest.width * largest.height * 4), dst(src.size());
+	for (size_t i = 0; i < src.size(); ++i)
+		src[i] = uint8_t(i * 7);
+
+	// BGRA to RGBA, as FreeImage hands it over
+	static const uint8_t order[4] = { 2, 1, 0, 3 };
+
+	benchPaths("swizzle BGRA8 to RGBA8", paths, ARRAY_SIZE(paths), 4, [&](size_t width, size_t height) {
+		for (size_t y = 0; y < height; ++y)
+			swizzleRow8(&src[y * width * 4], &dst[y * width * 4], width, order);
+		doNotOptimize(dst[width * height * 4 - 1]);
+	});
+}
+
+static void benchHalfFloat()
+{
+	static const KernelPath paths[] = {
+		{ "scalar", makeFeatures(false, false, false, false), [](const CpuFeatures &) { return true; } },
+		{ "F16C", makeFeatures(true, true, false, true), [](const CpuFeatures &cpu) { return cpu.avx && cpu.f16c; } },
+	};
+
+	auto &largest = imageSizes[ARRAY_SIZE(imageSizes) - 1];
+	vector<float> src(largest.width * largest.height * 3);
+	vector<uint16_t> dst(largest.width * largest.height * 4);
+	for (size_t i = 0; i < src.size(); ++i)
+		src[i] = float(i % 4096) / 1024.0f;
+
+	benchPaths("convert RGB32F to RGBA16F", paths, ARRAY_SIZE(paths), 12, [&](size_t width, size_t height) {
+		for (size_t y = 0; y < height; ++y)
+			convertRowRGB32FToRGBA16F(&src[y * width * 3], &dst[y * width * 4], width);
+		doNotOptimize(dst[width * height * 4 - 1]);
+	});
+}
+
+void benchPixelConvert()
+{
+	benchSwizzle();
+	benchHalfFloat();
+}
@@ -0,0 +1,141 @@
+#include "bench.h"
+
+#include "../scene/transformstore.h"
+
+#include <stdio.h>
+#include <algorithm>
+#include <list>
+#include <vector>
+
+using std::vector;
+
+namespace
+{
+	// the heap-allocated, child-list hierarchy that Scene used before TransformStore
+	class ListTransform {
+	public:
+		ListTransform() :
+			parent(nullptr),
+			localMatrix(1),
+			worldMatrix(1),
+			dirty(true)
+		{
+		}
+
+		virtual ~ListTransform()
+		{
+		}
+
+		void setParent(ListTransform *parent)
+		{
+			this->parent = parent;
+			parent->children.push_back(this);
+			dirty = true;
+		}
+
+		virtual glm::mat4 getLocalMatrix() const
+		{
+			return localMatrix;
+		}
+
+		void setLocalMatrix(const glm::mat4 &localMatrix)
+		{
+			this->localMatrix = localMatrix;
+			dirty = true;
+		}
+
+		const glm::mat4 &getWorldMatrix() const { return worldMatrix; }
+
+		void updateWorldMatrices(bool parentChanged = false)
+		{
+			if (dirty || parentChanged) {
+				worldMatrix = parent != nullptr ? parent->worldMatrix * getLocalMatrix() : getLocalMatrix();
+				parentChanged = true;
+				dirty = false;
+			}
+
+			for (auto child : children)
+				child->updateWorldMatrices(parentChanged);
+		}
+
+	private:
+		ListTransform *parent;
+		vector<ListTransform*> children;
+		glm::mat4 localMatrix;
+		glm::mat4 worldMatrix;
+		bool dirty;
+	};
+
+	glm::mat4 translation(float x)
+	{
+		glm::mat4 matrix(1);
+		matrix[3] = glm::vec4(x, 0, 0, 1);
+		return matrix;
+	}
+}
+
+static void benchTransformCount(uint32_t count, uint32_t movingEvery)
+{
+	// node 0 is the root, and every other node hangs off a random earlier one
+	vector<uint32_t> parents(count, 0);
+	Random random(count);
+	for (auto i = 1u; i < count; ++i)
+		parents[i] = random.next() % i;
+
+	vector<ListTransform*> nodes(count);
+	std::list<ListTransform*> transforms;
+	for (auto i = 0u; i < count; ++i) {
+		nodes[i] = new ListTransform();
+		if (i > 0)
+			nodes[i]->setParent(nodes[parents[i]]);
+		transforms.push_back(nodes[i]);
+	}
+
+	TransformStore store;
+	vector<TransformHandle> handles(count);
+	for (auto i = 0u; i < count; ++i)
+		handles[i] = store.create(i > 0 ? handles[parents[i]] : TransformStore::invalidHandle);
+
+	ThreadPool serialPool(0);
+	store.updateWorldMatrices(serialPool);
+
+	const int runs = 20;
+	int frame = 0;
+
+	auto listTime = timeBest(runs, [&]() {
+		auto matrix = translation(float(++frame));
+		uint32_t i = 0;
+		for (auto transform : transforms) {
+			if (i++ % movingEvery == 0)
+				transform->setLocalMatrix(matrix);
+		}
+		nodes[0]->updateWorldMatrices();
+		doNotOptimize(nodes[count - 1]->getWorldMatrix()[3][0]);
+	});
+
+	auto storeUpdate = [&](ThreadPool &threadPool) {
+		auto matrix = translation(float(++frame));
+		for (auto i = 0u; i < count; i += movingEvery)
+			store.setLocalMatrix(handles[i], matrix);
+		store.updateWorldMatrices(threadPool);
+		doNotOptimize(store.getWorldMatrix(handles[count - 1])[3][0]);
+	};
+
+	auto storeTime = timeBest(runs, [&]() { storeUpdate(serialPool); });
+	auto parallelTime = timeBest(runs, [&]() { storeUpdate(ThreadPool::getDefault()); });
+
+	printf("  %6u transforms, 1/%-3u moving: list %7.3f ms, store %7.3f ms (%.1fx), store on %u threads %7.3f ms (%.1fx)\n",
+		count, movingEvery, listTime, storeTime, listTime / storeTime,
+		ThreadPool::getDefault().getThreadCount() + 1, parallelTime, listTime / parallelTime);
+
+	for (auto node : nodes)
+		delete node;
+}
+
+void benchTransforms()
+{
+	for (auto count : { 1000u, 10000u, 100000u }) {
+		benchTransformCount(count, 1);
+		benchTransformCount(count, 100);
+	}
+}
@@ -0,0 +1,70 @@
+#include "bench.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdexcept>
+
+volatile float benchSink;
+
+namespace
+{
+	struct Benchmark {
+		const char *name;
+		void (*run)();
+	};
+
+	const Benchmark benchmarks[] = {
+		{ "transforms", benchTransforms },
+		{ "pixel-convert", benchPixelConvert },
+		{ "bvh", benchBoundingVolumeHierarchy },
+		{ "mesh-optimize", benchMeshOptimize },
+		{ "command-recording", benchCommandRecording },
+	};
+}
+
+static void usage(const char *argv0)
+{
+	fprintf(stderr, "usage: %s [benchmark...]\n\nbenchmarks:\n", argv0);
+	for (auto &benchmark : benchmarks)
+		fprintf(stderr, "  %s\n", benchmark.name);
+}
+
+static const Benchmark *findBenchmark(const char *name)
+{
+	for (auto &benchmark : benchmarks) {
+		if (!strcmp(name, benchmark.name))
+			return &benchmark;
+	}
+	return nullptr;
+}
+
+int main(int argc, char *argv[])
+{
+	for (int arg = 1; arg < argc; ++arg) {
+		if (!findBenchmark(argv[arg])) {
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	// all of them when none are named
+	for (auto &benchmark : benchmarks) {
+		auto selected = argc < 2;
+		for (int arg = 1; arg < argc; ++arg)
+			selected = selected || !strcmp(argv[arg], benchmark.name);
+
+		if (selected) {
+			printf("%s:\n", benchmark.name);
+			try {
+				benchmark.run();
+			} catch (const std::exception &e) {
+				// the ones that need a device can't run everywhere
+				fprintf(stderr, "%s failed: %s\n", benchmark.name, e.what());
+				return 1;
+			}
+			printf("\n");
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,55 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdint.h>
+#include <algorithm>
+#include <chrono>
+
+// runs func a few times and returns the fastest run, in milliseconds
+template <typename Func>
+static double timeBest(int runs, Func func)
+{
+	auto best = 1e30;
+	for (int i = 0; i < runs; ++i) {
+		auto start = std::chrono::steady_clock::now();
+		func();
+		auto end = std::chrono::steady_clock::now();
+		best = std::min(best, std::chrono::duration<double, std::milli>(end - start).count());
+	}
+	return best;
+}
+
+// a small LCG, so runs are repeatable everywhere
+struct Random {
+	uint32_t state;
+
+	explicit Random(uint32_t seed) : state(seed) {}
+
+	// 24 random bits
+	uint32_t next()
+	{
+		state = state * 1664525u + 1013904223u;
+		return state >> 8;
+	}
+
+	float nextFloat(float min, float max)
+	{
+		return min + (max - min) * (float(next()) / float(1 << 24));
+	}
+};
+
+// keeps the optimizer from dropping work whose result is otherwise unused
+extern volatile float benchSink;
+
+static inline void doNotOptimize(float value)
+{
+	benchSink = value;
+}
+
+void benchTransforms();
+void benchPixelConvert();
+void benchBoundingVolumeHierarchy();
+void benchMeshOptimize();
+void benchCommandRecording();
+
+#endif // BENCH_H
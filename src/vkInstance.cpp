@@ -25,7 +25,10 @@ VkPhysicalDeviceProperties vulkan::deviceProperties;
 VkPhysicalDeviceMemoryProperties vulkan::deviceMemoryProperties;
 uint32_t vulkan::graphicsQueueIndex = UINT32_MAX;
 VkQueue vulkan::graphicsQueue;
+uint32_t vulkan::transferQueueIndex = UINT32_MAX;
+VkQueue vulkan::transferQueue;
 VkCommandPool vulkan::setupCommandPool;
+VkCommandPool vulkan::transferCommandPool;
 VkDebugReportCallbackEXT vulkan::debugReportCallback;
 
 #ifndef NDEBUG
@@ -124,6 +127,77 @@ static uint32_t findQueue(VkPhysicalDevice physicalDevice, VkQueueFlags required
 	throw runtime_error("failed to find queue!");
 }
 
+/*
+ * Prefer a transfer-only family (usually a DMA engine), then any other
+ * family that can transfer (async compute), and finally share the graphics
+ * family.
+ *
+ * A transfer-only family may have a coarse minImageTransferGranularity,
+ * which limits image copies to multiples of it. TextureBase copies whole
+ * levels of any size, so such a family is skipped; graphics and compute
+ * families always have a granularity of one texel.
+ */
+static uint32_t findTransferQueue(VkPhysicalDevice physicalDevice, uint32_t graphicsQueueIndex)
+{
+	uint32_t queueCount;
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueCount, nullptr);
+	assert(queueCount > 0);
+
+	vector<VkQueueFamilyProperties> props(queueCount);
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueCount, props.data());
+
+	// graphics and compute queues implicitly support transfers
+	auto canTransfer = [](const VkQueueFamilyProperties &props) {
+		return (props.queueFlags & (VK_QUEUE_TRANSFER_BIT | VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)) != 0 &&
+		       props.queueCount > 0;
+	};
+
+	auto hasTexelGranularity = [](const VkQueueFamilyProperties &props) {
+		auto &granularity = props.minImageTransferGranularity;
+		return granularity.width == 1 && granularity.height == 1 && granularity.depth == 1;
+	};
+
+	for (uint32_t i = 0; i < queueCount; i++) {
+		if (i != graphicsQueueIndex && canTransfer(props[i]) && hasTexelGranularity(props[i]) &&
+		    (props[i].queueFlags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)) == 0)
+			return i;
+	}
+
+	for (uint32_t i = 0; i < queueCount; i++) {
+		if (i != graphicsQueueIndex && canTransfer(props[i]) && hasTexelGranularity(props[i]))
+			return i;
+	}
+
+	return graphicsQueueIndex;
+}
+
+template <typename T>
+static T getDeviceProc(VkDevice device, const char *entrypoint)
+{
+	auto ret = reinterpret_cast<T>(vkGetDeviceProcAddr(device, entrypoint));
+	assert(ret != nullptr);
+	return ret;
+}
+
+struct vulkan::device_funcs vulkan::deviceFuncs;
+
+static bool hasDeviceExtension(VkPhysicalDevice physicalDevice, const char *name)
+{
+	uint32_t extensionCount = 0;
+	VkResult err = vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, nullptr);
+	assert(err == VK_SUCCESS);
+
+	vector<VkExtensionProperties> extensions(extensionCount);
+	err = vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, extensions.data());
+	assert(err == VK_SUCCESS);
+
+	for (auto &extension : extensions) {
+		if (strcmp(extension.extensionName, name) == 0)
+			return true;
+	}
+	return false;
+}
+
 void vulkan::deviceInit(VkPhysicalDevice physicalDevice, function<bool(VkInstance, VkPhysicalDevice, uint32_t)> usableQueue)
 {
 	vulkan::physicalDevice = physicalDevice;
@@ -132,30 +206,43 @@ void vulkan::deviceInit(VkPhysicalDevice physicalDevice, function<bool(VkInstanc
 	vkGetPhysicalDeviceFeatures(physicalDevice, &physicalDeviceFeatures);
 
 	enabledFeatures.samplerAnisotropy = physicalDeviceFeatures.samplerAnisotropy;
+	enabledFeatures.textureCompressionBC = physicalDeviceFeatures.textureCompressionBC;
+	enabledFeatures.multiDrawIndirect = physicalDeviceFeatures.multiDrawIndirect;
+	enabledFeatures.drawIndirectFirstInstance = physicalDeviceFeatures.drawIndirectFirstInstance;
 
 	vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
 
 	graphicsQueueIndex = findQueue(physicalDevice, VK_QUEUE_GRAPHICS_BIT, usableQueue);
+	transferQueueIndex = findTransferQueue(physicalDevice, graphicsQueueIndex);
 
-	VkDeviceQueueCreateInfo queueCreateInfo = {};
+	VkDeviceQueueCreateInfo queueCreateInfos[2] = {};
 	float queuePriorities = 0.0f;
-	queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-	queueCreateInfo.queueFamilyIndex = graphicsQueueIndex;
-	queueCreateInfo.queueCount = 1;
-	queueCreateInfo.pQueuePriorities = &queuePriorities;
+	queueCreateInfos[0].sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+	queueCreateInfos[0].queueFamilyIndex = graphicsQueueIndex;
+	queueCreateInfos[0].queueCount = 1;
+	queueCreateInfos[0].pQueuePriorities = &queuePriorities;
+
+	queueCreateInfos[1] = queueCreateInfos[0];
+	queueCreateInfos[1].queueFamilyIndex = transferQueueIndex;
 
 	VkDeviceCreateInfo deviceCreateInfo = {};
 	deviceCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
 	deviceCreateInfo.pNext = nullptr;
-	deviceCreateInfo.queueCreateInfoCount = 1;
-	deviceCreateInfo.pQueueCreateInfos = &queueCreateInfo;
+	deviceCreateInfo.queueCreateInfoCount = transferQueueIndex != graphicsQueueIndex ? 2 : 1;
+	deviceCreateInfo.pQueueCreateInfos = queueCreateInfos;
 	deviceCreateInfo.pEnabledFeatures = &enabledFeatures;
 
-	const char *enabledExtensions[] = {
+	vector<const char *> enabledExtensions = {
 		VK_KHR_SWAPCHAIN_EXTENSION_NAME,
 	};
-	deviceCreateInfo.enabledExtensionCount = ARRAY_SIZE(enabledExtensions);
-	deviceCreateInfo.ppEnabledExtensionNames = enabledExtensions;
+
+	// optional, see deviceFuncs
+	auto hasDrawIndirectCount = hasDeviceExtension(physicalDevice, VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+	if (hasDrawIndirectCount)
+		enabledExtensions.push_back(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+
+	deviceCreateInfo.enabledExtensionCount = uint32_t(enabledExtensions.size());
+	deviceCreateInfo.ppEnabledExtensionNames = enabledExtensions.data();
 
 #ifndef NDEBUG
 	deviceCreateInfo.ppEnabledLayerNames = validationLayerNames;
@@ -167,16 +254,14 @@ void vulkan::deviceInit(VkPhysicalDevice physicalDevice, function<bool(VkInstanc
 
 	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &deviceMemoryProperties);
 	vkGetDeviceQueue(device, graphicsQueueIndex, 0, &graphicsQueue);
+	vkGetDeviceQueue(device, transferQueueIndex, 0, &transferQueue);
 
-	setupCommandPool = createCommandPool(graphicsQueueIndex);
-}
+	deviceFuncs.vkCmdDrawIndexedIndirectCountKHR = hasDrawIndirectCount ?
+		getDeviceProc<PFN_vkCmdDrawIndexedIndirectCountKHR>(device, "vkCmdDrawIndexedIndirectCountKHR") :
+		nullptr;
 
-template <typename T>
-static T getDeviceProc(VkDevice device, const char *entrypoint)
-{
-	auto ret = reinterpret_cast<T>(vkGetDeviceProcAddr(device, entrypoint));
-	assert(ret != nullptr);
-	return ret;
+	setupCommandPool = createCommandPool(graphicsQueueIndex);
+	transferCommandPool = transferQueueIndex != graphicsQueueIndex ? createCommandPool(transferQueueIndex) : setupCommandPool;
 }
 
 struct vulkan::instance_funcs vulkan::instanceFuncs;
@@ -0,0 +1,299 @@
+#include "vulkan.h"
+
+#include <mutex>
+#include <stdexcept>
+
+using namespace vulkan;
+
+using std::vector;
+using std::runtime_error;
+
+namespace
+{
+	struct FreeRange {
+		VkDeviceSize offset, size;
+	};
+
+	struct MemoryBlock {
+		VkDeviceMemory deviceMemory;
+		VkDeviceSize size;
+		uint8_t *mappedData;
+		bool dedicated;
+		uint32_t allocationCount;
+		vector<FreeRange> freeRanges; // sorted by offset, never adjacent
+	};
+
+	struct MemoryPool {
+		uint32_t memoryTypeIndex;
+		VkDeviceSize blockSize;
+		VkDeviceSize extraAlignment;
+		bool hostVisible, hostCoherent;
+		vector<MemoryBlock> blocks;
+	};
+
+	std::mutex poolMutex;
+	vector<MemoryPool> pools;
+
+	const VkDeviceSize defaultBlockSize = 64 * 1024 * 1024;
+}
+
+static MemoryPool &getPool(uint32_t memoryTypeIndex, bool linearResource, uint32_t *poolIndex)
+{
+	if (pools.empty()) {
+		pools.resize(deviceMemoryProperties.memoryTypeCount * 2);
+		for (auto i = 0u; i < pools.size(); ++i) {
+			auto &pool = pools[i];
+			auto &memoryType = deviceMemoryProperties.memoryTypes[i / 2];
+			auto heapSize = deviceMemoryProperties.memoryHeaps[memoryType.heapIndex].size;
+
+			pool.memoryTypeIndex = i / 2;
+			pool.blockSize = std::min(defaultBlockSize, alignSize(heapSize / 8, 1024 * 1024));
+			pool.hostVisible = (memoryType.propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) != 0;
+			pool.hostCoherent = (memoryType.propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+
+			// flushing needs nonCoherentAtomSize-aligned ranges
+			pool.extraAlignment = pool.hostVisible && !pool.hostCoherent ? deviceProperties.limits.nonCoherentAtomSize : 1;
+		}
+	}
+
+	// without a granularity restriction, buffers and images can share blocks
+	if (deviceProperties.limits.bufferImageGranularity <= 1)
+		linearResource = true;
+
+	*poolIndex = memoryTypeIndex * 2 + (linearResource ? 1 : 0);
+	return pools[*poolIndex];
+}
+
+static uint32_t createBlock(MemoryPool &pool, VkDeviceSize size, bool dedicated)
+{
+	MemoryBlock block;
+	block.deviceMemory = allocateDeviceMemory(size, pool.memoryTypeIndex);
+	block.size = size;
+	block.mappedData = nullptr;
+	block.dedicated = dedicated;
+	block.allocationCount = 0;
+	block.freeRanges.push_back({ 0, size });
+
+	if (pool.hostVisible) {
+		void *ptr;
+		VkResult err = vkMapMemory(device, block.deviceMemory, 0, VK_WHOLE_SIZE, 0, &ptr);
+		assert(err == VK_SUCCESS);
+		block.mappedData = static_cast<uint8_t *>(ptr);
+	}
+
+	// reuse slots of released blocks, so block indices stay stable
+	for (auto i = 0u; i < pool.blocks.size(); ++i) {
+		if (pool.blocks[i].deviceMemory == VK_NULL_HANDLE) {
+			pool.blocks[i] = block;
+			return i;
+		}
+	}
+
+	pool.blocks.push_back(block);
+	return uint32_t(pool.blocks.size() - 1);
+}
+
+static void releaseBlock(MemoryBlock &block)
+{
+	if (block.mappedData != nullptr)
+		vkUnmapMemory(device, block.deviceMemory);
+
+	vkFreeMemory(device, block.deviceMemory, nullptr);
+	block.deviceMemory = VK_NULL_HANDLE;
+	block.mappedData = nullptr;
+	block.freeRanges.clear();
+}
+
+static bool allocateFromBlock(MemoryBlock &block, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize *offset)
+{
+	// best fit, to keep large ranges intact for large resources
+	auto best = block.freeRanges.end();
+	VkDeviceSize bestWaste = ~VkDeviceSize(0);
+	for (auto it = block.freeRanges.begin(); it != block.freeRanges.end(); ++it) {
+		auto alignedOffset = alignSize(it->offset, alignment);
+		if (alignedOffset + size > it->offset + it->size)
+			continue;
+
+		auto waste = it->size - size;
+		if (waste < bestWaste) {
+			best = it;
+			bestWaste = waste;
+		}
+	}
+
+	if (best == block.freeRanges.end())
+		return false;
+
+	auto range = *best;
+	auto alignedOffset = alignSize(range.offset, alignment);
+	auto end = alignedOffset + size;
+	auto rangeEnd = range.offset + range.size;
+
+	// keep the alignment padding and the tail as separate free ranges
+	best = block.freeRanges.erase(best);
+	if (end < rangeEnd)
+		best = block.freeRanges.insert(best, { end, rangeEnd - end });
+	if (range.offset < alignedOffset)
+		block.freeRanges.insert(best, { range.offset, alignedOffset - range.offset });
+
+	block.allocationCount++;
+	*offset = alignedOffset;
+	return true;
+}
+
+static void freeToBlock(MemoryBlock &block, VkDeviceSize offset, VkDeviceSize size)
+{
+	auto next = std::lower_bound(block.freeRanges.begin(), block.freeRanges.end(), offset,
+		[](const FreeRange &range, VkDeviceSize offset) {
+			return range.offset < offset;
+		});
+
+	auto it = block.freeRanges.insert(next, { offset, size });
+
+	// merge with the following range
+	auto following = it + 1;
+	if (following != block.freeRanges.end() && it->offset + it->size == following->offset) {
+		it->size += following->size;
+		it = block.freeRanges.erase(following) - 1;
+	}
+
+	// ...and the preceding one
+	if (it != block.freeRanges.begin()) {
+		auto preceding = it - 1;
+		if (preceding->offset + preceding->size == it->offset) {
+			preceding->size += it->size;
+			block.freeRanges.erase(it);
+		}
+	}
+
+	assert(block.allocationCount > 0);
+	block.allocationCount--;
+}
+
+DeviceMemoryAllocation vulkan::allocateDeviceMemory(const VkMemoryRequirements &memoryRequirements, VkMemoryPropertyFlags propertyFlags, bool linearResource)
+{
+	std::lock_guard<std::mutex> lock(poolMutex);
+
+	auto memoryTypeIndex = getMemoryTypeIndex(memoryRequirements, propertyFlags);
+
+	uint32_t poolIndex;
+	auto &pool = getPool(memoryTypeIndex, linearResource, &poolIndex);
+
+	auto size = memoryRequirements.size;
+	auto alignment = std::max(memoryRequirements.alignment, pool.extraAlignment);
+	if (pool.extraAlignment > 1)
+		size = alignSize(size, pool.extraAlignment);
+
+	DeviceMemoryAllocation allocation = {};
+	allocation.size = size;
+	allocation.poolIndex = poolIndex;
+
+	auto blockIndex = ~0u;
+	if (size > pool.blockSize / 2) {
+		// big resources get a block of their own
+		blockIndex = createBlock(pool, size, true);
+		auto ok = allocateFromBlock(pool.blocks[blockIndex], size, alignment, &allocation.offset);
+		assert(ok);
+		(void)ok;
+	} else {
+		for (auto i = 0u; i < pool.blocks.size(); ++i) {
+			auto &block = pool.blocks[i];
+			if (block.deviceMemory == VK_NULL_HANDLE || block.dedicated)
+				continue;
+
+			if (allocateFromBlock(block, size, alignment, &allocation.offset)) {
+				blockIndex = i;
+				break;
+			}
+		}
+
+		if (blockIndex == ~0u) {
+			blockIndex = createBlock(pool, pool.blockSize, false);
+			if (!allocateFromBlock(pool.blocks[blockIndex], size, alignment, &allocation.offset))
+				throw runtime_error("failed to sub-allocate device memory!");
+		}
+	}
+
+	auto &block = pool.blocks[blockIndex];
+	allocation.blockIndex = blockIndex;
+	allocation.deviceMemory = block.deviceMemory;
+	allocation.mappedData = block.mappedData != nullptr ? block.mappedData + allocation.offset : nullptr;
+	return allocation;
+}
+
+void vulkan::freeDeviceMemory(const DeviceMemoryAllocation &allocation)
+{
+	std::lock_guard<std::mutex> lock(poolMutex);
+
+	assert(allocation.poolIndex < pools.size());
+	auto &pool = pools[allocation.poolIndex];
+
+	assert(allocation.blockIndex < pool.blocks.size());
+	auto &block = pool.blocks[allocation.blockIndex];
+	assert(block.deviceMemory == allocation.deviceMemory);
+
+	freeToBlock(block, allocation.offset, allocation.size);
+	if (block.allocationCount > 0)
+		return;
+
+	if (block.dedicated) {
+		releaseBlock(block);
+		return;
+	}
+
+	// keep one empty block around per pool, to avoid allocation ping-pong
+	for (auto i = 0u; i < pool.blocks.size(); ++i) {
+		auto &other = pool.blocks[i];
+		if (i != allocation.blockIndex && other.deviceMemory != VK_NULL_HANDLE &&
+		    !other.dedicated && other.allocationCount == 0) {
+			releaseBlock(block);
+			return;
+		}
+	}
+}
+
+void vulkan::flushDeviceMemory(const DeviceMemoryAllocation &allocation)
+{
+	assert(allocation.poolIndex < pools.size());
+	if (pools[allocation.poolIndex].hostCoherent)
+		return;
+
+	VkMappedMemoryRange mappedMemoryRange = {};
+	mappedMemoryRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+	mappedMemoryRange.memory = allocation.deviceMemory;
+	mappedMemoryRange.offset = allocation.offset;
+	mappedMemoryRange.size = allocation.size;
+
+	VkResult err = vkFlushMappedMemoryRanges(device, 1, &mappedMemoryRange);
+	assert(err == VK_SUCCESS);
+}
+
+DeviceMemoryStatistics vulkan::getDeviceMemoryStatistics()
+{
+	std::lock_guard<std::mutex> lock(poolMutex);
+
+	DeviceMemoryStatistics statistics = {};
+	for (auto &pool : pools) {
+		for (auto &block : pool.blocks) {
+			if (block.deviceMemory == VK_NULL_HANDLE)
+				continue;
+
+			statistics.blockCount++;
+			if (block.dedicated)
+				statistics.dedicatedBlockCount++;
+
+			statistics.allocationCount += block.allocationCount;
+			statistics.blockBytes += block.size;
+
+			VkDeviceSize freeBytes = 0;
+			for (auto &range : block.freeRanges) {
+				freeBytes += range.size;
+				statistics.largestFreeRange = std::max(statistics.largestFreeRange, range.size);
+			}
+			statistics.freeRangeCount += uint32_t(block.freeRanges.size());
+			statistics.usedBytes += block.size - freeBytes;
+		}
+	}
+
+	return statistics;
+}
@@ -23,7 +23,12 @@ namespace vulkan
 	extern VkQueue graphicsQueue;
 	extern uint32_t graphicsQueueIndex;
 
+	// equal to the graphics queue when the device has no separate family
+	extern VkQueue transferQueue;
+	extern uint32_t transferQueueIndex;
+
 	extern VkCommandPool setupCommandPool;
+	extern VkCommandPool transferCommandPool;
 
 	extern VkDebugReportCallbackEXT debugReportCallback;
 
@@ -36,6 +41,11 @@ namespace vulkan
 		PFN_vkDebugReportMessageEXT vkDebugReportMessageEXT;
 	} instanceFuncs;
 
+	extern struct device_funcs {
+		// null without VK_KHR_draw_indirect_count
+		PFN_vkCmdDrawIndexedIndirectCountKHR vkCmdDrawIndexedIndirectCountKHR;
+	} deviceFuncs;
+
 	inline VkDeviceSize alignSize(VkDeviceSize value, VkDeviceSize alignment)
 	{
 		return ((value + alignment - 1) / alignment) * alignment;
@@ -70,6 +80,36 @@ namespace vulkan
 		return deviceMemory;
 	}
 
+	struct DeviceMemoryAllocation {
+		VkDeviceMemory deviceMemory;
+		VkDeviceSize offset;
+		VkDeviceSize size;
+		void *mappedData; // points at offset; nullptr unless host visible
+		uint32_t poolIndex;
+		uint32_t blockIndex;
+	};
+
+	struct DeviceMemoryStatistics {
+		uint32_t blockCount;
+		uint32_t dedicatedBlockCount;
+		uint32_t allocationCount;
+		VkDeviceSize blockBytes;
+		VkDeviceSize usedBytes;
+		uint32_t freeRangeCount;
+		VkDeviceSize largestFreeRange;
+	};
+
+	/*
+	 * Sub-allocates from large per-memory-type blocks instead of calling
+	 * vkAllocateMemory for every resource. Host visible blocks stay mapped.
+	 * Buffers and linear images must pass linearResource = true, so they
+	 * never share a page with optimal images (bufferImageGranularity).
+	 */
+	DeviceMemoryAllocation allocateDeviceMemory(const VkMemoryRequirements &memoryRequirements, VkMemoryPropertyFlags propertyFlags, bool linearResource);
+	void freeDeviceMemory(const DeviceMemoryAllocation &allocation);
+	void flushDeviceMemory(const DeviceMemoryAllocation &allocation);
+	DeviceMemoryStatistics getDeviceMemoryStatistics();
+
 	inline VkCommandBuffer *allocateCommandBuffers(VkCommandPool commandPool, int commandBufferCount)
 	{
 		VkCommandBufferAllocateInfo commandAllocInfo = {};
@@ -203,6 +243,33 @@ namespace vulkan
 			oldQueueFamily, newQueueFamily);
 	}
 
+	inline void bufferBarrier(VkCommandBuffer commandBuffer, VkBuffer buffer,
+		VkDeviceSize offset, VkDeviceSize size,
+		VkPipelineStageFlags srcStage, VkPipelineStageFlags dstStage,
+		VkAccessFlags srcAccess, VkAccessFlags dstAccess,
+		uint32_t oldQueueFamily = VK_QUEUE_FAMILY_IGNORED,
+		uint32_t newQueueFamily = VK_QUEUE_FAMILY_IGNORED)
+	{
+		VkBufferMemoryBarrier bufferBarrier = {
+			VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+			nullptr,
+			srcAccess,
+			dstAccess,
+			oldQueueFamily,
+			newQueueFamily,
+			buffer,
+			offset,
+			size
+		};
+
+		vkCmdPipelineBarrier(
+			commandBuffer, srcStage, dstStage, 0,
+			0, nullptr,
+			1, &bufferBarrier,
+			0, nullptr
+		);
+	}
+
 	inline void blitImage(
 		VkCommandBuffer commandBuffer,
 		VkImage srcImage, VkImage dstImage,
@@ -312,13 +379,13 @@ namespace vulkan
 		return imageView;
 	}
 
-	inline VkSampler createSampler(float maxLod, bool repeat, bool wantAnisotropy)
+	inline VkSampler createSampler(float maxLod, bool repeat, bool wantAnisotropy, VkFilter filter = VK_FILTER_LINEAR)
 	{
 		VkSamplerCreateInfo samplerCreateInfo = {};
 		samplerCreateInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
-		samplerCreateInfo.magFilter = VK_FILTER_LINEAR;
-		samplerCreateInfo.minFilter = VK_FILTER_LINEAR;
-		samplerCreateInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+		samplerCreateInfo.magFilter = filter;
+		samplerCreateInfo.minFilter = filter;
+		samplerCreateInfo.mipmapMode = filter == VK_FILTER_NEAREST ? VK_SAMPLER_MIPMAP_MODE_NEAREST : VK_SAMPLER_MIPMAP_MODE_LINEAR;
 		samplerCreateInfo.addressModeU = repeat ? VK_SAMPLER_ADDRESS_MODE_REPEAT : VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
 		samplerCreateInfo.addressModeV = repeat ? VK_SAMPLER_ADDRESS_MODE_REPEAT : VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
 		samplerCreateInfo.addressModeW = repeat ? VK_SAMPLER_ADDRESS_MODE_REPEAT : VK_SAMPLER_ADDRESS_MODE_REPEAT;
@@ -379,6 +446,22 @@ namespace vulkan
 		return pipelineLayout;
 	}
 
+	inline VkPipeline createComputePipeline(VkPipelineLayout layout, VkShaderModule shaderModule, const char *name = "main")
+	{
+		VkComputePipelineCreateInfo computePipelineCreateInfo = {};
+		computePipelineCreateInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+		computePipelineCreateInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		computePipelineCreateInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+		computePipelineCreateInfo.stage.module = shaderModule;
+		computePipelineCreateInfo.stage.pName = name;
+		computePipelineCreateInfo.layout = layout;
+
+		VkPipeline computePipeline;
+		auto err = vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &computePipelineCreateInfo, nullptr, &computePipeline);
+		assert(err == VK_SUCCESS);
+		return computePipeline;
+	}
+
 	inline VkDescriptorSetLayout createDescriptorSetLayout(const std::vector<VkDescriptorSetLayoutBinding> &layoutBindings, VkDescriptorSetLayoutCreateFlags flags = 0)
 	{
 		VkDescriptorSetLayoutCreateInfo desciptorSetLayoutCreateInfo = {};